@@ -0,0 +1,432 @@
+#include <stdio.h>      // for file and console I/O
+#include <stdlib.h>     // for malloc/free
+#include <string.h>     // for string handling functions
+#include <unistd.h>     // for sysconf
+#include "batch.h"      // for batch declarations
+#include "encode.h"     // for do_encoding
+#include "decode.h"     // for do_decoding
+#include "pool.h"       // for the work-stealing pool
+#include "stats.h"      // for stats_now_ms
+
+typedef struct _BatchJob
+{
+    int line;               // manifest line number, used in the report
+    BatchSpec spec;         // what to run, tokens copied off the line
+    char *label;            // "line <n>: <cover>: " in front of the job's errors
+
+    const StegoOptions *opts;
+    const BatchWorkers *workers;   // per-worker buffers and rings
+    int wave;               // runs after every job of the waves before it
+    const struct _BatchJob *input_from[2];   // earlier jobs writing its image / secret, NULL for none
+    Status status;
+    double ms;              // wall time of the job
+
+} BatchJob;
+
+typedef struct _BatchPath
+{
+    const char *name;
+    int slot;               // job * 3 + 0 for its image, 1 for its secret, 2 for its output
+
+} BatchPath;
+
+typedef struct _BatchFile
+{
+    int write_wave;         // wave of the latest job writing it, -1 for none
+    const BatchJob *writer; // that job
+    int read_wave;          // latest wave reading it, -1 for none
+
+} BatchFile;
+
+Status batch_run_job(const BatchSpec *spec, const StegoOptions *job_opts, unsigned char *buf, Uring *uring)
+{
+    StegoOptions opts = *job_opts;
+
+    opts.magic = spec->magic;  // no prompts inside the pool
+    opts.quiet = 1;            // results are reported per job instead
+    opts.threads = 1;          // parallelism comes from running jobs side by side
+    opts.stats = 0;            // process-wide counters would mix the jobs
+
+    if (spec->op == e_encode)
+    {
+        EncodeInfo encInfo = {0};
+        encInfo.opts = opts;
+        encInfo.src_image_fname = spec->image;
+        encInfo.secret_fname = spec->secret;
+        encInfo.secret_extn = spec->secret_extn;
+        encInfo.stego_image_fname = spec->output;
+        encInfo.block.buf = buf;
+        encInfo.block.shared_buf = 1;
+        encInfo.block.uring = uring;
+        return do_encoding(&encInfo);
+    }
+    else
+    {
+        DecodeInfo decInfo = {0};
+        decInfo.opts = opts;
+        decInfo.stego_image_fname = spec->image;
+        decInfo.output_fname = spec->output;
+        decInfo.block.buf = buf;
+        decInfo.block.shared_buf = 1;
+        decInfo.block.uring = uring;
+        return do_decoding(&decInfo);
+    }
+}
+
+// run one job on the calling worker, reusing that worker's block buffer
+static void run_job(void *arg, int worker)
+{
+    BatchJob *job = arg;
+    double start = stats_now_ms();
+
+    set_error_label(job->label);   // jobs side by side print their errors on one stdout
+    job->status = e_success;
+    for (int k = 0; k < 2; k++)    // the earlier wave has finished, its results are final
+    {
+        if (job->input_from[k] != NULL && job->input_from[k]->status == e_failure)
+        {
+            print_error("not run, its input comes from line %d, which failed\n", job->input_from[k]->line);
+            job->status = e_failure;
+        }
+    }
+    if (job->status == e_success)
+        job->status = batch_run_job(&job->spec, job->opts, job->workers->buffers[worker],
+                                    job->workers->urings != NULL ? &job->workers->urings[worker] : NULL);
+    set_error_label(NULL);
+    job->ms = stats_now_ms() - start;
+}
+
+// one io_uring per worker, or NULL to stay on stdio when the kernel does not offer it
+static Uring *setup_urings(int workers, size_t block_size)
+{
+    Uring *urings = calloc(workers, sizeof(Uring));
+    int ready = 0;
+
+    while (urings != NULL && ready < workers && uring_init(&urings[ready], block_size) == e_success)
+        ready++;
+
+    if (urings == NULL || ready < workers)
+    {
+        printf("io_uring is not available, jobs use stdio\n");
+        for (int i = 0; i < ready; i++)
+            uring_free(&urings[i]);
+        free(urings);
+        return NULL;
+    }
+    return urings;
+}
+
+Status batch_setup_workers(BatchWorkers *workers, int count, const StegoOptions *opts)
+{
+    workers->count = count;
+    workers->urings = NULL;
+    workers->buffers = calloc(count, sizeof(unsigned char *));
+    if (workers->buffers == NULL)
+        return e_failure;
+
+    for (int i = 0; i < count; i++)   // reused by every job the worker runs
+    {
+        workers->buffers[i] = aligned_alloc(64, (opts->block_size + 63) / 64 * 64);
+        if (workers->buffers[i] == NULL)
+            return e_failure;
+    }
+    if (opts->uring)
+        workers->urings = setup_urings(count, opts->block_size);
+    return e_success;
+}
+
+void batch_free_workers(BatchWorkers *workers)
+{
+    for (int i = 0; workers->urings != NULL && i < workers->count; i++)
+        uring_free(&workers->urings[i]);
+    free(workers->urings);
+    for (int i = 0; workers->buffers != NULL && i < workers->count; i++)
+        free(workers->buffers[i]);
+    free(workers->buffers);
+    workers->urings = NULL;
+    workers->buffers = NULL;
+}
+
+static char *dup_token(const char *token)
+{
+    char *copy = malloc(strlen(token) + 1);
+    if (copy != NULL)
+        strcpy(copy, token);
+    return copy;
+}
+
+const char *batch_parse_job(char *tok[], int n, BatchSpec *spec)
+{
+    memset(spec, 0, sizeof(*spec));
+
+    if (n == 5 && strcmp(tok[0], "-e") == 0)
+    {
+        const char *dot = strrchr(tok[2], '.');
+        const char *slash = strrchr(tok[2], '/');
+        if (dot == NULL || (slash != NULL && dot < slash))
+            return "the secret file has no extension";
+        spec->op = e_encode;
+        spec->image = tok[1];
+        spec->secret = tok[2];
+        spec->output = tok[3];
+        spec->magic = tok[4];
+    }
+    else if (n == 4 && strcmp(tok[0], "-d") == 0)
+    {
+        spec->op = e_decode;
+        spec->image = tok[1];
+        spec->output = tok[2];
+        spec->magic = tok[3];
+    }
+    else
+        return "expected \"-e cover secret output magic\" or \"-d stego output magic\"";
+    return NULL;
+}
+
+// split one manifest line into a job, returns e_failure on a malformed line
+static Status parse_job(char *line, int line_no, BatchJob *job)
+{
+    char *save, *tok[6];
+    int n = 0;
+    BatchSpec spec;
+
+    for (char *t = strtok_r(line, " \t\r\n", &save); t != NULL && n < 6; t = strtok_r(NULL, " \t\r\n", &save))
+        tok[n++] = t;
+
+    memset(job, 0, sizeof(*job));
+    job->line = line_no;
+
+    const char *why = batch_parse_job(tok, n, &spec);
+    if (why != NULL)
+    {
+        printf("manifest line %d: %s\n", line_no, why);
+        return e_failure;
+    }
+    job->spec.op = spec.op;
+    job->spec.image = dup_token(spec.image);
+    job->spec.secret = spec.secret != NULL ? dup_token(spec.secret) : NULL;
+    job->spec.output = dup_token(spec.output);
+    job->spec.magic = dup_token(spec.magic);
+
+    size_t len = strlen(spec.image) + 32;
+    job->label = malloc(len);
+    if (job->label != NULL)
+        snprintf(job->label, len, "line %d: %s: ", line_no, spec.image);
+    return e_success;
+}
+
+// read every job of the manifest, skipping blank and comment lines
+static Status read_manifest(const char *fname, BatchJob **jobs_out, int *count_out)
+{
+    FILE *fptr = fopen(fname, "r");
+    if (fptr == NULL)
+    {
+        printf("Error: manifest %s not found\n", fname);
+        return e_failure;
+    }
+
+    char line[MAX_MANIFEST_LINE];
+    BatchJob *jobs = NULL;
+    int count = 0, cap = 0, line_no = 0;
+    Status status = e_success;
+
+    while (fgets(line, sizeof(line), fptr) != NULL)
+    {
+        line_no++;
+        char *hash = strchr(line, '#');
+        if (hash != NULL)
+            *hash = '\0';
+        if (strspn(line, " \t\r\n") == strlen(line))
+            continue;
+
+        if (count == cap)
+        {
+            cap = cap ? cap * 2 : 64;
+            BatchJob *grown = realloc(jobs, cap * sizeof(BatchJob));
+            if (grown == NULL)
+            {
+                status = e_failure;
+                break;
+            }
+            jobs = grown;
+        }
+
+        if (parse_job(line, line_no, &jobs[count]) == e_failure)
+        {
+            status = e_failure;
+            break;
+        }
+        count++;
+    }
+    fclose(fptr);
+
+    *jobs_out = jobs;
+    *count_out = count;
+    return status;
+}
+
+static int compare_name(const void *a, const void *b)
+{
+    return strcmp(((const BatchPath *)a)->name, ((const BatchPath *)b)->name);
+}
+
+static int compare_wave(const void *a, const void *b)
+{
+    const BatchJob *x = *(BatchJob *const *)a, *y = *(BatchJob *const *)b;
+    return x->wave != y->wave ? x->wave - y->wave : x->line - y->line;
+}
+
+// put jobs sharing a file in manifest order: a job reading a file an earlier line writes,
+// or writing one an earlier line reads or writes, goes into a later wave than that line.
+// Files are matched by the name as written. order receives the jobs wave by wave
+static Status order_jobs(BatchJob *jobs, int count, BatchJob **order)
+{
+    if (count == 0)
+        return e_success;
+
+    BatchPath *paths = malloc(count * 3 * sizeof(BatchPath));
+    int *file_of = malloc(count * 3 * sizeof(int));           // file of every slot, -1 for none
+    BatchFile *files = malloc(count * 3 * sizeof(BatchFile));
+    int n = 0, nfiles = 0;
+
+    if (paths == NULL || file_of == NULL || files == NULL)
+    {
+        free(paths);
+        free(file_of);
+        free(files);
+        return e_failure;
+    }
+
+    for (int i = 0; i < count; i++)
+    {
+        const char *names[3] = { jobs[i].spec.image, jobs[i].spec.secret, jobs[i].spec.output };
+        for (int k = 0; k < 3; k++)
+        {
+            file_of[i * 3 + k] = -1;
+            if (names[k] != NULL)
+                paths[n++] = (BatchPath){ names[k], i * 3 + k };
+        }
+    }
+    qsort(paths, n, sizeof(BatchPath), compare_name);
+    for (int i = 0; i < n; i++)
+    {
+        if (i == 0 || strcmp(paths[i].name, paths[i - 1].name) != 0)
+            files[nfiles++] = (BatchFile){ -1, NULL, -1 };
+        file_of[paths[i].slot] = nfiles - 1;
+    }
+
+    for (int i = 0; i < count; i++)   // manifest order
+    {
+        BatchFile *in[2], *out = &files[file_of[i * 3 + 2]];
+        int wave = (out->write_wave > out->read_wave ? out->write_wave : out->read_wave) + 1;
+
+        for (int k = 0; k < 2; k++)
+        {
+            in[k] = file_of[i * 3 + k] >= 0 ? &files[file_of[i * 3 + k]] : NULL;
+            jobs[i].input_from[k] = in[k] != NULL ? in[k]->writer : NULL;
+            if (in[k] != NULL && in[k]->write_wave + 1 > wave)
+                wave = in[k]->write_wave + 1;
+        }
+        for (int k = 0; k < 2; k++)
+        {
+            if (in[k] != NULL && in[k]->read_wave < wave)
+                in[k]->read_wave = wave;
+        }
+        out->write_wave = wave;
+        out->writer = &jobs[i];
+        jobs[i].wave = wave;
+        order[i] = &jobs[i];
+    }
+    qsort(order, count, sizeof(BatchJob *), compare_wave);
+
+    free(paths);
+    free(file_of);
+    free(files);
+    return e_success;
+}
+
+static void free_jobs(BatchJob *jobs, int count)
+{
+    for (int i = 0; i < count; i++)
+    {
+        free(jobs[i].spec.image);
+        free(jobs[i].spec.secret);
+        free(jobs[i].spec.output);
+        free(jobs[i].spec.magic);
+        free(jobs[i].label);
+    }
+    free(jobs);
+}
+
+Status do_batch(const char *manifest_fname, const StegoOptions *opts)
+{
+    BatchJob *jobs;
+    int count;
+
+    if (read_manifest(manifest_fname, &jobs, &count) == e_failure)
+    {
+        free_jobs(jobs, count);
+        return e_failure;
+    }
+
+    int workers = opts->threads > 0 ? opts->threads : (int)sysconf(_SC_NPROCESSORS_ONLN);
+    if (workers < 1)
+        workers = 1;
+    if (workers > count && count > 0)
+        workers = count;
+
+    BatchWorkers per_worker = {0};   // one block buffer (and ring) per worker
+    BatchJob **order = malloc((count + 1) * sizeof(BatchJob *));
+    Status status = order != NULL ? batch_setup_workers(&per_worker, workers, opts) : e_failure;
+    if (status == e_success)
+        status = order_jobs(jobs, count, order);
+    ThreadPool pool;
+    double start = stats_now_ms();
+
+    if (status == e_success && pool_init(&pool, workers) == e_success)
+    {
+        for (int i = 0; i < count; i++)
+        {
+            jobs[i].opts = opts;
+            jobs[i].workers = &per_worker;
+            jobs[i].status = e_failure;
+        }
+        for (int i = 0; i < count; i++)
+        {
+            if (i > 0 && order[i]->wave != order[i - 1]->wave)
+                pool_wait(&pool);   // the jobs of the next wave read or replace files of this one
+            if (pool_submit(&pool, run_job, order[i]) == e_failure)
+                break;
+        }
+        pool_wait(&pool);
+        pool_destroy(&pool);
+    }
+    else
+    {
+        printf("Error: unable to set up %d batch workers\n", workers);
+        status = e_failure;
+    }
+
+    double total = stats_now_ms() - start;
+    int failed = 0;
+
+    for (int i = 0; status == e_success && i < count; i++)   // one result line per job
+    {
+        BatchJob *job = &jobs[i];
+        printf("line %d: %s %s -> %s: %s (%.2f ms)\n", job->line,
+               job->spec.op == e_encode ? "encode" : "decode", job->spec.image, job->spec.output,
+               job->status == e_success ? "ok" : "FAILED", job->ms);
+        if (job->status == e_failure)
+            failed++;
+    }
+
+    if (status == e_success)
+        printf("Batch finished: %d jobs, %d ok, %d failed, %d workers, %.2f ms (%.1f jobs/s)\n",
+               count, count - failed, failed, workers, total, total > 0 ? count * 1000.0 / total : 0.0);
+
+    batch_free_workers(&per_worker);
+    free(order);
+    free_jobs(jobs, count);
+
+    return status == e_success && failed == 0 ? e_success : e_failure;
+}
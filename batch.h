@@ -0,0 +1,66 @@
+#ifndef BATCH_H
+#define BATCH_H
+
+#include "types.h"    // Contains user-defined types
+#include "options.h"  // Contains command-line options
+#include "uring.h"    // Contains the per-worker io_uring
+
+/*
+ * Batch mode: run every encode / decode job listed in a manifest
+ * on a work-stealing thread pool inside this one process.
+ *
+ * Manifest format, one job per line, '#' starts a comment:
+ *     -e <cover.bmp> <secret.ext> <output.bmp> <magic>
+ *     -d <stego.bmp> <output> <magic>
+ *
+ * Jobs run side by side in no particular order, except where lines
+ * share a file (named the same way): a job reading a file an earlier
+ * line writes, or writing one an earlier line reads or writes, waits
+ * for that line, so "-d" may take the stego image of an "-e" above
+ * it. A job whose input comes from a line that failed is not run.
+ *
+ * With --uring every worker gets its own io_uring (see uring.h), so
+ * the next blocks of a cover are read and finished stego blocks are
+ * written while the worker embeds; without io_uring the jobs fall
+ * back to stdio.
+ */
+
+#define MAX_MANIFEST_LINE 4096
+
+typedef struct _BatchSpec
+{
+    OperationType op;       // e_encode or e_decode
+    char *image;            // cover (encode) or stego image (decode)
+    char *secret;           // secret file, encode only
+    char *secret_extn;      // extension stored for the secret, NULL to take it from its name
+    char *output;           // stego image (encode) or decoded file (decode)
+    char *magic;
+
+} BatchSpec;
+
+typedef struct _BatchWorkers
+{
+    int count;                  // workers
+    unsigned char **buffers;    // per-worker block buffers
+    Uring *urings;              // per-worker io_uring, NULL on stdio
+
+} BatchWorkers;
+
+/* One block buffer per worker and, with opts->uring, one io_uring each (stdio when the
+   kernel has none); batch_free_workers also takes one that failed half way */
+Status batch_setup_workers(BatchWorkers *workers, int count, const StegoOptions *opts);
+
+/* Free the buffers and rings of batch_setup_workers */
+void batch_free_workers(BatchWorkers *workers);
+
+/* Split the file names and magic of one job off the tokens of a manifest line,
+   returns NULL or why the job is malformed */
+const char *batch_parse_job(char *tok[], int n, BatchSpec *spec);
+
+/* Run one job on the calling thread with its own block buffer (and io_uring, or NULL) */
+Status batch_run_job(const BatchSpec *spec, const StegoOptions *opts, unsigned char *buf, Uring *uring);
+
+/* Run all jobs of the manifest and print one result line per job */
+Status do_batch(const char *manifest_fname, const StegoOptions *opts);
+
+#endif
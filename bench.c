@@ -0,0 +1,417 @@
+#include <stdio.h>      // for file and console I/O
+#include <stdlib.h>     // for malloc/free
+#include <string.h>     // for string handling functions
+#include <stdint.h>     // for uint8_t
+#include <unistd.h>     // for sysconf/unlink
+#include "bench.h"      // for bench declarations
+#include "encode.h"     // for do_encoding
+#include "decode.h"     // for do_decoding
+#include "stego.h"      // for the in-memory encode/decode
+#include "lsb.h"        // for the selected kernels
+#include "cover.h"      // for the BMP header layout and parser
+#include "crc32c.h"     // for the data checksum
+#include "cipher.h"     // for the data keystream
+#include "stats.h"      // for stats_now_ms
+
+typedef Status (*BenchFn)(void *ctx);
+
+typedef struct _BenchCase
+{
+    size_t mp;                 // megapixels of the cover
+    int bpp;                   // bits per pixel of the cover
+
+    uint8_t *cover;            // synthetic image in memory
+    size_t cover_len;
+    BmpInfo bmp;
+    uint8_t *secret;           // random secret that fills most of the cover
+    size_t secret_len;
+    uint8_t *out;              // stego image / extracted secret
+    uint8_t *data;
+    StegoParams params;
+    Cipher cipher;             // key of the *_cipher strategies
+
+    char dir[64];              // scratch directory for the file strategies
+    char cover_fname[96];
+    char secret_fname[96];
+    char tiny_fname[96];       // one byte secret for tail_copy
+    char stego_fname[96];
+    char decoded_fname[96];
+    StegoOptions opts;         // options of the strategy being timed
+    int tiny;                  // encode the one byte secret
+
+} BenchCase;
+
+// xorshift64 noise, good enough for pixels and secrets
+static void fill_random(uint8_t *buf, size_t n, uint64_t *state)
+{
+    uint64_t x = *state;
+
+    for (size_t i = 0; i < n; i++)
+    {
+        x ^= x << 13;
+        x ^= x >> 7;
+        x ^= x << 17;
+        buf[i] = x >> 56;
+    }
+    *state = x;
+}
+
+static void put_le16(uint8_t *p, uint32_t v)
+{
+    p[0] = v;
+    p[1] = v >> 8;
+}
+
+static void put_le32(uint8_t *p, uint32_t v)
+{
+    put_le16(p, v);
+    put_le16(p + 2, v >> 16);
+}
+
+// floor of the square root, by Newton steps from above (keeps bench off libm)
+static size_t isqrt(size_t n)
+{
+    size_t x = n, y = (n + 1) / 2;
+
+    while (y < x)
+    {
+        x = y;
+        y = (x + n / x) / 2;
+    }
+    return x;
+}
+
+// bottom-up BITMAPINFOHEADER image of about mp megapixels with random pixels;
+// the width is odd so 24 bpp rows carry padding like most real covers
+static uint8_t *make_bmp(size_t mp, int bpp, size_t *len, uint64_t *state)
+{
+    size_t pixels = mp * 1000000;
+    size_t width = isqrt(pixels) | 1;
+    size_t height = pixels / width;
+    size_t stride = (width * bpp / 8 + 3) & ~(size_t)3;
+
+    *len = BMP_MIN_HEADER_SIZE + stride * height;
+    uint8_t *image = malloc(*len);
+    if (image == NULL)
+        return NULL;
+
+    memset(image, 0, BMP_MIN_HEADER_SIZE);
+    image[0] = 'B';
+    image[1] = 'M';
+    put_le32(image + 2, *len > UINT32_MAX ? 0 : *len);
+    put_le32(image + 10, BMP_MIN_HEADER_SIZE);
+    put_le32(image + 14, BMP_MIN_HEADER_SIZE - BMP_FILE_HEADER_SIZE);
+    put_le32(image + 18, width);
+    put_le32(image + 22, height);
+    put_le16(image + 26, 1);       // planes
+    put_le16(image + 28, bpp);
+    put_le32(image + 34, stride * height);
+    fill_random(image + BMP_MIN_HEADER_SIZE, *len - BMP_MIN_HEADER_SIZE, state);
+    return image;
+}
+
+static Status write_file(const char *fname, const uint8_t *buf, size_t len)
+{
+    FILE *fptr = fopen(fname, "wb");
+    if (fptr == NULL)
+        return e_failure;
+
+    size_t done = fwrite(buf, 1, len, fptr);
+    if (fclose(fptr) != 0 || done != len)
+    {
+        printf("Error: unable to write %s\n", fname);
+        return e_failure;
+    }
+    return e_success;
+}
+
+// run fn until BENCH_MIN_MS have passed, keeping the fastest repetition
+static Status measure(BenchFn fn, BenchCase *bc, const char *stage, const char *io, size_t bytes)
+{
+    double best = 0, spent = 0;
+    int reps = 0;
+
+    while (reps == 0 || (spent < BENCH_MIN_MS && reps < BENCH_MAX_REPS))
+    {
+        double start = stats_now_ms();
+        if (fn(bc) == e_failure)
+        {
+            printf("Error: %s (%s) failed on the %zu MP %d bpp cover\n", stage, io, bc->mp, bc->bpp);
+            return e_failure;
+        }
+        double ms = stats_now_ms() - start;
+        best = reps == 0 || ms < best ? ms : best;
+        spent += ms;
+        reps++;
+    }
+
+    if (best <= 0)
+        best = 1e-6;
+    printf("{\"stage\":\"%s\",\"io\":\"%s\",\"kernel\":\"%s\",\"megapixels\":%zu,\"bpp\":%d,"
+           "\"bytes\":%zu,\"reps\":%d,\"best_s\":%.6f,\"mb_per_s\":%.1f,\"ns_per_byte\":%.3f}\n",
+           stage, io, lsb_kernel_name(), bc->mp, bc->bpp, bytes, reps, best / 1000.0,
+           bytes / (best * 1000.0), best * 1e6 / bytes);
+    fflush(stdout);
+    return e_success;
+}
+
+static Status kernel_embed(void *ctx)
+{
+    BenchCase *bc = ctx;
+    size_t n = (bc->cover_len - bc->bmp.pixel_offset) / 8;
+
+    lsb_embed(bc->out + bc->bmp.pixel_offset, bc->cover + bc->bmp.pixel_offset, bc->secret, n);
+    return e_success;
+}
+
+static Status kernel_extract(void *ctx)
+{
+    BenchCase *bc = ctx;
+    size_t n = (bc->cover_len - bc->bmp.pixel_offset) / 8;
+
+    lsb_extract(bc->out + bc->bmp.pixel_offset, bc->data, n);
+    return e_success;
+}
+
+static Status checksum(void *ctx)
+{
+    BenchCase *bc = ctx;
+    volatile uint32_t crc = crc32c(0, bc->secret, bc->secret_len);
+
+    (void)crc;
+    return e_success;
+}
+
+static Status keystream(void *ctx)
+{
+    BenchCase *bc = ctx;
+
+    cipher_xor(&bc->cipher, 0, bc->secret, bc->data, bc->secret_len);
+    return e_success;
+}
+
+static Status memory_encode(void *ctx)
+{
+    BenchCase *bc = ctx;
+    return stego_encode(bc->cover, bc->cover_len, bc->secret, bc->secret_len, &bc->params, bc->out);
+}
+
+static Status memory_decode(void *ctx)
+{
+    BenchCase *bc = ctx;
+    StegoInfo info;
+
+    if (stego_decode(bc->out, bc->cover_len, &bc->params, bc->data, bc->secret_len, &info) == e_failure)
+        return e_failure;
+    return info.payload_size == bc->secret_len && memcmp(bc->data, bc->secret, bc->secret_len) == 0
+        ? e_success : e_failure;
+}
+
+static Status file_encode(void *ctx)
+{
+    BenchCase *bc = ctx;
+    EncodeInfo encInfo = {0};
+
+    encInfo.opts = bc->opts;
+    encInfo.src_image_fname = bc->cover_fname;
+    encInfo.secret_fname = bc->tiny ? bc->tiny_fname : bc->secret_fname;
+    encInfo.stego_image_fname = bc->stego_fname;
+    return do_encoding(&encInfo);
+}
+
+static Status file_decode(void *ctx)
+{
+    BenchCase *bc = ctx;
+    DecodeInfo decInfo = {0};
+
+    decInfo.opts = bc->opts;
+    decInfo.stego_image_fname = bc->stego_fname;
+    decInfo.output_fname = bc->decoded_fname;
+    return do_decoding(&decInfo);
+}
+
+// encode, decode and tail copy through the file tool with one I/O strategy
+static Status bench_files(BenchCase *bc, const char *io, size_t block_size, int use_mmap, int threads)
+{
+    size_t pixels = bmp_pixel_bytes(&bc->bmp);
+
+    bc->opts.block_size = block_size;
+    bc->opts.use_mmap = use_mmap;
+    bc->opts.threads = threads;
+
+    bc->tiny = 0;
+    if (measure(file_encode, bc, "encode", io, pixels) == e_failure ||
+        measure(file_decode, bc, "decode", io, pixels) == e_failure)
+        return e_failure;
+
+    bc->tiny = 1;
+    return measure(file_encode, bc, "tail_copy", io, bc->cover_len);
+}
+
+static void remove_files(BenchCase *bc)
+{
+    unlink(bc->cover_fname);
+    unlink(bc->secret_fname);
+    unlink(bc->tiny_fname);
+    unlink(bc->stego_fname);
+    unlink(bc->decoded_fname);
+}
+
+// every stage and strategy on one synthetic cover
+static Status bench_cover(BenchCase *bc, const StegoOptions *opts, int threads, uint64_t *state)
+{
+    Status status = e_failure;
+
+    bc->cover = make_bmp(bc->mp, bc->bpp, &bc->cover_len, state);
+    if (bc->cover == NULL || cover_parse(bc->cover, bc->cover_len, &bc->bmp) == e_failure)
+    {
+        printf("Error: unable to generate a %zu MP %d bpp cover\n", bc->mp, bc->bpp);
+        free(bc->cover);
+        return e_failure;
+    }
+
+    bc->params = (StegoParams){ BENCH_MAGIC, ".bin", opts->bits, opts->channels, STEGO_FLAG_CRC, NULL, NULL };
+    bc->secret_len = stego_capacity(bc->cover, bc->cover_len, &bc->params) / 10 * 9;   // leaves room for scattering
+    size_t kernel_len = (bc->cover_len - bc->bmp.pixel_offset) / 8;
+    size_t secret_cap = bc->secret_len > kernel_len ? bc->secret_len : kernel_len;
+
+    bc->secret = malloc(secret_cap);
+    bc->data = malloc(secret_cap);
+    bc->out = malloc(bc->cover_len);
+    uint8_t tiny = 0x5a;
+
+    if (bc->secret != NULL && bc->data != NULL && bc->out != NULL)
+    {
+        fill_random(bc->secret, secret_cap, state);
+        status = e_success;
+    }
+    else
+        printf("Error: not enough memory for a %zu MP %d bpp cover\n", bc->mp, bc->bpp);
+
+    if (status == e_success)
+        status = measure(kernel_embed, bc, "embed", "memory", kernel_len * 8);
+    if (status == e_success)
+        status = measure(kernel_extract, bc, "extract", "memory", kernel_len * 8);
+    if (status == e_success)
+        status = measure(checksum, bc, "crc32c", crc32c_impl_name(), bc->secret_len);
+    if (status == e_success)
+        status = measure(memory_encode, bc, "encode", "memory", bmp_pixel_bytes(&bc->bmp));
+    if (status == e_success)
+        status = measure(memory_decode, bc, "decode", "memory", bmp_pixel_bytes(&bc->bmp));
+
+    bc->params.key = BENCH_KEY;   // the same payload spread over keyed blocks
+    if (status == e_success)
+        status = measure(memory_encode, bc, "encode", "memory_scatter", bmp_pixel_bytes(&bc->bmp));
+    if (status == e_success)
+        status = measure(memory_decode, bc, "decode", "memory_scatter", bmp_pixel_bytes(&bc->bmp));
+    bc->params.key = NULL;
+
+    bc->params.cipher = &bc->cipher;   // the same payload encrypted on its way into the kernels
+    if (status == e_success)
+        status = measure(keystream, bc, "chacha20", "memory", bc->secret_len);
+    if (status == e_success)
+        status = measure(memory_encode, bc, "encode", "memory_cipher", bmp_pixel_bytes(&bc->bmp));
+    if (status == e_success)
+        status = measure(memory_decode, bc, "decode", "memory_cipher", bmp_pixel_bytes(&bc->bmp));
+    bc->params.cipher = NULL;
+
+    // the file tool reads its inputs from the scratch directory
+    if (status == e_success &&
+        (write_file(bc->cover_fname, bc->cover, bc->cover_len) == e_failure ||
+         write_file(bc->secret_fname, bc->secret, bc->secret_len) == e_failure ||
+         write_file(bc->tiny_fname, &tiny, 1) == e_failure))
+        status = e_failure;
+
+    free(bc->out);      // the file strategies need the memory more
+    free(bc->data);
+    free(bc->secret);
+    free(bc->cover);
+
+    if (status == e_success)
+        status = bench_files(bc, "stdio", MIN_BLOCK_SIZE, 0, 1);
+    if (status == e_success)
+        status = bench_files(bc, "buffered", opts->block_size, 0, 1);
+    if (status == e_success)
+        status = bench_files(bc, "mmap", opts->block_size, 1, 1);
+    if (status == e_success && threads > 1)
+        status = bench_files(bc, "threaded", opts->block_size, opts->use_mmap, threads);
+
+    bc->opts.key = BENCH_KEY;
+    if (status == e_success)
+        status = bench_files(bc, "buffered_scatter", opts->block_size, 0, 1);
+    if (status == e_success)
+        status = bench_files(bc, "mmap_scatter", opts->block_size, 1, 1);
+    bc->opts.key = NULL;
+
+    bc->opts.pass = (const unsigned char *)BENCH_PASS;
+    bc->opts.pass_len = strlen(BENCH_PASS);
+    bc->opts.pass_rounds = CIPHER_FILE_ROUNDS;   // time the data path, not the key stretching
+    if (status == e_success)
+        status = bench_files(bc, "buffered_cipher", opts->block_size, 0, 1);
+    if (status == e_success)
+        status = bench_files(bc, "mmap_cipher", opts->block_size, 1, 1);
+    bc->opts.pass = NULL;
+
+    remove_files(bc);
+    return status;
+}
+
+Status do_bench(char *sizes[], const StegoOptions *opts)
+{
+    static char *default_sizes[] = { BENCH_DEFAULT_MP, NULL };
+    static const int depths[] = { 24, 32 };
+    BenchCase bc = {0};
+    uint64_t state = 0x9e3779b97f4a7c15ull;   // fixed seed, runs are comparable
+
+    if (sizes[0] == NULL)
+        sizes = default_sizes;
+
+    for (int i = 0; sizes[i] != NULL; i++)   // check every size before generating anything
+    {
+        char *end;
+        unsigned long mp = strtoul(sizes[i], &end, 10);
+        if (end == sizes[i] || *end != '\0' || mp == 0 || mp > BENCH_MAX_MP)
+        {
+            printf("Error: invalid cover size %s, expected 1 to %d megapixels\n", sizes[i], BENCH_MAX_MP);
+            return e_failure;
+        }
+    }
+
+    const char *tmp = getenv("TMPDIR");
+    snprintf(bc.dir, sizeof(bc.dir), "%s/stego-bench-XXXXXX", tmp != NULL && strlen(tmp) < 32 ? tmp : "/tmp");
+    if (mkdtemp(bc.dir) == NULL)
+    {
+        printf("Error: unable to create a scratch directory in %s\n", bc.dir);
+        return e_failure;
+    }
+    snprintf(bc.cover_fname, sizeof(bc.cover_fname), "%s/cover.bmp", bc.dir);
+    snprintf(bc.secret_fname, sizeof(bc.secret_fname), "%s/secret.bin", bc.dir);
+    snprintf(bc.tiny_fname, sizeof(bc.tiny_fname), "%s/tiny.bin", bc.dir);
+    snprintf(bc.stego_fname, sizeof(bc.stego_fname), "%s/stego.bmp", bc.dir);
+    snprintf(bc.decoded_fname, sizeof(bc.decoded_fname), "%s/decoded.bin", bc.dir);
+
+    bc.opts = *opts;
+    bc.opts.magic = BENCH_MAGIC;   // no prompts while timing
+    bc.opts.quiet = 1;
+    bc.opts.stats = 0;
+    bc.opts.pass = NULL;           // only the *_cipher strategies encrypt
+
+    static const uint8_t salt[CIPHER_SALT_LEN];   // fixed, runs are comparable
+    cipher_derive(&bc.cipher, (const uint8_t *)BENCH_PASS, strlen(BENCH_PASS), salt, CIPHER_FILE_ROUNDS);
+
+    int threads = opts->threads > 0 ? opts->threads : (int)sysconf(_SC_NPROCESSORS_ONLN);
+    Status status = e_success;
+
+    for (int i = 0; status == e_success && sizes[i] != NULL; i++)
+    {
+        for (size_t d = 0; status == e_success && d < sizeof(depths) / sizeof(depths[0]); d++)
+        {
+            bc.mp = strtoul(sizes[i], NULL, 10);
+            bc.bpp = depths[d];
+            status = bench_cover(&bc, opts, threads, &state);
+        }
+    }
+
+    rmdir(bc.dir);
+    return status;
+}
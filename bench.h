@@ -0,0 +1,43 @@
+#ifndef BENCH_H
+#define BENCH_H
+
+#include "types.h"    // Contains user-defined types
+#include "options.h"  // Contains command-line options
+
+/*
+ * Benchmark mode: generate synthetic BMP covers (random pixels,
+ * 24 and 32 bpp) and random secrets at the given sizes, then time
+ * every pipeline stage:
+ *     embed / extract   the selected LSB kernel over the pixel array
+ *     encode / decode   libstego on an in-memory image
+ *     encode / decode / tail_copy   the file tool per I/O strategy
+ * I/O strategies are stdio (smallest blocks, close to the original
+ * byte-at-a-time reads), buffered (-b block size), mmap and, with
+ * more than one thread, threaded. tail_copy embeds a one byte secret
+ * so the time is spent copying the image after the payload. The
+ * *_scatter strategies repeat memory, buffered and mmap with the
+ * data spread over keyed blocks (--key), next to the linear layout.
+ * The *_cipher strategies repeat memory, buffered and mmap with the
+ * data encrypted (--pass), next to the plain ones; their key is
+ * derived with a single round so the passphrase stretching stays out
+ * of the timing. chacha20 times the keystream on its own.
+ *
+ * Results go to stdout as one JSON object per line:
+ *     {"stage":..., "io":..., "kernel":..., "megapixels":..., "bpp":...,
+ *      "bytes":..., "reps":..., "best_s":..., "mb_per_s":..., "ns_per_byte":...}
+ * mb_per_s and ns_per_byte come from the fastest repetition; bytes is
+ * the cover bytes a repetition moves.
+ */
+
+#define BENCH_DEFAULT_MP "1"          // megapixels when none are given
+#define BENCH_MAX_MP 1000             // largest cover the generator makes
+#define BENCH_MIN_MS 250.0            // repeat a measurement until this much time has passed
+#define BENCH_MAX_REPS 50
+#define BENCH_MAGIC "#*"
+#define BENCH_KEY "bench"             // scatter key of the *_scatter strategies
+#define BENCH_PASS "bench"            // passphrase of the *_cipher strategies
+
+/* Run the benchmark for every megapixel count in sizes (NULL terminated, may be empty) */
+Status do_bench(char *sizes[], const StegoOptions *opts);
+
+#endif
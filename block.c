@@ -0,0 +1,838 @@
+#include <stdio.h>      // for fread/fwrite
+#include <stdlib.h>     // for aligned_alloc/free
+#include <string.h>     // for memcpy
+#include <sys/mman.h>   // for mmap/munmap
+#include <sys/stat.h>   // for fstat
+#include "block.h"      // for block engine declarations
+#include "lsb.h"        // for the embed/extract kernels
+#include "crc32c.h"     // for the running payload CRC
+#include "copy.h"       // for the kernel copy of a mapped cover
+#include "varint.h"     // for 64-bit size fields
+#include "stego.h"      // for stego_error
+
+#define BLOCK_ALIGN 64  // cache line alignment for the pixel block
+#define BLOCK_CIPHER_CHUNK 4096   // data bytes XORed with the keystream at a time, stays in L1
+
+static const BlockUringOps *uring_ops;   // set by uring_init, before any engine is given a ring
+
+void block_set_uring_ops(const BlockUringOps *ops)
+{
+    uring_ops = ops;
+}
+
+Status block_init(BlockIO *io, FILE *fptr_src, FILE *fptr_dest, size_t block_size)
+{
+    io->fptr_src = fptr_src;
+    io->fptr_dest = fptr_dest;
+    io->block_size = block_size;
+    io->len = 0;
+    io->pos = 0;
+    io->base = 0;
+    io->stream = ftell(fptr_src) < 0 || (fptr_dest != NULL && ftell(fptr_dest) < 0);   // pipes report no position
+    io->stream_pos = 0;
+    io->map_src = NULL;
+    io->map_dest = NULL;
+    io->mapped = 0;
+    lsb_get_layout(1, 0, 0, &io->layout);   // classic 1 bit per byte until the payload says otherwise
+    bmp_rows_flat(&io->rows, 0);             // every byte until the caller sets the image's rows
+    io->carry_len = 0;
+    io->carry_pos = 0;
+    io->scatter.count = 0;
+    io->crc_on = 0;
+    io->cipher_on = 0;
+    io->ahead_buf = -1;
+
+    if (io->uring != NULL && !io->stream)   // blocks live in the ring's registered buffers
+    {
+        io->uring_buf = uring_ops->acquire(io->uring);
+        if (io->uring_buf >= 0)
+        {
+            io->buf = uring_ops->buffer(io->uring, io->uring_buf) + URING_HEADROOM;
+            return e_success;
+        }
+    }
+    io->uring = NULL;   // pipes stay on stdio
+
+    if (io->shared_buf && io->buf != NULL)   // reuse the caller's block buffer
+        return e_success;
+
+    size_t alloc = (block_size + BLOCK_ALIGN - 1) / BLOCK_ALIGN * BLOCK_ALIGN;   // aligned_alloc wants a multiple
+    io->buf = aligned_alloc(BLOCK_ALIGN, alloc);
+    if (io->buf == NULL)
+    {
+        stego_error("unable to allocate %zu byte pixel block", block_size);
+        return e_failure;
+    }
+    return e_success;
+}
+
+// image offset of the next byte fread would return
+static long source_offset(const BlockIO *io)
+{
+    long at = ftell(io->fptr_src);
+    return at >= 0 ? at : io->stream_pos;
+}
+
+// bytes to read behind the rest of the block: a whole block, or no further than the end of the scattered block
+static size_t read_size(const BlockIO *io, size_t need, size_t rest)
+{
+    size_t want = io->block_size - rest;
+    long next = io->len > 0 ? io->base + (long)io->len : source_offset(io);
+
+    if (io->scatter.count > 0)
+    {
+        long end = io->scatter_end - next;
+        if (end < (long)(need - rest))
+            end = need - rest;
+        if ((size_t)end < want)
+            want = end;
+    }
+    return want;
+}
+
+// wait out a read ahead that will not be used, its buffer cannot be handed out before
+static void drop_ahead(BlockIO *io)
+{
+    if (io->ahead_buf < 0)
+        return;
+    uring_ops->wait(io->uring, io->ahead_buf);
+    uring_ops->release(io->uring, io->ahead_buf);
+    io->ahead_buf = -1;
+}
+
+// start reading the block after the one just filled, the kernels work on this one meanwhile
+static void read_ahead(BlockIO *io)
+{
+    if (io->scatter.count > 0 || io->ahead_buf >= 0)   // keyed blocks are not visited in image order
+        return;
+
+    int buf = uring_ops->acquire(io->uring);
+    long off = io->base + (long)io->len;
+    if (buf < 0)
+        return;
+    if (uring_ops->read(io->uring, buf, uring_ops->buffer(io->uring, buf) + URING_HEADROOM, fileno(io->fptr_src),
+                        off, io->block_size) == e_failure)
+    {
+        uring_ops->release(io->uring, buf);
+        return;
+    }
+    io->ahead_buf = buf;
+    io->ahead_off = off;
+}
+
+// fill_block on the io_uring: the used part is written out of its buffer without waiting,
+// the rest of the block goes in front of the next one, which was usually read ahead already
+static Status fill_uring(BlockIO *io, size_t need, size_t want)
+{
+    Uring *ur = io->uring;
+    int old = io->uring_buf, writing = 0;
+    size_t rest = io->len - io->pos;
+    long at = io->len > 0 ? io->base + (long)io->len : source_offset(io);   // image offset of the next unread byte
+
+    if (io->fptr_dest != NULL && io->pos > 0)
+    {
+        if (uring_ops->write(ur, old, io->buf, fileno(io->fptr_dest), io->base, io->pos) == e_failure)
+        {
+            stego_error("failed to write pixel block");
+            return e_failure;
+        }
+        writing = 1;
+    }
+
+    int next;
+    long got = 0;
+    unsigned char *data;
+    if (io->ahead_buf >= 0 && io->ahead_off == at && rest <= URING_HEADROOM)
+    {
+        next = io->ahead_buf;
+        io->ahead_buf = -1;
+        got = uring_ops->wait(ur, next);
+        if (got > (long)want)
+            got = want;
+        data = uring_ops->buffer(ur, next) + URING_HEADROOM;
+    }
+    else
+    {
+        drop_ahead(io);
+        if ((next = uring_ops->acquire(ur)) < 0)
+            return e_failure;
+        data = uring_ops->buffer(ur, next) + (rest > URING_HEADROOM ? rest : URING_HEADROOM);
+    }
+
+    while (got >= 0 && (size_t)got < want)   // read what is missing, a short read only ends at the end of the image
+    {
+        long n = -1;
+        if (uring_ops->read(ur, next, data + got, fileno(io->fptr_src), at + got, want - got) == e_success)
+            n = uring_ops->wait(ur, next);
+        if (n <= 0)
+        {
+            got = n < 0 ? n : got;
+            break;
+        }
+        got += n;
+    }
+
+    memcpy(data - rest, io->buf + io->pos, rest);   // a buffer being written is only read from
+    if (!writing)
+        uring_ops->release(ur, old);
+
+    io->uring_buf = next;
+    io->buf = data - rest;
+    io->base = at - (long)rest;
+    io->len = rest + (got > 0 ? got : 0);
+    io->pos = 0;
+    if (got < 0)
+    {
+        stego_error("failed to read pixel block");
+        return e_failure;
+    }
+
+    if ((size_t)got == want)
+        read_ahead(io);
+    return io->len >= need ? e_success : e_failure;
+}
+
+// move the unused rest of the block to the front and read more behind it
+// (writing the used part first when encoding), until need bytes are unused or the image ends
+static Status fill_block(BlockIO *io, size_t need)
+{
+    if (io->len - io->pos >= need)
+        return e_success;
+    if (io->map_src != NULL)   // the mapping already spans the whole image
+        return e_failure;
+
+    size_t rest = io->len - io->pos;   // part of a layout step, only non-zero with k-LSB layouts or padded rows
+    size_t want = read_size(io, need, rest);
+    if (io->uring != NULL)
+        return fill_uring(io, need, want);
+
+    if (io->fptr_dest != NULL && io->pos > 0)
+    {
+        if (fwrite(io->buf, 1, io->pos, io->fptr_dest) != io->pos)
+        {
+            stego_error("failed to write pixel block");
+            return e_failure;
+        }
+    }
+
+    memmove(io->buf, io->buf + io->pos, rest);
+    io->base = io->len > 0 ? io->base + (long)io->pos : source_offset(io);
+    io->len = rest + fread(io->buf + rest, 1, want, io->fptr_src);
+    io->pos = 0;
+    io->stream_pos = io->base + (long)io->len;
+
+    return io->len >= need ? e_success : e_failure;
+}
+
+// make sure need unused bytes are in the block
+static Status block_refill(BlockIO *io, size_t need)
+{
+    if (fill_block(io, need) == e_failure)   // not even one layout step fits, image is exhausted
+    {
+        stego_error("image has no more pixel data");
+        return e_failure;
+    }
+    return e_success;
+}
+
+// pass over n bytes that carry no payload (header gap, row padding) unchanged
+static Status skip_bytes(BlockIO *io, size_t n)
+{
+    while (n > 0)
+    {
+        if (block_refill(io, 1) == e_failure)
+            return e_failure;
+
+        size_t count = io->len - io->pos < n ? io->len - io->pos : n;
+        if (io->map_dest != NULL && io->map_dest != io->map_src)
+            memcpy(io->map_dest + io->pos, io->map_src + io->pos, count);   // mapped output gets them too
+        io->pos += count;
+        n -= count;
+    }
+    return e_success;
+}
+
+// pixel bytes left in the current row, moving past any padding first; 0 once the pixel array is used up
+static size_t next_span(BlockIO *io)
+{
+    size_t span;
+    long next;
+
+    while ((span = bmp_span(&io->rows, block_offset(io), &next)) == 0)
+    {
+        if (next < 0 || skip_bytes(io, next - block_offset(io)) == e_failure)
+            return 0;
+    }
+    return span;
+}
+
+// one layout step that runs over the end of a row: gather its cover bytes
+// from both sides of the padding, run the kernel on them and scatter them back
+static Status stitch_step(BlockIO *io, const unsigned char *in, unsigned char *out)
+{
+    const LsbLayout *layout = &io->layout;
+    unsigned char cover[LSB_MAX_STEP_COVER];
+    size_t at[LSB_MAX_STEP_COVER];
+
+    // keep the whole step in the block so the positions below stay valid
+    size_t pad = io->rows.stride - io->rows.row_bytes;
+    fill_block(io, layout->step_cover + (layout->step_cover / io->rows.row_bytes + 1) * pad);
+
+    for (size_t i = 0; i < layout->step_cover; i++)
+    {
+        if (next_span(io) == 0 || io->pos >= io->len)
+        {
+            stego_error("image has no more pixel data");
+            return e_failure;
+        }
+        at[i] = io->pos;
+        cover[i] = io->map_src != NULL ? io->map_src[io->pos] : io->buf[io->pos];
+        io->pos++;
+    }
+
+    if (out != NULL)   // extracting
+    {
+        layout->extract(cover, out, 1);
+        return e_success;
+    }
+
+    layout->embed(cover, cover, in, 1);
+    unsigned char *dest = io->map_src != NULL ? io->map_dest : io->buf;
+    for (size_t i = 0; i < layout->step_cover; i++)
+        dest[at[i]] = cover[i];
+    return e_success;
+}
+
+static Status move_to(BlockIO *io, long offset);
+
+// go to the block holding data section step `step`
+static Status scatter_jump(BlockIO *io, size_t step)
+{
+    const Scatter *sc = &io->scatter;
+    long offset = scatter_offset(sc, step);
+
+    if (move_to(io, offset) == e_failure)
+        return e_failure;
+    io->scatter_step = step;
+    io->scatter_left = sc->block_steps - step % sc->block_steps;
+    io->scatter_end = bmp_advance(&sc->rows, offset, io->scatter_left * sc->step_cover);
+    return e_success;
+}
+
+// run the layout kernel over whole steps, row by row; in is the payload when embedding, out when extracting
+static Status run_steps(BlockIO *io, const unsigned char *in, unsigned char *out, size_t steps)
+{
+    const LsbLayout *layout = &io->layout;
+
+    while (steps > 0)
+    {
+        if (io->scatter.count > 0 && io->scatter_left == 0 &&   // block used up, on to the next one
+            scatter_jump(io, io->scatter_step) == e_failure)
+            return e_failure;
+
+        size_t span = next_span(io);
+        if (span == 0)
+        {
+            stego_error("image has no more pixel data");
+            return e_failure;
+        }
+
+        size_t count = 1;
+        if (span < layout->step_cover)
+        {
+            if (stitch_step(io, in, out) == e_failure)
+                return e_failure;
+        }
+        else
+        {
+            if (block_refill(io, layout->step_cover) == e_failure)
+                return e_failure;
+
+            size_t avail = io->len - io->pos < span ? io->len - io->pos : span;
+            count = avail / layout->step_cover;   // steps that fit in this block and row
+            if (count > steps)
+                count = steps;
+            if (io->scatter.count > 0 && count > io->scatter_left)
+                count = io->scatter_left;
+
+            if (out != NULL)
+                layout->extract((io->map_src != NULL ? io->map_src : io->buf) + io->pos, out, count);
+            else if (io->map_src != NULL)   // read the cover mapping, write straight into the stego mapping
+                layout->embed(io->map_dest + io->pos, io->map_src + io->pos, in, count);
+            else
+                layout->embed(io->buf + io->pos, io->buf + io->pos, in, count);
+            io->pos += count * layout->step_cover;
+        }
+
+        if (out != NULL)
+            out += count * layout->step_data;
+        else
+            in += count * layout->step_data;
+        steps -= count;
+        io->scatter_step += count;
+        io->scatter_left -= io->scatter.count > 0 ? count : 0;
+    }
+    return e_success;
+}
+
+static Status embed_steps(BlockIO *io, const unsigned char *data, size_t steps)
+{
+    return run_steps(io, data, NULL, steps);
+}
+
+static Status extract_steps(BlockIO *io, unsigned char *data, size_t steps)
+{
+    return run_steps(io, NULL, data, steps);
+}
+
+// embed size payload bytes as they are
+static Status embed_bytes(BlockIO *io, const unsigned char *bytes, long size)
+{
+    size_t step = io->layout.step_data;
+
+    while (size > 0 && io->carry_len > 0)   // top up the step left open by the previous call
+    {
+        io->carry[io->carry_len++] = *bytes++;
+        size--;
+        if (io->carry_len == step)
+        {
+            io->carry_len = 0;
+            if (embed_steps(io, io->carry, 1) == e_failure)
+                return e_failure;
+        }
+    }
+
+    if (embed_steps(io, bytes, size / step) == e_failure)
+        return e_failure;
+
+    for (long i = size / step * step; i < size; i++)   // keep the bytes of an unfinished step
+        io->carry[io->carry_len++] = bytes[i];
+    return e_success;
+}
+
+Status block_embed(BlockIO *io, const char *data, long size)
+{
+    const unsigned char *bytes = (const unsigned char *)data;
+    unsigned char sealed[BLOCK_CIPHER_CHUNK];
+
+    if (!io->cipher_on)
+    {
+        if (io->crc_on)
+            io->crc = crc32c(io->crc, data, size);
+        return embed_bytes(io, bytes, size);
+    }
+
+    for (long i = 0; i < size; i += BLOCK_CIPHER_CHUNK)   // checksum, encrypt and embed each piece while it is in L1
+    {
+        long n = size - i < BLOCK_CIPHER_CHUNK ? size - i : BLOCK_CIPHER_CHUNK;
+        if (io->crc_on)
+            io->crc = crc32c(io->crc, bytes + i, n);
+        cipher_xor(io->cipher, io->cipher_pos, bytes + i, sealed, n);   // the caller's bytes stay plain
+        io->cipher_pos += n;
+        if (embed_bytes(io, sealed, n) == e_failure)
+            return e_failure;
+    }
+    return e_success;
+}
+
+Status block_embed_size(BlockIO *io, uint size)
+{
+    char bytes[4];
+
+    for (int i = 0; i < 4; i++)
+        bytes[i] = (size >> (i * 8)) & 0xFF;     // bit i of size lands in cover byte i
+
+    return block_embed(io, bytes, 4);
+}
+
+Status block_embed_field(BlockIO *io, int varint, uint64_t value)
+{
+    uint8_t bytes[VARINT_MAX_LEN];
+
+    if (!varint)
+        return value <= UINT32_MAX ? block_embed_size(io, value) : e_failure;
+    return block_embed(io, (char *)bytes, varint_put(bytes, value));
+}
+
+// hand out size payload bytes, starting with any left in carry
+static Status extract_bytes(BlockIO *io, unsigned char *bytes, long size)
+{
+    size_t step = io->layout.step_data;
+
+    while (size > 0 && io->carry_pos < io->carry_len)   // rest of a step extracted by the previous call
+    {
+        *bytes++ = io->carry[io->carry_pos++];
+        size--;
+    }
+
+    if (extract_steps(io, bytes, size / step) == e_failure)
+        return e_failure;
+    bytes += size / step * step;
+    size %= step;
+
+    if (size > 0)   // extract a whole step, hand out what was asked for and keep the rest
+    {
+        if (extract_steps(io, io->carry, 1) == e_failure)
+            return e_failure;
+        memcpy(bytes, io->carry, size);
+        io->carry_len = step;
+        io->carry_pos = size;
+    }
+    return e_success;
+}
+
+Status block_extract(BlockIO *io, char *data, long size)
+{
+    unsigned char *bytes = (unsigned char *)data;
+
+    if (!io->cipher_on)
+    {
+        if (extract_bytes(io, bytes, size) == e_failure)
+            return e_failure;
+        if (io->crc_on)   // checksum what came out, still in cache
+            io->crc = crc32c(io->crc, data, size);
+        return e_success;
+    }
+
+    for (long i = 0; i < size; i += BLOCK_CIPHER_CHUNK)   // extract, decrypt in place and checksum each piece in L1
+    {
+        long n = size - i < BLOCK_CIPHER_CHUNK ? size - i : BLOCK_CIPHER_CHUNK;
+        if (extract_bytes(io, bytes + i, n) == e_failure)
+            return e_failure;
+        cipher_xor(io->cipher, io->cipher_pos, bytes + i, bytes + i, n);
+        io->cipher_pos += n;
+        if (io->crc_on)
+            io->crc = crc32c(io->crc, bytes + i, n);
+    }
+    return e_success;
+}
+
+Status block_extract_size(BlockIO *io, long *size)
+{
+    unsigned char bytes[4];
+
+    if (block_extract(io, (char *)bytes, 4) == e_failure)
+        return e_failure;
+
+    *size = bytes[0] | (bytes[1] << 8) | (bytes[2] << 16) | ((long)bytes[3] << 24);
+    return e_success;
+}
+
+Status block_extract_field(BlockIO *io, int varint, uint64_t *value)
+{
+    uint8_t bytes[VARINT_MAX_LEN];
+    long size;
+
+    if (!varint)
+    {
+        if (block_extract_size(io, &size) == e_failure)
+            return e_failure;
+        *value = size;
+        return e_success;
+    }
+
+    for (size_t n = 0; n < VARINT_MAX_LEN; n++)   // a byte at a time, the last one has its top bit clear
+    {
+        if (block_extract(io, (char *)&bytes[n], 1) == e_failure)
+            return e_failure;
+        if (!(bytes[n] & 0x80))
+            return varint_get(bytes, n + 1, value) > 0 ? e_success : e_failure;
+    }
+    return e_failure;
+}
+
+// write_block on the io_uring: wait for every write, then line the stdio positions up with the engine again
+static Status write_uring(BlockIO *io)
+{
+    Uring *ur = io->uring;
+    long end = io->base + (long)io->len;
+    Status status = e_success;
+
+    drop_ahead(io);
+    if (io->fptr_dest != NULL && io->len > 0)
+        status = uring_ops->write(ur, io->uring_buf, io->buf, fileno(io->fptr_dest), io->base, io->len);
+    if (uring_ops->drain(ur) == e_failure)
+        status = e_failure;
+
+    if (io->fptr_dest != NULL && io->len > 0)   // the buffer went back to the ring once written
+    {
+        io->uring_buf = uring_ops->acquire(ur);
+        if (io->uring_buf < 0)
+            return e_failure;
+        io->buf = uring_ops->buffer(ur, io->uring_buf) + URING_HEADROOM;
+    }
+
+    if (status == e_failure)
+    {
+        stego_error("failed to write pixel block");
+        return e_failure;
+    }
+    if (io->len > 0 && (fseek(io->fptr_src, end, SEEK_SET) != 0 ||
+                        (io->fptr_dest != NULL && fseek(io->fptr_dest, end, SEEK_SET) != 0)))
+        return e_failure;
+
+    io->len = 0;
+    io->pos = 0;
+    return e_success;
+}
+
+// write out the block read so far and start an empty one
+static Status write_block(BlockIO *io)
+{
+    if (io->uring != NULL)
+        return write_uring(io);
+
+    if (io->fptr_dest != NULL && io->len > 0)
+    {
+        if (fwrite(io->buf, 1, io->len, io->fptr_dest) != io->len)   // embedded part plus untouched rest of block
+        {
+            stego_error("failed to write pixel block");
+            return e_failure;
+        }
+    }
+    io->len = 0;
+    io->pos = 0;
+    return e_success;
+}
+
+Status block_flush(BlockIO *io)
+{
+    if (block_align_step(io) == e_failure)   // the last payload bytes may sit in an open step
+        return e_failure;
+
+    if (io->map_src != NULL)   // embedded bytes are already in the stego mapping
+        return e_success;
+    return write_block(io);
+}
+
+Status block_align_step(BlockIO *io)
+{
+    if (io->fptr_dest == NULL && io->map_dest == NULL)   // extracting: the rest of the step is padding
+    {
+        io->carry_len = 0;
+        io->carry_pos = 0;
+        return e_success;
+    }
+
+    if (io->carry_len == 0)
+        return e_success;
+
+    memset(io->carry + io->carry_len, 0, sizeof(io->carry) - io->carry_len);
+    io->carry_len = 0;
+    return embed_steps(io, io->carry, 1);
+}
+
+Status block_set_layout(BlockIO *io, const LsbLayout *layout)
+{
+    if (block_align_step(io) == e_failure)
+        return e_failure;
+    io->layout = *layout;
+
+    if (layout->mask == 0)   // every byte is used, no pixel boundary to meet
+        return e_success;
+
+    if (next_span(io) == 0)
+    {
+        stego_error("image has no more pixel data");
+        return e_failure;
+    }
+
+    // rows start on whole pixels, so the column tells how far the next pixel is
+    long bpp = layout->bytes_per_pixel;
+    size_t col = (block_offset(io) - io->rows.first) % io->rows.stride;
+    return skip_bytes(io, (bpp - col % bpp) % bpp);
+}
+
+size_t block_payload_size(const BlockIO *io)
+{
+    return io->block_size / io->layout.step_cover * io->layout.step_data;
+}
+
+long block_offset(BlockIO *io)
+{
+    if (io->len == 0 && io->map_src == NULL)   // nothing read yet or just flushed
+        return source_offset(io);
+    return io->base + io->pos;
+}
+
+// continue at image offset with no layout step open
+static Status move_to(BlockIO *io, long offset)
+{
+    if (io->map_src != NULL)
+    {
+        io->pos = offset;
+        return e_success;
+    }
+
+    if (io->stream)   // a pipe only goes forward, the bytes in between pass through
+    {
+        if (offset < block_offset(io))
+        {
+            stego_error("cannot go back to image offset %ld in a stream", offset);
+            return e_failure;
+        }
+        return skip_bytes(io, offset - block_offset(io));
+    }
+
+    if (write_block(io) == e_failure)
+        return e_failure;
+
+    if (fseek(io->fptr_src, offset, SEEK_SET) != 0 ||
+        (io->fptr_dest != NULL && fseek(io->fptr_dest, offset, SEEK_SET) != 0))
+    {
+        stego_error("unable to seek to image offset %ld", offset);
+        return e_failure;
+    }
+    return e_success;
+}
+
+Status block_seek(BlockIO *io, long offset)
+{
+    if (block_align_step(io) == e_failure)   // a partly used step ends here
+        return e_failure;
+    return move_to(io, offset);
+}
+
+void block_stream_at(BlockIO *io, long offset)
+{
+    io->stream_pos = offset;
+}
+
+Status block_scatter(BlockIO *io, long data_off, size_t data_len, uint64_t seed)
+{
+    if (block_align_step(io) == e_failure ||
+        scatter_init(&io->scatter, &io->rows, &io->layout, data_off, data_len, seed) == e_failure)
+        return e_failure;
+
+    io->scatter_step = 0;
+    io->scatter_left = 0;   // the first step jumps to the first block
+    return e_success;
+}
+
+Status block_seek_step(BlockIO *io, long data_off, size_t step)
+{
+    if (io->scatter.count == 0)
+        return block_seek(io, bmp_advance(&io->rows, data_off, step * io->layout.step_cover));
+
+    if (block_align_step(io) == e_failure)
+        return e_failure;
+    return scatter_jump(io, step);
+}
+
+void block_crc_start(BlockIO *io)
+{
+    io->crc_on = 1;
+    io->crc = 0;
+    block_cipher_at(io, 0);   // the data section is where the keystream starts
+}
+
+uint32_t block_crc_stop(BlockIO *io)
+{
+    io->crc_on = 0;
+    io->cipher_on = 0;
+    return io->crc;
+}
+
+void block_cipher_at(BlockIO *io, uint64_t pos)
+{
+    io->cipher_on = io->cipher != NULL;
+    io->cipher_pos = pos;
+}
+
+Status block_map(BlockIO *io, size_t offset)
+{
+    struct stat st;
+
+    if (fstat(fileno(io->fptr_src), &st) != 0 || (size_t)st.st_size <= offset)
+    {
+        stego_error("unable to read image size for mapping");
+        return e_failure;
+    }
+    size_t size = st.st_size;
+
+    if (io->fptr_dest != NULL)   // embed in place in a kernel copy of the cover, only payload pages are touched
+    {
+        void *dest = MAP_FAILED;
+        fflush(io->fptr_dest);
+        if (copy_fd_range(fileno(io->fptr_src), fileno(io->fptr_dest), 0, size) == e_success)
+            dest = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, fileno(io->fptr_dest), 0);
+
+        if (dest == MAP_FAILED)
+        {
+            stego_error("unable to map %zu byte stego image", size);
+            return e_failure;
+        }
+        block_attach(io, dest, dest, size, offset);
+        io->mapped = 1;
+        return e_success;
+    }
+
+    void *src = mmap(NULL, size, PROT_READ, MAP_SHARED, fileno(io->fptr_src), 0);
+    if (src == MAP_FAILED)
+    {
+        stego_error("unable to map %zu byte image", size);
+        return e_failure;
+    }
+    madvise(src, size, MADV_SEQUENTIAL);   // payload is walked front to back
+
+    block_attach(io, src, NULL, size, offset);
+    io->mapped = 1;
+    return e_success;
+}
+
+void block_attach(BlockIO *io, const unsigned char *src, unsigned char *dest, size_t len, size_t offset)
+{
+    io->map_src = src;
+    io->map_dest = dest;
+    io->mapped = 0;
+    io->len = len;
+    io->pos = offset;
+    io->base = 0;
+    lsb_get_layout(1, 0, 0, &io->layout);
+    bmp_rows_flat(&io->rows, 0);
+    io->carry_len = 0;
+    io->carry_pos = 0;
+    io->scatter.count = 0;
+    io->crc_on = 0;
+    io->cipher_on = 0;
+}
+
+Status block_copy_tail(BlockIO *io)
+{
+    if (io->map_src == NULL || io->map_dest == NULL || block_align_step(io) == e_failure)
+        return e_failure;
+
+    if (io->map_dest != io->map_src)   // nothing to copy when embedding in place
+        memcpy(io->map_dest + io->pos, io->map_src + io->pos, io->len - io->pos);   // untouched pixels after the payload
+    io->pos = io->len;
+    return e_success;
+}
+
+void block_free(BlockIO *io)
+{
+    if (io->mapped)
+    {
+        munmap((void *)io->map_src, io->len);
+        if (io->map_dest != NULL && io->map_dest != io->map_src)
+            munmap(io->map_dest, io->len);
+    }
+    io->map_src = NULL;
+    io->map_dest = NULL;
+    io->mapped = 0;
+
+    if (io->uring != NULL)   // the buffers go back to the ring for the worker's next image
+    {
+        drop_ahead(io);
+        uring_ops->drain(io->uring);
+        uring_ops->release(io->uring, io->uring_buf);
+        io->uring = NULL;
+        io->buf = NULL;
+        return;
+    }
+
+    if (!io->shared_buf)
+    {
+        free(io->buf);
+        io->buf = NULL;
+    }
+}
@@ -0,0 +1,180 @@
+#ifndef BLOCK_H
+#define BLOCK_H
+
+#include <stdio.h>
+#include <stddef.h>
+#include "types.h"  // Contains user-defined types
+#include "lsb.h"    // Contains the kernel layouts
+#include "bmp.h"    // Contains the pixel row geometry
+#include "scatter.h"  // Contains the keyed block order
+#include "uring.h"    // Contains the io_uring backend
+#include "cipher.h"   // Contains the data keystream
+
+/*
+ * Block engine used by every embed / extract stage.
+ * Pixel data is read from the cover in large blocks, secret
+ * bytes are embedded into (or extracted from) the whole block
+ * in memory and the block is written back with a single call,
+ * instead of one 8-byte fread/fwrite per secret byte.
+ * With block_map() the whole image is memory mapped instead and
+ * the kernels work directly on the mapping; when encoding, the
+ * cover is first copied to the stego image by the kernel and the
+ * payload is embedded in place in one shared mapping.
+ * Payload bytes go through the engine's layout, 1 bit per cover
+ * byte until block_set_layout() switches to a k-LSB layout; a
+ * layout step that straddles two calls is held in carry.
+ * Only the pixel bytes of each row (rows) carry payload; row
+ * padding is passed over and a step running over a row end is
+ * gathered from both rows.
+ * After block_scatter() the engine jumps to the next keyed block
+ * whenever one is used up; streamed images then read no further
+ * than the end of the block.
+ * Between block_crc_start() and block_crc_stop() every payload
+ * byte embedded or extracted also goes into a running CRC32C.
+ * With a cipher attached (cipher set before block_init) the same
+ * bytes are XORed with its keystream, a few KB at a time while they
+ * are in cache: after the CRC when embedding, before it when
+ * extracting, so the CRC is always over the plaintext.
+ * Images that cannot seek (pipes) are read and written in one
+ * forward pass: seeking ahead passes the bytes in between through,
+ * seeking back fails.
+ * With an io_uring attached (uring set before block_init) seekable
+ * images are read and written through it instead of stdio: blocks
+ * live in the ring's buffers, the next block is read ahead while
+ * the current one is embedded and used blocks are written out
+ * without waiting; block_flush() and block_seek() wait for them.
+ */
+
+typedef struct _BlockIO
+{
+    FILE *fptr_src;          // image the pixel blocks are read from
+    FILE *fptr_dest;         // image the blocks are written to (NULL when decoding)
+
+    unsigned char *buf;      // current pixel block
+    int shared_buf;          // buf belongs to the caller (batch worker), block_free keeps it
+    size_t block_size;       // capacity of buf, at least one layout step
+    size_t len;              // number of valid bytes in buf
+    size_t pos;              // next unused byte in buf
+    long base;               // image offset of buf[0]
+    int stream;              // source or destination cannot seek, only forward moves
+    long stream_pos;         // image offset a source that cannot seek has been read up to
+
+    const unsigned char *map_src;   // whole source image when memory mapped or attached
+    unsigned char *map_dest;        // whole destination image when memory mapped or attached
+    int mapped;                     // map_src / map_dest came from block_map and must be unmapped
+
+    LsbLayout layout;                            // how payload bytes land in cover bytes
+    BmpRows rows;                                // where the pixel bytes are, every byte until set
+    unsigned char carry[LSB_MAX_STEP_DATA];      // payload bytes of a partly filled layout step
+    size_t carry_len;                            // bytes held in carry
+    size_t carry_pos;                            // next carry byte handed out when extracting
+
+    Scatter scatter;                             // keyed block order of the data section, count 0 when linear
+    size_t scatter_step;                         // data section step the engine is at
+    size_t scatter_left;                         // steps left in the current block
+    long scatter_end;                            // image offset where the current block ends
+
+    int crc_on;                                  // payload bytes go into crc
+    uint32_t crc;                                // CRC32C of the payload bytes since block_crc_start
+
+    const Cipher *cipher;                        // keystream of the data section, NULL for plain data
+    int cipher_on;                               // payload bytes go through the keystream
+    uint64_t cipher_pos;                         // keystream offset of the next payload byte
+
+    Uring *uring;                                // io_uring the blocks go through, NULL for stdio
+    int uring_buf;                               // ring buffer holding buf
+    int ahead_buf;                               // ring buffer the next block is read into, -1 when none
+    long ahead_off;                              // image offset of that read
+
+} BlockIO;
+
+/* io_uring calls of the engine, see uring.h; reached through this table so the
+   library does not link uring.c */
+typedef struct _BlockUringOps
+{
+    int (*acquire)(Uring *ur);
+    unsigned char *(*buffer)(Uring *ur, int buf);
+    Status (*read)(Uring *ur, int buf, unsigned char *addr, int fd, long off, size_t len);
+    long (*wait)(Uring *ur, int buf);
+    Status (*write)(Uring *ur, int buf, const unsigned char *addr, int fd, long off, size_t len);
+    void (*release)(Uring *ur, int buf);
+    Status (*drain)(Uring *ur);
+
+} BlockUringOps;
+
+/* Install the io_uring calls, done by uring_init before a ring reaches the engine */
+void block_set_uring_ops(const BlockUringOps *ops);
+
+/* Prepare a block engine, src -> dest for encoding or src only for decoding.
+   A buffer already attached to io (shared_buf) is reused instead of allocated,
+   an attached uring supplies the blocks unless an image is a pipe */
+Status block_init(BlockIO *io, FILE *fptr_src, FILE *fptr_dest, size_t block_size);
+
+/* Embed size bytes of data into the next cover bytes */
+Status block_embed(BlockIO *io, const char *data, long size);
+
+/* Embed a 32-bit value as 4 little-endian payload bytes */
+Status block_embed_size(BlockIO *io, uint size);
+
+/* Embed a size field: a varint of up to 64 bits when varint is set, 32 bits otherwise */
+Status block_embed_field(BlockIO *io, int varint, uint64_t value);
+
+/* Extract size bytes of data from the next cover bytes */
+Status block_extract(BlockIO *io, char *data, long size);
+
+/* Extract a 32-bit value stored as 4 little-endian payload bytes */
+Status block_extract_size(BlockIO *io, long *size);
+
+/* Extract a size field written by block_embed_field */
+Status block_extract_field(BlockIO *io, int varint, uint64_t *value);
+
+/* Write out the partially used block so the source and destination line up again */
+Status block_flush(BlockIO *io);
+
+/* Close a partly filled layout step (zero padded when embedding) so the next byte starts a new step */
+Status block_align_step(BlockIO *io);
+
+/* Continue with another layout, a channel mask starts on the next whole pixel */
+Status block_set_layout(BlockIO *io, const LsbLayout *layout);
+
+/* Payload bytes one full block holds under the current layout */
+size_t block_payload_size(const BlockIO *io);
+
+/* Image offset of the next cover byte the engine will use */
+long block_offset(BlockIO *io);
+
+/* Continue at image offset (after the caller filled the bytes before it), only forward on streams */
+Status block_seek(BlockIO *io, long offset);
+
+/* The source was read up to image offset outside the engine (a pipe cannot tell its position) */
+void block_stream_at(BlockIO *io, long offset);
+
+/* Spread the data section starting at image offset data_off over keyed blocks,
+   fails (printing nothing) when data_len bytes do not fit */
+Status block_scatter(BlockIO *io, long data_off, size_t data_len, uint64_t seed);
+
+/* Continue at layout step `step` of the data section starting at data_off, in scatter order once set */
+Status block_seek_step(BlockIO *io, long data_off, size_t step);
+
+/* Start a CRC32C over the payload bytes embedded or extracted from here on, and the keystream at data offset 0 */
+void block_crc_start(BlockIO *io);
+
+/* Stop the running CRC32C and return it */
+uint32_t block_crc_stop(BlockIO *io);
+
+/* Continue the keystream at data offset pos, after a seek inside the data section */
+void block_cipher_at(BlockIO *io, uint64_t pos);
+
+/* Map the whole source image, or a kernel copy of it in the destination when encoding; pixel data starts at offset */
+Status block_map(BlockIO *io, size_t offset);
+
+/* Work on caller-owned memory (dest NULL when decoding), pixel data starts at offset */
+void block_attach(BlockIO *io, const unsigned char *src, unsigned char *dest, size_t len, size_t offset);
+
+/* Copy the untouched pixels after the payload between the mappings */
+Status block_copy_tail(BlockIO *io);
+
+/* Release the block buffer and any mappings */
+void block_free(BlockIO *io);
+
+#endif
@@ -0,0 +1,151 @@
+#include <limits.h>     // for LONG_MAX
+#include "bmp.h"        // for BMP declarations
+#include "cover.h"      // for cover_short
+
+#define BI_RGB 0
+#define BI_BITFIELDS 3
+#define BI_ALPHABITFIELDS 6
+
+static uint32_t le16(const uint8_t *p)
+{
+    return p[0] | (p[1] << 8);
+}
+
+static uint32_t le32(const uint8_t *p)
+{
+    return p[0] | (p[1] << 8) | (p[2] << 16) | ((uint32_t)p[3] << 24);
+}
+
+const char *bmp_parse_header(const uint8_t *header, size_t len, BmpInfo *info)
+{
+    if (len < BMP_MIN_HEADER_SIZE)
+    {
+        info->header_len = BMP_MIN_HEADER_SIZE;
+        return cover_short;
+    }
+    if (header[0] != 'B' || header[1] != 'M')
+        return "not a BMP image";
+
+    info->format = e_cover_bmp;
+    info->header_len = BMP_MIN_HEADER_SIZE;
+    info->file_size = le32(header + 2);
+    info->pixel_offset = le32(header + 10);
+    info->dib_size = le32(header + 14);
+    info->width = (int32_t)le32(header + 18);
+    info->height = (int32_t)le32(header + 22);
+    info->bits_per_pixel = le16(header + 28);
+    info->compression = le32(header + 30);
+
+    if (info->dib_size < 40)   // OS/2 core headers store 16-bit sizes
+        return "unsupported BMP core header";
+
+    if (info->compression != BI_RGB && info->compression != BI_BITFIELDS && info->compression != BI_ALPHABITFIELDS)
+        return "compressed BMP images are not supported";
+
+    // only 8-bit channels have a byte LSB that is a colour LSB: in a palette index it picks
+    // another colour, in a 5-6-5 / 5-5-5 pixel it is a middle bit of green
+    if (info->bits_per_pixel != 24 && info->bits_per_pixel != 32)
+        return "unsupported BMP pixel depth";
+
+    if (info->width <= 0 || info->height == 0 || info->height == INT32_MIN ||
+        info->pixel_offset < BMP_FILE_HEADER_SIZE + info->dib_size)
+        return "corrupt BMP header";
+
+    info->top_down = info->height < 0;
+    info->rows = info->top_down ? -(long)info->height : info->height;
+    info->row_bytes = (size_t)info->width * info->bits_per_pixel / 8;
+    info->stride = (info->row_bytes + 3) & ~(size_t)3;   // rows are padded to whole 32-bit words
+    return NULL;
+}
+
+size_t bmp_pixel_bytes(const BmpInfo *info)
+{
+    return info->row_bytes * info->rows;
+}
+
+void bmp_rows(const BmpInfo *info, BmpRows *rows)
+{
+    rows->first = info->pixel_offset;
+    if (info->stride == info->row_bytes)   // no padding, the whole array is one span
+    {
+        rows->row_bytes = info->row_bytes * info->rows;
+        rows->stride = rows->row_bytes;
+        rows->count = 1;
+    }
+    else
+    {
+        rows->row_bytes = info->row_bytes;
+        rows->stride = info->stride;
+        rows->count = info->rows;
+    }
+}
+
+void bmp_rows_flat(BmpRows *rows, long first)
+{
+    rows->first = first;
+    rows->row_bytes = LONG_MAX;
+    rows->stride = LONG_MAX;
+    rows->count = 1;
+}
+
+size_t bmp_span(const BmpRows *rows, long off, long *next)
+{
+    if (off < rows->first)   // still in the header or palette
+    {
+        *next = rows->first;
+        return 0;
+    }
+
+    size_t rel = off - rows->first;
+    size_t row = rel / rows->stride;
+    size_t col = rel % rows->stride;
+
+    if (row >= rows->count)
+    {
+        *next = -1;
+        return 0;
+    }
+    if (col >= rows->row_bytes)   // in the padding after a row
+    {
+        *next = row + 1 < rows->count ? rows->first + (long)((row + 1) * rows->stride) : -1;
+        return 0;
+    }
+    return rows->row_bytes - col;
+}
+
+long bmp_advance(const BmpRows *rows, long off, size_t n)
+{
+    size_t rel = off - rows->first;
+    size_t row = rel / rows->stride;
+    size_t col = rel % rows->stride;
+
+    if (col >= rows->row_bytes)   // starting in padding: the next pixel byte is the next row's first
+    {
+        row++;
+        col = 0;
+    }
+    col += n;
+
+    if (col > rows->row_bytes)   // crosses into later rows
+    {
+        row += (col - 1) / rows->row_bytes;
+        col = (col - 1) % rows->row_bytes + 1;   // a run ending on a row end stays on that row
+    }
+    return rows->first + (long)(row * rows->stride + col);
+}
+
+size_t bmp_bytes_left(const BmpRows *rows, long off)
+{
+    long next;
+
+    if (bmp_span(rows, off, &next) == 0)   // between rows: count from the next one
+    {
+        if (next < 0)
+            return 0;
+        off = next;
+    }
+
+    size_t rel = off - rows->first;
+    size_t row = rel / rows->stride;
+    return (rows->count - row) * rows->row_bytes - rel % rows->stride;
+}
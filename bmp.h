@@ -0,0 +1,83 @@
+#ifndef BMP_H
+#define BMP_H
+
+#include <stdio.h>
+#include <stddef.h>
+#include <stdint.h>
+#include "types.h"  // Contains user-defined types
+
+/*
+ * BMP header parsing and pixel row geometry.
+ * The pixel array starts at the offset stored in byte 10, so
+ * BITMAPINFOHEADER, V4 and V5 headers are all handled; only 24
+ * and 32 bpp pixels are taken as covers. Rows are padded to 4 bytes; BmpRows describes where
+ * the pixel bytes of each row are so the block engine can walk
+ * them in file order and skip the padding. Rows without padding
+ * are merged into one span so the kernels see one long run.
+ * BmpInfo is the geometry of every cover format: the PPM/PAM and
+ * TGA parsers fill it in too (see cover.h).
+ */
+
+#define BMP_FILE_HEADER_SIZE 14
+#define BMP_MIN_HEADER_SIZE 54     // file header + BITMAPINFOHEADER
+
+typedef enum
+{
+    e_cover_bmp,
+    e_cover_ppm,
+    e_cover_pam,
+    e_cover_tga
+
+} CoverFormat;
+
+typedef struct _BmpInfo
+{
+    CoverFormat format;        // image format the header was parsed as
+    uint32_t header_len;       // header bytes parsed, the rest up to pixel_offset is passed over
+    uint32_t file_size;        // size field of the BMP file header (informational)
+    uint32_t pixel_offset;     // image offset of the pixel array
+    uint32_t dib_size;         // 40 info, 108 V4, 124 V5 header; 0 in other formats
+    int32_t width;
+    int32_t height;            // as stored in a BMP, negative for top-down images
+    int top_down;              // rows are stored top row first
+    uint16_t bits_per_pixel;
+    uint32_t compression;      // BI_RGB or BI_BITFIELDS
+    size_t rows;               // number of pixel rows
+    size_t row_bytes;          // pixel bytes in one row
+    size_t stride;             // bytes between rows, padding included
+
+} BmpInfo;
+
+typedef struct _BmpRows
+{
+    long first;                // image offset of the first row
+    size_t row_bytes;          // pixel bytes in a row
+    size_t stride;             // distance between rows
+    size_t count;              // number of rows
+
+} BmpRows;
+
+/* Parse the first len bytes of a BMP image, returns NULL or why it cannot be
+   used (cover_short when len is below BMP_MIN_HEADER_SIZE) */
+const char *bmp_parse_header(const uint8_t *header, size_t len, BmpInfo *info);
+
+/* Pixel bytes in the image, padding excluded */
+size_t bmp_pixel_bytes(const BmpInfo *info);
+
+/* Row geometry of the image's pixel array */
+void bmp_rows(const BmpInfo *info, BmpRows *rows);
+
+/* Every byte from first to the end of the file as one row (payloads written before row parsing) */
+void bmp_rows_flat(BmpRows *rows, long first);
+
+/* Pixel bytes from image offset off to the end of its row. Returns 0 when off is
+   not on a pixel byte: *next is then the start of the next row, or -1 past the last row */
+size_t bmp_span(const BmpRows *rows, long off, long *next);
+
+/* Image offset reached after n pixel bytes starting at pixel byte off */
+long bmp_advance(const BmpRows *rows, long off, size_t n);
+
+/* Pixel bytes from image offset off to the end of the pixel array */
+size_t bmp_bytes_left(const BmpRows *rows, long off);
+
+#endif
@@ -0,0 +1,262 @@
+#include <string.h>     // for memcpy/memset
+#include <errno.h>      // for EINTR
+#include <sys/random.h> // for getrandom
+#include "cipher.h"     // for cipher declarations
+
+#define CIPHER_LANES 4   // keystream blocks made side by side, one vector lane each
+
+typedef uint32_t Lanes __attribute__((vector_size(CIPHER_LANES * 4)));   // one state word of every block
+
+#define ROTL(v, n) ((v) << (n) | (v) >> (32 - (n)))
+
+/* ---------- ChaCha20 ---------- */
+
+#define QUARTER(a, b, c, d)                               \
+    do {                                                  \
+        a += b; d ^= a; d = ROTL(d, 16);                  \
+        c += d; b ^= c; b = ROTL(b, 12);                  \
+        a += b; d ^= a; d = ROTL(d, 8);                   \
+        c += d; b ^= c; b = ROTL(b, 7);                   \
+    } while (0)
+
+// CIPHER_LANES keystream blocks from block counter `block` on, in stream order
+static void chacha_blocks(const Cipher *c, uint64_t block, uint8_t out[CIPHER_LANES * CIPHER_BLOCK])
+{
+    static const uint32_t sigma[4] = { 0x61707865, 0x3320646e, 0x79622d32, 0x6b206574 };   // "expand 32-byte k"
+    Lanes in[16], x[16];
+
+    for (int w = 0; w < 4; w++)
+        in[w] = (Lanes){0} + sigma[w];
+    for (int w = 0; w < 8; w++)
+        in[4 + w] = (Lanes){0} + c->key[w];
+    for (int l = 0; l < CIPHER_LANES; l++)
+    {
+        in[12][l] = (uint32_t)(block + l);           // 64-bit block counter
+        in[13][l] = (uint32_t)((block + l) >> 32);
+    }
+    in[14] = in[15] = (Lanes){0};                    // nonce, the salt makes every key unique
+    memcpy(x, in, sizeof(x));
+
+    for (int r = 0; r < 10; r++)   // 20 rounds: a column and a diagonal round each time
+    {
+        QUARTER(x[0], x[4], x[8], x[12]);
+        QUARTER(x[1], x[5], x[9], x[13]);
+        QUARTER(x[2], x[6], x[10], x[14]);
+        QUARTER(x[3], x[7], x[11], x[15]);
+        QUARTER(x[0], x[5], x[10], x[15]);
+        QUARTER(x[1], x[6], x[11], x[12]);
+        QUARTER(x[2], x[7], x[8], x[13]);
+        QUARTER(x[3], x[4], x[9], x[14]);
+    }
+
+    for (int w = 0; w < 16; w++)   // words stored as is: a little-endian host, like the CRC32C code
+    {
+        Lanes v = x[w] + in[w];
+        for (int l = 0; l < CIPHER_LANES; l++)
+            memcpy(out + l * CIPHER_BLOCK + w * 4, &v[l], 4);
+    }
+}
+
+void cipher_xor(const Cipher *c, uint64_t pos, const uint8_t *in, uint8_t *out, size_t n)
+{
+    uint8_t ks[CIPHER_LANES * CIPHER_BLOCK];
+    uint64_t block = pos / CIPHER_BLOCK;
+    size_t skip = pos % CIPHER_BLOCK;   // pos may fall inside a block
+
+    while (n > 0)
+    {
+        chacha_blocks(c, block, ks);
+        size_t len = sizeof(ks) - skip < n ? sizeof(ks) - skip : n;
+        size_t i = 0;
+        for (; i + 8 <= len; i += 8)   // a word at a time, the tail bytewise
+        {
+            uint64_t a, b;
+            memcpy(&a, in + i, 8);
+            memcpy(&b, ks + skip + i, 8);
+            a ^= b;
+            memcpy(out + i, &a, 8);
+        }
+        for (; i < len; i++)
+            out[i] = in[i] ^ ks[skip + i];
+
+        in += len;
+        out += len;
+        n -= len;
+        block += CIPHER_LANES;
+        skip = 0;
+    }
+}
+
+/* ---------- SHA-256, HMAC and PBKDF2 for the key ---------- */
+
+typedef struct _Sha256
+{
+    uint32_t h[8];
+    uint8_t buf[64];
+    size_t len;        // bytes in buf
+    uint64_t total;    // bytes hashed so far
+
+} Sha256;
+
+static const uint32_t sha_k[64] =
+{
+    0x428a2f98, 0x71374491, 0xb5c0fbcf, 0xe9b5dba5, 0x3956c25b, 0x59f111f1, 0x923f82a4, 0xab1c5ed5,
+    0xd807aa98, 0x12835b01, 0x243185be, 0x550c7dc3, 0x72be5d74, 0x80deb1fe, 0x9bdc06a7, 0xc19bf174,
+    0xe49b69c1, 0xefbe4786, 0x0fc19dc6, 0x240ca1cc, 0x2de92c6f, 0x4a7484aa, 0x5cb0a9dc, 0x76f988da,
+    0x983e5152, 0xa831c66d, 0xb00327c8, 0xbf597fc7, 0xc6e00bf3, 0xd5a79147, 0x06ca6351, 0x14292967,
+    0x27b70a85, 0x2e1b2138, 0x4d2c6dfc, 0x53380d13, 0x650a7354, 0x766a0abb, 0x81c2c92e, 0x92722c85,
+    0xa2bfe8a1, 0xa81a664b, 0xc24b8b70, 0xc76c51a3, 0xd192e819, 0xd6990624, 0xf40e3585, 0x106aa070,
+    0x19a4c116, 0x1e376c08, 0x2748774c, 0x34b0bcb5, 0x391c0cb3, 0x4ed8aa4a, 0x5b9cca4f, 0x682e6ff3,
+    0x748f82ee, 0x78a5636f, 0x84c87814, 0x8cc70208, 0x90befffa, 0xa4506ceb, 0xbef9a3f7, 0xc67178f2
+};
+
+#define ROTR(v, n) ((v) >> (n) | (v) << (32 - (n)))
+
+static void sha_compress(uint32_t h[8], const uint8_t block[64])
+{
+    uint32_t w[64], s[8];
+
+    for (int i = 0; i < 16; i++)
+        w[i] = (uint32_t)block[i * 4] << 24 | block[i * 4 + 1] << 16 | block[i * 4 + 2] << 8 | block[i * 4 + 3];
+    for (int i = 16; i < 64; i++)
+    {
+        uint32_t s0 = ROTR(w[i - 15], 7) ^ ROTR(w[i - 15], 18) ^ (w[i - 15] >> 3);
+        uint32_t s1 = ROTR(w[i - 2], 17) ^ ROTR(w[i - 2], 19) ^ (w[i - 2] >> 10);
+        w[i] = w[i - 16] + s0 + w[i - 7] + s1;
+    }
+
+    memcpy(s, h, sizeof(s));
+    for (int i = 0; i < 64; i++)
+    {
+        uint32_t t1 = s[7] + (ROTR(s[4], 6) ^ ROTR(s[4], 11) ^ ROTR(s[4], 25)) +
+                      ((s[4] & s[5]) ^ (~s[4] & s[6])) + sha_k[i] + w[i];
+        uint32_t t2 = (ROTR(s[0], 2) ^ ROTR(s[0], 13) ^ ROTR(s[0], 22)) +
+                      ((s[0] & s[1]) ^ (s[0] & s[2]) ^ (s[1] & s[2]));
+        memmove(s + 1, s, 7 * sizeof(uint32_t));
+        s[4] += t1;
+        s[0] = t1 + t2;
+    }
+    for (int i = 0; i < 8; i++)
+        h[i] += s[i];
+}
+
+static void sha_init(Sha256 *sha)
+{
+    static const uint32_t iv[8] = { 0x6a09e667, 0xbb67ae85, 0x3c6ef372, 0xa54ff53a,
+                                    0x510e527f, 0x9b05688c, 0x1f83d9ab, 0x5be0cd19 };
+    memcpy(sha->h, iv, sizeof(iv));
+    sha->len = 0;
+    sha->total = 0;
+}
+
+static void sha_update(Sha256 *sha, const uint8_t *data, size_t n)
+{
+    sha->total += n;
+    while (n > 0)
+    {
+        size_t take = 64 - sha->len < n ? 64 - sha->len : n;
+        memcpy(sha->buf + sha->len, data, take);
+        sha->len += take;
+        data += take;
+        n -= take;
+        if (sha->len == 64)
+        {
+            sha_compress(sha->h, sha->buf);
+            sha->len = 0;
+        }
+    }
+}
+
+static void sha_final(Sha256 *sha, uint8_t digest[32])
+{
+    uint64_t bits = sha->total * 8;
+    uint8_t pad[72] = { 0x80 };
+    size_t pad_len = (sha->len < 56 ? 56 : 120) - sha->len;
+
+    for (int i = 0; i < 8; i++)
+        pad[pad_len + i] = bits >> (56 - i * 8);
+    sha_update(sha, pad, pad_len + 8);
+    for (int i = 0; i < 8; i++)
+    {
+        digest[i * 4] = sha->h[i] >> 24;
+        digest[i * 4 + 1] = sha->h[i] >> 16;
+        digest[i * 4 + 2] = sha->h[i] >> 8;
+        digest[i * 4 + 3] = sha->h[i];
+    }
+}
+
+// HMAC-SHA256 states after the inner and outer padded keys, reused by every PBKDF2 iteration
+static void hmac_init(Sha256 *inner, Sha256 *outer, const uint8_t *key, size_t len)
+{
+    uint8_t block[64] = {0}, pad[64];
+
+    if (len > sizeof(block))   // long keys are hashed first
+    {
+        sha_init(inner);
+        sha_update(inner, key, len);
+        sha_final(inner, block);
+    }
+    else
+        memcpy(block, key, len);
+
+    sha_init(inner);
+    sha_init(outer);
+    for (int i = 0; i < 64; i++)
+        pad[i] = block[i] ^ 0x36;
+    sha_update(inner, pad, 64);
+    for (int i = 0; i < 64; i++)
+        pad[i] = block[i] ^ 0x5c;
+    sha_update(outer, pad, 64);
+}
+
+static void hmac(const Sha256 *inner, const Sha256 *outer, const uint8_t *data, size_t n, uint8_t mac[32])
+{
+    Sha256 sha = *inner;
+
+    sha_update(&sha, data, n);
+    sha_final(&sha, mac);
+    sha = *outer;
+    sha_update(&sha, mac, 32);
+    sha_final(&sha, mac);
+}
+
+void cipher_derive(Cipher *c, const uint8_t *secret, size_t len, const uint8_t salt[CIPHER_SALT_LEN], unsigned rounds)
+{
+    Sha256 inner, outer;
+    uint8_t first[CIPHER_SALT_LEN + 4], u[32], key[CIPHER_KEY_LEN];
+
+    // PBKDF2 block 1 is the whole 32 byte key: U1 = HMAC(salt | 1), Un = HMAC(Un-1), key = U1 ^ ... ^ Un
+    hmac_init(&inner, &outer, secret, len);
+    memcpy(first, salt, CIPHER_SALT_LEN);
+    memcpy(first + CIPHER_SALT_LEN, "\0\0\0\1", 4);
+    hmac(&inner, &outer, first, sizeof(first), u);
+    memcpy(key, u, sizeof(key));
+
+    for (unsigned r = 1; r < rounds; r++)
+    {
+        hmac(&inner, &outer, u, sizeof(u), u);
+        for (int i = 0; i < CIPHER_KEY_LEN; i++)
+            key[i] ^= u[i];
+    }
+
+    for (int w = 0; w < CIPHER_KEY_LEN / 4; w++)   // little-endian key words
+        c->key[w] = key[w * 4] | key[w * 4 + 1] << 8 | key[w * 4 + 2] << 16 | (uint32_t)key[w * 4 + 3] << 24;
+    memcpy(c->salt, salt, CIPHER_SALT_LEN);
+    memset(key, 0, sizeof(key));
+    memset(u, 0, sizeof(u));
+}
+
+Status cipher_salt(uint8_t salt[CIPHER_SALT_LEN])
+{
+    size_t got = 0;
+
+    while (got < CIPHER_SALT_LEN)
+    {
+        ssize_t n = getrandom(salt + got, CIPHER_SALT_LEN - got, 0);
+        if (n < 0 && errno != EINTR)
+            return e_failure;
+        if (n > 0)
+            got += n;
+    }
+    return e_success;
+}
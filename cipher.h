@@ -0,0 +1,45 @@
+#ifndef CIPHER_H
+#define CIPHER_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include "types.h"  // Contains user-defined types
+
+/*
+ * ChaCha20 encryption of the payload data (--pass / --pass-file).
+ * The key is derived with PBKDF2-HMAC-SHA256 from a passphrase, or
+ * from the bytes of a key file, and a random salt stored in the
+ * payload header, so every payload gets a key of its own and the
+ * nonce can stay zero. The keystream is seekable: data byte i is
+ * XORed with keystream byte i (block i / 64 of a 64-bit counter),
+ * so the block engine XORs each block of the secret on its way into
+ * the kernels, and a range read or a worker thread starts the
+ * keystream wherever its bytes start.
+ * This is confidentiality only: the CRC32C of the data is taken
+ * over the plaintext and catches a wrong key, but it is no MAC.
+ */
+
+#define CIPHER_KEY_LEN 32           // ChaCha20 key bytes
+#define CIPHER_SALT_LEN 16          // salt stored with an encrypted payload
+#define CIPHER_BLOCK 64             // keystream bytes per ChaCha20 block
+#define CIPHER_PASS_ROUNDS 100000   // PBKDF2 iterations for a passphrase
+#define CIPHER_FILE_ROUNDS 1        // a key file is random already, one HMAC spreads it over the key
+#define CIPHER_MAX_KEY_FILE 4096    // largest key file read
+
+typedef struct _Cipher
+{
+    uint32_t key[CIPHER_KEY_LEN / 4];   // ChaCha20 key words
+    uint8_t salt[CIPHER_SALT_LEN];      // salt the key was derived with
+
+} Cipher;
+
+/* Fill salt with random bytes from the kernel */
+Status cipher_salt(uint8_t salt[CIPHER_SALT_LEN]);
+
+/* Derive the key for salt from len bytes of secret (a passphrase or key file) with rounds PBKDF2 iterations */
+void cipher_derive(Cipher *c, const uint8_t *secret, size_t len, const uint8_t salt[CIPHER_SALT_LEN], unsigned rounds);
+
+/* XOR n bytes of in with the keystream from stream offset pos on into out (out may equal in) */
+void cipher_xor(const Cipher *c, uint64_t pos, const uint8_t *in, uint8_t *out, size_t n);
+
+#endif
@@ -0,0 +1,254 @@
+#include <stdio.h>      // for file and console I/O
+#include <stdlib.h>     // for malloc/free
+#include <string.h>     // for string handling functions
+#include <sys/stat.h>   // for stat
+#include "container.h"  // for container declarations
+#include "varint.h"     // for the directory fields
+#include "crc32c.h"     // for the per-file check
+#include "options.h"    // for print_error
+
+#define CONTAINER_LEN_FIELD 4   // directory length ahead of the directory
+
+static void put_le32(uint8_t *p, uint32_t v)
+{
+    p[0] = v;
+    p[1] = v >> 8;
+    p[2] = v >> 16;
+    p[3] = v >> 24;
+}
+
+static uint32_t get_le32(const uint8_t *p)
+{
+    return p[0] | (p[1] << 8) | (p[2] << 16) | ((uint32_t)p[3] << 24);
+}
+
+// name stored for a file: the path without its directories
+static const char *entry_name(const char *path)
+{
+    const char *slash = strrchr(path, '/');
+    return slash != NULL ? slash + 1 : path;
+}
+
+// directory bytes for these names and sizes; the offsets depend on the directory's
+// own length, so it is sized again until their varints stop growing
+static size_t dir_len(char *files[], const uint64_t *sizes, int count)
+{
+    size_t len = 0, prev;
+
+    do
+    {
+        prev = len;
+        uint64_t offset = CONTAINER_LEN_FIELD + prev;
+        len = varint_len(count);
+        for (int i = 0; i < count; i++)
+        {
+            size_t name = strlen(entry_name(files[i]));
+            len += varint_len(name) + name + varint_len(sizes[i]) + varint_len(offset) + 4;
+            offset += sizes[i];
+        }
+    } while (len != prev);
+    return len;
+}
+
+// size every file and check the names can be told apart
+static Status check_files(char *files[], int count, uint64_t *sizes)
+{
+    struct stat st;
+
+    for (int i = 0; i < count; i++)
+    {
+        const char *name = entry_name(files[i]);
+        if (stat(files[i], &st) != 0 || !S_ISREG(st.st_mode))
+        {
+            print_error("%s is not a regular file\n", files[i]);
+            return e_failure;
+        }
+        if (*name == '\0' || strlen(name) > CONTAINER_MAX_NAME)
+        {
+            print_error("file name %s is empty or longer than %d characters\n", files[i], CONTAINER_MAX_NAME);
+            return e_failure;
+        }
+        for (int j = 0; j < i; j++)
+        {
+            if (strcmp(entry_name(files[j]), name) == 0)
+            {
+                print_error("two files are named %s\n", name);
+                return e_failure;
+            }
+        }
+        sizes[i] = st.st_size;
+    }
+    return e_success;
+}
+
+// read one file into place, returns its CRC32C through crc
+static Status read_file(const char *fname, uint8_t *out, uint64_t size, uint32_t *crc)
+{
+    FILE *fptr = fopen(fname, "r");
+    Status status = fptr != NULL && fread(out, 1, size, fptr) == size ? e_success : e_failure;
+
+    if (fptr != NULL)
+        fclose(fptr);
+    if (status == e_failure)
+        print_error("unable to read %s\n", fname);
+    *crc = crc32c(0, out, size);
+    return status;
+}
+
+Status container_build(char *files[], int count, uint8_t **out, size_t *out_len)
+{
+    uint64_t *sizes = malloc(count * sizeof(uint64_t));
+    uint8_t *buf = NULL;
+
+    *out = NULL;
+    if (sizes == NULL || check_files(files, count, sizes) == e_failure)
+    {
+        free(sizes);
+        return e_failure;
+    }
+
+    size_t dir = dir_len(files, sizes, count);
+    size_t total = CONTAINER_LEN_FIELD + dir;
+    for (int i = 0; i < count; i++)
+        total += sizes[i];
+
+    buf = malloc(total + 1);
+    Status status = buf != NULL && dir <= UINT32_MAX ? e_success : e_failure;
+    if (status == e_failure)
+        print_error("unable to allocate a %zu byte container\n", total);
+
+    // the files go in first, their CRCs are needed for the directory
+    uint8_t *file = buf + CONTAINER_LEN_FIELD + dir;
+    uint32_t *crcs = malloc(count * sizeof(uint32_t) + 1);
+    for (int i = 0; status == e_success && i < count; i++)
+    {
+        status = crcs != NULL ? read_file(files[i], file, sizes[i], &crcs[i]) : e_failure;
+        file += sizes[i];
+    }
+
+    if (status == e_success)
+    {
+        uint8_t *p = buf;
+        uint64_t offset = CONTAINER_LEN_FIELD + dir;
+
+        put_le32(p, dir);
+        p += CONTAINER_LEN_FIELD;
+        p += varint_put(p, count);
+        for (int i = 0; i < count; i++)
+        {
+            const char *name = entry_name(files[i]);
+            size_t name_len = strlen(name);
+
+            p += varint_put(p, name_len);
+            memcpy(p, name, name_len);
+            p += name_len;
+            p += varint_put(p, sizes[i]);
+            p += varint_put(p, offset);
+            put_le32(p, crcs[i]);
+            p += 4;
+            offset += sizes[i];
+        }
+        *out = buf;
+        *out_len = total;
+    }
+    else
+        free(buf);
+
+    free(crcs);
+    free(sizes);
+    return status;
+}
+
+// one varint field of the directory, moving *p past it
+static Status get_field(const uint8_t **p, const uint8_t *end, uint64_t *value)
+{
+    size_t n = varint_get(*p, end - *p, value);
+
+    *p += n;
+    return n > 0 ? e_success : e_failure;
+}
+
+// split the directory bytes into entries
+static Status parse_dir(const uint8_t *p, const uint8_t *end, size_t data_start, ContainerDir *dir)
+{
+    uint64_t count, name_len;
+
+    if (get_field(&p, end, &count) == e_failure || count > (size_t)(end - p))   // every entry takes bytes
+        return e_failure;
+
+    dir->entries = calloc(count + 1, sizeof(ContainerEntry));
+    if (dir->entries == NULL)
+        return e_failure;
+
+    for (dir->count = 0; dir->count < count; dir->count++)
+    {
+        ContainerEntry *e = &dir->entries[dir->count];
+
+        if (get_field(&p, end, &name_len) == e_failure || name_len == 0 || name_len > CONTAINER_MAX_NAME ||
+            name_len > (size_t)(end - p))
+            return e_failure;
+        memcpy(e->name, p, name_len);
+        e->name[name_len] = '\0';
+        p += name_len;
+
+        if (get_field(&p, end, &e->size) == e_failure || get_field(&p, end, &e->offset) == e_failure ||
+            end - p < 4 || e->offset < data_start || e->offset + e->size < e->offset)
+            return e_failure;
+        e->crc = get_le32(p);
+        p += 4;
+    }
+    return e_success;
+}
+
+Status container_read_dir(ContainerReadFn read, void *ctx, ContainerDir *dir)
+{
+    uint8_t field[CONTAINER_LEN_FIELD];
+
+    dir->entries = NULL;
+    dir->count = 0;
+    if (read(ctx, 0, CONTAINER_LEN_FIELD, field) == e_failure)
+        return e_failure;
+
+    size_t len = get_le32(field);
+    uint8_t *bytes = malloc(len + 1);
+    Status status = bytes != NULL ? read(ctx, CONTAINER_LEN_FIELD, len, bytes) : e_failure;
+
+    if (status == e_success)
+        status = parse_dir(bytes, bytes + len, CONTAINER_LEN_FIELD + len, dir);
+    free(bytes);
+    if (status == e_failure)
+    {
+        print_error("the container directory is corrupt\n");
+        container_free(dir);
+    }
+    return status;
+}
+
+const ContainerEntry *container_find(const ContainerDir *dir, const char *name)
+{
+    for (size_t i = 0; i < dir->count; i++)
+    {
+        if (strcmp(dir->entries[i].name, name) == 0)
+            return &dir->entries[i];
+    }
+    return NULL;
+}
+
+void container_list(const ContainerDir *dir)
+{
+    uint64_t total = 0;
+
+    for (size_t i = 0; i < dir->count; i++)
+    {
+        printf("%12llu  %08x  %s\n", (unsigned long long)dir->entries[i].size, dir->entries[i].crc, dir->entries[i].name);
+        total += dir->entries[i].size;
+    }
+    printf("%zu files, %llu bytes\n", dir->count, (unsigned long long)total);
+}
+
+void container_free(ContainerDir *dir)
+{
+    free(dir->entries);
+    dir->entries = NULL;
+    dir->count = 0;
+}
@@ -0,0 +1,60 @@
+#ifndef CONTAINER_H
+#define CONTAINER_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include "types.h"  // Contains user-defined types
+
+/*
+ * Container mode (--add): several files in one payload.
+ * A payload with STEGO_FLAG_CONTAINER set holds a directory ahead
+ * of the files, all of it ordinary data (packed, scattered and
+ * checksummed like any other):
+ *     directory length (32 bit) | entry count | entries | file data
+ * and every entry is
+ *     name length | name | size | offset | CRC32C of the file (32 bit)
+ * with the lengths, sizes and offsets as varints (see varint.h).
+ * Offsets count payload bytes from the start of the data, so a
+ * decoder reads the directory, then seeks straight to the one file
+ * it wants with a range read; the files before it are passed over.
+ */
+
+#define CONTAINER_EXTN ".box"      // extension stored with a container payload
+#define CONTAINER_MAX_NAME 255     // longest file name in the directory
+#define CONTAINER_CHUNK (64 * 1024)   // chunk size a packed container uses, so each file unpacks on its own
+
+typedef struct _ContainerEntry
+{
+    char name[CONTAINER_MAX_NAME + 1];   // file name, no directory part
+    uint64_t size;                       // bytes of the file
+    uint64_t offset;                     // data offset of its first byte
+    uint32_t crc;                        // CRC32C of the file
+
+} ContainerEntry;
+
+typedef struct _ContainerDir
+{
+    ContainerEntry *entries;
+    size_t count;
+
+} ContainerDir;
+
+/* Reads payload bytes [off, off + len) into out, failing when fewer are there */
+typedef Status (*ContainerReadFn)(void *ctx, size_t off, size_t len, uint8_t *out);
+
+/* Read every file into one container, *out (malloc'd) receives the directory and the files */
+Status container_build(char *files[], int count, uint8_t **out, size_t *out_len);
+
+/* Read and check the directory at the start of a container payload */
+Status container_read_dir(ContainerReadFn read, void *ctx, ContainerDir *dir);
+
+/* Entry named name, NULL when the container has none */
+const ContainerEntry *container_find(const ContainerDir *dir, const char *name);
+
+/* Print the directory, one file per line */
+void container_list(const ContainerDir *dir);
+
+/* Release the directory entries */
+void container_free(ContainerDir *dir);
+
+#endif
@@ -0,0 +1,148 @@
+#define _GNU_SOURCE     // for copy_file_range
+#include <stdio.h>      // for fread/fwrite
+#include <stdlib.h>     // for malloc/free
+#include <errno.h>      // for the errors that mean "not supported here"
+#include <unistd.h>     // for copy_file_range/pread/write
+#include <sys/stat.h>   // for fstat
+#include <sys/sendfile.h>   // for sendfile
+#include "copy.h"       // for copy declarations
+#include "stego.h"      // for stego_error
+
+// errors telling the kernel cannot do this copy, not that the files are broken
+static int try_next_method(int err)
+{
+    return err == EXDEV || err == ENOSYS || err == EINVAL || err == EOPNOTSUPP || err == EBADF;
+}
+
+int copy_same_file(int fd_a, int fd_b)
+{
+    struct stat a, b;
+
+    return fstat(fd_a, &a) == 0 && fstat(fd_b, &b) == 0 && a.st_dev == b.st_dev && a.st_ino == b.st_ino;
+}
+
+// resolve COPY_TO_END against the size of the source
+static Status copy_len(int fd_src, long off, size_t *len)
+{
+    struct stat st;
+
+    if (*len != COPY_TO_END)
+        return e_success;
+    if (fstat(fd_src, &st) != 0)
+        return e_failure;
+    *len = st.st_size > off ? (size_t)(st.st_size - off) : 0;
+    return e_success;
+}
+
+// fallback: pread from the source, then pwrite at the same offset, or append to a pipe
+static Status copy_loop(int fd_src, int fd_dest, long off, size_t len, int to_pipe)
+{
+    unsigned char *buf = malloc(COPY_BUF_SIZE);
+    Status status = buf != NULL ? e_success : e_failure;
+
+    while (status == e_success && len > 0)
+    {
+        ssize_t n = pread(fd_src, buf, len < COPY_BUF_SIZE ? len : COPY_BUF_SIZE, off);
+        if (n <= 0)
+            status = e_failure;
+        for (ssize_t done = 0, w; status == e_success && done < n; done += w)
+        {
+            w = to_pipe ? write(fd_dest, buf + done, n - done) : pwrite(fd_dest, buf + done, n - done, off + done);
+            if (w <= 0)
+                status = e_failure;
+        }
+        off += n;
+        len -= n;
+    }
+    free(buf);
+    return status;
+}
+
+Status copy_fd_range(int fd_src, int fd_dest, long off, size_t len)
+{
+    if (copy_same_file(fd_src, fd_dest))   // in place: the bytes are already there
+        return e_success;
+    if (copy_len(fd_src, off, &len) == e_failure)
+        return e_failure;
+
+    loff_t in = off, out = off;
+    while (len > 0)
+    {
+        ssize_t n = copy_file_range(fd_src, &in, fd_dest, &out, len, 0);
+        if (n > 0)
+            len -= n;
+        else if (n < 0 && try_next_method(errno))
+            break;
+        else
+            return e_failure;   // the source ended early, or a real I/O error
+    }
+    return len == 0 ? e_success : copy_loop(fd_src, fd_dest, in, len, 0);
+}
+
+// a pipe has no offsets for copy_file_range, sendfile appends to it instead
+static Status send_to_pipe(int fd_src, int fd_dest, long off, size_t len)
+{
+    off_t in = off;
+
+    while (len > 0)
+    {
+        ssize_t n = sendfile(fd_dest, fd_src, &in, len);
+        if (n > 0)
+            len -= n;
+        else if (n < 0 && try_next_method(errno))
+            break;
+        else
+            return e_failure;
+    }
+    return len == 0 ? e_success : copy_loop(fd_src, fd_dest, in, len, 1);
+}
+
+// a piped source may already sit in the stream buffer, so it is read through stdio
+static Status copy_stream(FILE *fptr_src, FILE *fptr_dest, size_t len)
+{
+    unsigned char *buf = malloc(COPY_BUF_SIZE);
+    Status status = buf != NULL ? e_success : e_failure;
+
+    while (status == e_success && len > 0)
+    {
+        size_t n = fread(buf, 1, len < COPY_BUF_SIZE ? len : COPY_BUF_SIZE, fptr_src);
+        if (n == 0)
+        {
+            if (len != COPY_TO_END || ferror(fptr_src))   // only the rest of the image may end early
+                status = e_failure;
+            break;
+        }
+        if (fwrite(buf, 1, n, fptr_dest) != n)
+            status = e_failure;
+        if (len != COPY_TO_END)
+            len -= n;
+    }
+    free(buf);
+    return status;
+}
+
+Status copy_image_range(FILE *fptr_src, FILE *fptr_dest, long off, size_t len)
+{
+    int piped_src = ftell(fptr_src) < 0;
+    int piped_dest = ftell(fptr_dest) < 0;
+    int fd_src = fileno(fptr_src), fd_dest = fileno(fptr_dest);
+    Status status;
+
+    if (piped_src)
+        status = copy_stream(fptr_src, fptr_dest, len);
+    else if (fflush(fptr_dest) != 0 || copy_len(fd_src, off, &len) == e_failure)
+        status = e_failure;
+    else if (piped_dest)
+        status = send_to_pipe(fd_src, fd_dest, off, len);
+    else
+        status = copy_fd_range(fd_src, fd_dest, off, len);
+
+    if (status == e_success && !piped_src)   // the copy went around both streams, line them up after it
+    {
+        if (fseek(fptr_src, off + len, SEEK_SET) != 0 || (!piped_dest && fseek(fptr_dest, off + len, SEEK_SET) != 0))
+            status = e_failure;
+    }
+    if (status == e_failure)
+        stego_error("failed to copy the unchanged image bytes");
+    return status;
+}
@@ -0,0 +1,32 @@
+#ifndef COPY_H
+#define COPY_H
+
+#include <stdio.h>
+#include <stddef.h>
+#include "types.h"  // Contains user-defined types
+
+/*
+ * Copies of the cover bytes no payload touches: the header and the
+ * pixels after the data section. The kernel moves them with
+ * copy_file_range(), which shares the extents instead of copying
+ * on filesystems with reflinks, or with sendfile() when the stego
+ * image goes to a pipe; neither passes the bytes through user
+ * space. A read / write loop is the fallback for piped covers,
+ * older kernels and copies across filesystems.
+ * A file copied onto itself (--in-place) costs nothing.
+ */
+
+#define COPY_TO_END ((size_t)-1)    // copy up to the end of the source image
+#define COPY_BUF_SIZE (256 * 1024)  // bytes per read/write of the fallback loop
+
+/* Copy len bytes at image offset off from src to the same offset of dest, leaving both
+   streams after them; a piped src is read from where it is and off is not used */
+Status copy_image_range(FILE *fptr_src, FILE *fptr_dest, long off, size_t len);
+
+/* Same between two seekable descriptors without moving their file positions (safe from worker threads) */
+Status copy_fd_range(int fd_src, int fd_dest, long off, size_t len);
+
+/* Whether both descriptors refer to the same file */
+int copy_same_file(int fd_a, int fd_b);
+
+#endif
@@ -0,0 +1,107 @@
+#include <stdlib.h>     // for malloc/free
+#include <string.h>     // for memcpy
+#include "cover.h"      // for cover declarations
+#include "pnm.h"        // for PPM and PAM headers
+#include "tga.h"        // for TGA headers
+#include "stego.h"      // for stego_error
+
+const char cover_short[] = "image is too short for its header";
+
+// hand the header to the parser its first bytes pick
+static const char *parse_fields(const uint8_t *header, size_t len, BmpInfo *info)
+{
+    if (len < COVER_MAGIC_LEN)
+    {
+        info->header_len = COVER_MAGIC_LEN;
+        return cover_short;
+    }
+    if (header[0] == 'B' && header[1] == 'M')
+        return bmp_parse_header(header, len, info);
+    if (header[0] == 'P' && (header[1] == '6' || header[1] == '7'))
+        return pnm_parse_header(header, len, info);
+    return tga_parse_header(header, len, info);
+}
+
+// read the header of the image at fptr's position into head, exactly as far as its
+// parser asks, returns NULL or why it cannot be used
+static const char *read_fields(FILE *fptr, uint8_t head[COVER_MAX_HEADER], BmpInfo *info)
+{
+    const char *why;
+    size_t got = 0;
+
+    info->header_len = COVER_MAGIC_LEN;
+    do
+    {
+        if (info->header_len > COVER_MAX_HEADER)
+            return "image header is too long";
+        got += fread(head + got, 1, info->header_len - got, fptr);
+        if (got < info->header_len)
+            return cover_short;
+        why = parse_fields(head, got, info);
+    } while (why == cover_short);
+    return why;
+}
+
+Status cover_parse(const uint8_t *header, size_t len, BmpInfo *info)
+{
+    return parse_fields(header, len, info) == NULL ? e_success : e_failure;
+}
+
+Status cover_read(FILE *fptr, BmpInfo *info)
+{
+    uint8_t head[COVER_MAX_HEADER];
+
+    if (ftell(fptr) > 0)   // a pipe has no position and is read from where it is
+        rewind(fptr);
+
+    const char *why = read_fields(fptr, head, info);
+    if (why != NULL)
+    {
+        stego_error("%s", why);
+        return e_failure;
+    }
+    return e_success;
+}
+
+Status cover_read_stream(FILE *fptr, BmpInfo *info, uint8_t **header)
+{
+    uint8_t head[COVER_MAX_HEADER];
+
+    *header = NULL;
+    const char *why = read_fields(fptr, head, info);
+    if (why != NULL)
+    {
+        stego_error("%s", why);
+        return e_failure;
+    }
+
+    *header = malloc(info->pixel_offset);   // rest of the header and any palette, ID or colour map follow
+    if (*header == NULL)
+    {
+        stego_error("unable to allocate the %u byte image header", info->pixel_offset);
+        return e_failure;
+    }
+    memcpy(*header, head, info->header_len);
+    size_t rest = info->pixel_offset - info->header_len;
+    if (fread(*header + info->header_len, 1, rest, fptr) != rest)
+    {
+        stego_error("%s", cover_short);
+        free(*header);
+        *header = NULL;
+        return e_failure;
+    }
+    return e_success;
+}
+
+int cover_channels(const BmpInfo *info, int mask)
+{
+    if (info->format != e_cover_ppm && info->format != e_cover_pam)
+        return mask;
+    return (mask & ~5) | (mask & 1) << 2 | (mask & 4) >> 2;   // swap b (bit 0) and r (bit 2)
+}
+
+const char *cover_format_name(CoverFormat format)
+{
+    static const char *const names[] = { "BMP", "PPM", "PAM", "TGA" };
+    return names[format];
+}
@@ -0,0 +1,49 @@
+#ifndef COVER_H
+#define COVER_H
+
+#include <stdio.h>
+#include <stddef.h>
+#include <stdint.h>
+#include "types.h"  // Contains user-defined types
+#include "bmp.h"    // Contains the pixel row geometry
+
+/*
+ * Cover formats: the image is told apart by its first bytes, not
+ * its file name, and handed to the parser of its format:
+ *     "BM"        BMP (bmp.c)
+ *     "P6" / "P7" binary PPM and PAM with 8-bit samples (pnm.c)
+ *     otherwise   uncompressed TGA, which has no magic (tga.c)
+ * Every parser fills the same BmpInfo, so the block engine, the
+ * kernels and the header copy only ever see a pixel offset and a
+ * row geometry, whatever the format. PPM, PAM and TGA rows have no
+ * padding, so their whole pixel array is one span.
+ * A parser asks for more bytes by returning cover_short with
+ * info->header_len set to the length it needs, which lets a piped
+ * image be read exactly up to its pixels, however long its header.
+ */
+
+#define COVER_MAGIC_LEN 2           // bytes that pick the format
+#define COVER_MAX_HEADER 4096       // longest header parsed (PPM comments, PAM lines); palettes are passed over
+
+/* Returned by a parser when the header continues past the bytes it was given */
+extern const char cover_short[];
+
+/* Parse the first len bytes of an image in any cover format, prints nothing */
+Status cover_parse(const uint8_t *header, size_t len, BmpInfo *info);
+
+/* Read and parse the header of an open image, reporting why it cannot be used.
+   The stream is left info->header_len bytes in */
+Status cover_read(FILE *fptr, BmpInfo *info);
+
+/* cover_read for an image that cannot seek: *header receives every byte up to the
+   pixel array (malloc'd, for the stego image), the stream is left at the pixels */
+Status cover_read_stream(FILE *fptr, BmpInfo *info, uint8_t **header);
+
+/* Pixel byte positions of a --channels mask, which names bytes in BMP order (b g r a):
+   PPM and PAM pixels are RGB(A), so red and blue trade places */
+int cover_channels(const BmpInfo *info, int mask);
+
+/* Name of the format, for messages */
+const char *cover_format_name(CoverFormat format);
+
+#endif
@@ -0,0 +1,161 @@
+#include <string.h>     // for memcpy
+#include <pthread.h>    // for pthread_once
+#include "crc32c.h"     // for CRC32C declarations
+
+#if defined(__x86_64__) || defined(__i386__)
+#define CRC_X86 1
+#include <immintrin.h>  // for the SSE4.2 crc32 instruction
+#endif
+
+#define CRC32C_POLY 0x82F63B78u   // reflected Castagnoli polynomial
+
+typedef uint32_t (*CrcFn)(uint32_t crc, const unsigned char *p, size_t n);
+
+static uint32_t table[8][256];    // slicing-by-8, table[k][b] is b followed by k zero bytes
+static CrcFn crc_update;
+static const char *impl_name = "table";
+static pthread_once_t init_once = PTHREAD_ONCE_INIT;
+
+/* ---------- table fallback ---------- */
+
+static uint32_t update_table(uint32_t crc, const unsigned char *p, size_t n)
+{
+    for (; n > 0 && ((uintptr_t)p & 7) != 0; n--)   // bytewise up to an 8 byte boundary
+        crc = table[0][(crc ^ *p++) & 0xFF] ^ (crc >> 8);
+
+    for (; n >= 8; n -= 8, p += 8)
+    {
+        uint32_t lo, hi;
+        memcpy(&lo, p, 4);
+        memcpy(&hi, p + 4, 4);
+        lo ^= crc;   // little-endian: the CRC lines up with the first four bytes
+        crc = table[7][lo & 0xFF] ^ table[6][(lo >> 8) & 0xFF] ^ table[5][(lo >> 16) & 0xFF] ^ table[4][lo >> 24] ^
+              table[3][hi & 0xFF] ^ table[2][(hi >> 8) & 0xFF] ^ table[1][(hi >> 16) & 0xFF] ^ table[0][hi >> 24];
+    }
+
+    for (; n > 0; n--)
+        crc = table[0][(crc ^ *p++) & 0xFF] ^ (crc >> 8);
+    return crc;
+}
+
+#ifdef CRC_X86
+
+/* ---------- SSE4.2: 8 bytes per crc32 instruction ---------- */
+
+__attribute__((target("sse4.2")))
+static uint32_t update_sse42(uint32_t crc, const unsigned char *p, size_t n)
+{
+    for (; n > 0 && ((uintptr_t)p & 7) != 0; n--)
+        crc = _mm_crc32_u8(crc, *p++);
+
+#ifdef __x86_64__
+    uint64_t c = crc;
+    for (; n >= 8; n -= 8, p += 8)
+    {
+        uint64_t v;
+        memcpy(&v, p, 8);
+        c = _mm_crc32_u64(c, v);
+    }
+    crc = (uint32_t)c;
+#endif
+
+    for (; n >= 4; n -= 4, p += 4)
+    {
+        uint32_t v;
+        memcpy(&v, p, 4);
+        crc = _mm_crc32_u32(crc, v);
+    }
+    for (; n > 0; n--)
+        crc = _mm_crc32_u8(crc, *p++);
+    return crc;
+}
+
+#endif
+
+/* ---------- dispatch ---------- */
+
+// build the fallback tables and pick the implementation from cpuid
+static void crc_init(void)
+{
+    for (uint32_t b = 0; b < 256; b++)
+    {
+        uint32_t crc = b;
+        for (int i = 0; i < 8; i++)
+            crc = crc & 1 ? (crc >> 1) ^ CRC32C_POLY : crc >> 1;
+        table[0][b] = crc;
+    }
+    for (uint32_t b = 0; b < 256; b++)
+        for (int k = 1; k < 8; k++)
+            table[k][b] = table[0][table[k - 1][b] & 0xFF] ^ (table[k - 1][b] >> 8);
+
+    crc_update = update_table;
+#ifdef CRC_X86
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("sse4.2"))
+    {
+        crc_update = update_sse42;
+        impl_name = "sse4.2";
+    }
+#endif
+}
+
+uint32_t crc32c(uint32_t crc, const void *data, size_t n)
+{
+    pthread_once(&init_once, crc_init);
+    return ~crc_update(~crc, data, n);
+}
+
+const char *crc32c_impl_name(void)
+{
+    pthread_once(&init_once, crc_init);
+    return impl_name;
+}
+
+/* ---------- combine: zeros appended as a GF(2) matrix power ---------- */
+
+static uint32_t gf2_times(const uint32_t *mat, uint32_t vec)
+{
+    uint32_t sum = 0;
+
+    for (; vec != 0; vec >>= 1, mat++)
+        if (vec & 1)
+            sum ^= *mat;
+    return sum;
+}
+
+static void gf2_square(uint32_t *square, const uint32_t *mat)
+{
+    for (int n = 0; n < 32; n++)
+        square[n] = gf2_times(mat, mat[n]);
+}
+
+uint32_t crc32c_combine(uint32_t crc1, uint32_t crc2, size_t len2)
+{
+    uint32_t even[32], odd[32];   // operators for 2^k zero bits, alternating
+
+    if (len2 == 0)
+        return crc1;
+
+    odd[0] = CRC32C_POLY;   // one zero bit
+    for (int n = 1; n < 32; n++)
+        odd[n] = 1u << (n - 1);
+    gf2_square(even, odd);  // two zero bits
+    gf2_square(odd, even);  // four zero bits
+
+    do   // the first squaring gives one zero byte
+    {
+        gf2_square(even, odd);
+        if (len2 & 1)
+            crc1 = gf2_times(even, crc1);
+        len2 >>= 1;
+        if (len2 == 0)
+            break;
+
+        gf2_square(odd, even);
+        if (len2 & 1)
+            crc1 = gf2_times(odd, crc1);
+        len2 >>= 1;
+    } while (len2 != 0);
+
+    return crc1 ^ crc2;
+}
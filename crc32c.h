@@ -0,0 +1,26 @@
+#ifndef CRC32C_H
+#define CRC32C_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+/*
+ * CRC32C (Castagnoli, reflected polynomial 0x82F63B78) of the
+ * payload data. The SSE4.2 crc32 instruction is used when the CPU
+ * has it, slicing-by-8 tables otherwise; the first call picks one.
+ * Values chain like zlib's crc32(): start from 0 and pass the
+ * previous result back in, so a stream can be checksummed piece by
+ * piece, and crc32c_combine() joins the CRCs of two adjacent
+ * pieces computed on different threads.
+ */
+
+/* Continue crc (0 to start) over n bytes of data */
+uint32_t crc32c(uint32_t crc, const void *data, size_t n);
+
+/* CRC of A followed by B from crc1 = CRC(A), crc2 = CRC(B) and the length of B */
+uint32_t crc32c_combine(uint32_t crc1, uint32_t crc2, size_t len2);
+
+/* Name of the implementation in use, "sse4.2" or "table" */
+const char *crc32c_impl_name(void);
+
+#endif
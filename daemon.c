@@ -0,0 +1,562 @@
+#define _GNU_SOURCE     // for accept4 and MSG_CMSG_CLOEXEC
+#include <stdio.h>      // for console I/O and snprintf
+#include <stdlib.h>     // for calloc/qsort
+#include <stdarg.h>     // for va_list
+#include <string.h>     // for string handling functions
+#include <errno.h>      // for EINTR
+#include <signal.h>     // for sigaction
+#include <poll.h>       // for poll
+#include <unistd.h>     // for close/unlink/sysconf
+#include <pthread.h>    // for the counter lock
+#include <sys/stat.h>   // for lstat/umask
+#include <sys/socket.h> // for the listening socket and SCM_RIGHTS
+#include <sys/un.h>     // for sockaddr_un
+#include <sys/eventfd.h>    // for waking the accept loop from a worker
+#include "daemon.h"     // for daemon declarations
+#include "batch.h"      // for the job syntax and runner
+#include "pool.h"       // for the work-stealing pool
+#include "stats.h"      // for stats_now_ms
+
+#define DAEMON_FD_NAME 32   // "/proc/self/fd/<n>" for a passed descriptor
+
+typedef struct _Daemon Daemon;
+
+typedef struct _DaemonClient
+{
+    Daemon *daemon;
+    int fd;                          // connection, -1 for a free slot
+    int busy;                        // a request is queued or running: nothing more is read until it replies
+    int replied;                     // set by the worker once the reply is out (under the daemon lock)
+    char buf[MAX_MANIFEST_LINE + 1]; // bytes received, a request ends at '\n'
+    size_t len;                      // bytes in buf
+    size_t used;                     // bytes of buf taken by the running request
+    int passed[DAEMON_MAX_FDS];      // descriptors received for the next request
+    int passed_count;
+    char fd_names[DAEMON_MAX_FDS][DAEMON_FD_NAME];
+    BatchSpec spec;                  // the running request, pointing into buf and fd_names
+    StegoOptions opts;
+    double start;                    // when the request arrived
+
+} DaemonClient;
+
+struct _Daemon
+{
+    const char *path;
+    int listen_fd;
+    int wake_fd;                 // eventfd a worker bumps after replying
+    const StegoOptions *opts;    // options the daemon was started with
+    BatchWorkers workers;        // per-worker block buffers and io_uring
+    ThreadPool pool;
+    DaemonClient *clients;       // DAEMON_MAX_CLIENTS slots
+    int client_count;
+    int stop;                    // a shutdown request came in
+
+    pthread_mutex_t lock;        // protects everything below
+    int queued;                  // requests waiting for a worker
+    int running;                 // requests on a worker
+    unsigned long done;          // requests answered ok or failed
+    unsigned long failed;
+    double latency[DAEMON_LATENCY_SAMPLES];   // ring of the latest latencies in ms
+    double sorted[DAEMON_LATENCY_SAMPLES];    // scratch for the percentiles
+};
+
+static volatile sig_atomic_t daemon_signalled;
+
+static void on_signal(int sig)
+{
+    (void)sig;
+    daemon_signalled = 1;
+}
+
+// one reply line, whole; the client may have gone, which is no error of ours
+static void reply(int fd, const char *fmt, ...) __attribute__((format(printf, 2, 3)));
+static void reply(int fd, const char *fmt, ...)
+{
+    char line[512];
+    va_list args;
+
+    va_start(args, fmt);
+    int n = vsnprintf(line, sizeof(line) - 1, fmt, args);
+    va_end(args);
+    if (n < 0)
+        return;
+    if ((size_t)n > sizeof(line) - 2)
+        n = sizeof(line) - 2;
+    line[n++] = '\n';
+
+    for (int off = 0; off < n;)
+    {
+        ssize_t sent = send(fd, line + off, n - off, MSG_NOSIGNAL);
+        if (sent < 0 && errno == EINTR)
+            continue;
+        if (sent <= 0)
+            return;
+        off += sent;
+    }
+}
+
+// run one request on the calling worker with that worker's buffers
+static void run_request(void *arg, int worker)
+{
+    DaemonClient *c = arg;
+    Daemon *d = c->daemon;
+
+    pthread_mutex_lock(&d->lock);
+    d->queued--;
+    d->running++;
+    pthread_mutex_unlock(&d->lock);
+
+    Status status = batch_run_job(&c->spec, &c->opts, d->workers.buffers[worker],
+                                  d->workers.urings != NULL ? &d->workers.urings[worker] : NULL);
+    double ms = stats_now_ms() - c->start;
+
+    pthread_mutex_lock(&d->lock);   // counted before the reply, so a stats request after it sees the job done
+    d->running--;
+    d->latency[d->done % DAEMON_LATENCY_SAMPLES] = ms;
+    d->done++;
+    d->failed += status == e_failure;
+    pthread_mutex_unlock(&d->lock);
+
+    reply(c->fd, "%s %.3f", status == e_success ? "ok" : "failed", ms);
+    pthread_mutex_lock(&d->lock);   // only now may the accept loop start the client's next request
+    c->replied = 1;
+    pthread_mutex_unlock(&d->lock);
+
+    uint64_t one = 1;
+    if (write(d->wake_fd, &one, sizeof(one)) < 0)   // only fails when the counter is full, and then the loop is awake anyway
+        return;
+}
+
+static int compare_double(const void *a, const void *b)
+{
+    double x = *(const double *)a, y = *(const double *)b;
+    return (x > y) - (x < y);
+}
+
+// nearest-rank percentile of n sorted samples
+static double percentile(const double *sorted, size_t n, int p)
+{
+    size_t rank = (n * p + 99) / 100;
+    return n > 0 ? sorted[rank > 0 ? rank - 1 : 0] : 0.0;
+}
+
+static void reply_stats(Daemon *d, int fd)
+{
+    pthread_mutex_lock(&d->lock);
+    size_t n = d->done < DAEMON_LATENCY_SAMPLES ? d->done : DAEMON_LATENCY_SAMPLES;
+    memcpy(d->sorted, d->latency, n * sizeof(double));
+    int queued = d->queued, running = d->running;
+    unsigned long done = d->done, failed = d->failed;
+    pthread_mutex_unlock(&d->lock);
+
+    qsort(d->sorted, n, sizeof(double), compare_double);   // only the accept loop uses sorted
+    reply(fd, "{\"workers\": %d, \"clients\": %d, \"queued\": %d, \"running\": %d, \"done\": %lu, \"failed\": %lu, "
+              "\"latency_ms\": {\"samples\": %zu, \"p50\": %.3f, \"p90\": %.3f, \"p99\": %.3f, \"max\": %.3f}}",
+          d->workers.count, d->client_count, queued, running, done, failed, n,
+          percentile(d->sorted, n, 50), percentile(d->sorted, n, 90), percentile(d->sorted, n, 99),
+          n > 0 ? d->sorted[n - 1] : 0.0);
+}
+
+// swap a file name of the form @<n>[.ext] for the n-th passed descriptor, *extn gets the .ext
+static const char *resolve_name(DaemonClient *c, char **name, char **extn)
+{
+    if (*name == NULL)
+        return NULL;
+    if (is_stdio_name(*name))
+        return "stdin and stdout are the daemon's, pass pipes as descriptors";
+    if ((*name)[0] != '@')
+        return NULL;
+
+    char *end;
+    long idx = strtol(*name + 1, &end, 10);
+    if (end == *name + 1 || (*end != '\0' && *end != '.') || idx < 0 || idx >= c->passed_count)
+        return "no such descriptor was passed with the request";
+    if (extn != NULL)
+        *extn = *end == '.' ? end : NULL;   // a descriptor has no name to take the stored extension from
+    *name = c->fd_names[idx];
+    return NULL;
+}
+
+// parse the file names and options of a job into the client's slot, returns NULL or why it is malformed
+static const char *parse_request(Daemon *d, DaemonClient *c, int argc, char *argv[])
+{
+    const char *why = NULL;
+
+    for (int i = 2; i < argc; i++)
+    {
+        if (strcmp(argv[i], "--pass-file") == 0)   // its key lands in one static buffer
+            return "--pass-file is read once per process, start stegod with it or use --pass";
+    }
+
+    c->opts = *d->opts;
+    c->opts.add_files = NULL;   // --add grows a list of the request's own
+    c->opts.add_count = 0;
+    if (parse_options(&argc, argv, &c->opts) == e_failure)
+    {
+        free_options(&c->opts);
+        return "invalid options";
+    }
+    c->opts.block_size = d->opts->block_size;   // the worker buffers were sized once
+    c->opts.uring = d->opts->uring;
+
+    if ((why = batch_parse_job(argv + 1, argc - 1, &c->spec)) == NULL &&
+        (why = resolve_name(c, &c->spec.image, NULL)) == NULL &&
+        (why = resolve_name(c, &c->spec.secret, &c->spec.secret_extn)) == NULL)
+        why = resolve_name(c, &c->spec.output, NULL);
+    return why;
+}
+
+// parse one request line; jobs go to the pool, the rest is answered here.
+// Returns 1 when a job was queued and the client is busy
+static int dispatch(Daemon *d, DaemonClient *c, char *line)
+{
+    char *argv[DAEMON_MAX_TOKENS + 2], *save;
+    int argc = 1;
+
+    argv[0] = "stegod";
+    for (char *t = strtok_r(line, " \t\r", &save); t != NULL; t = strtok_r(NULL, " \t\r", &save))
+    {
+        if (argc == DAEMON_MAX_TOKENS + 1)
+        {
+            reply(c->fd, "error more than %d words in the request", DAEMON_MAX_TOKENS);
+            return 0;
+        }
+        argv[argc++] = t;
+    }
+    argv[argc] = NULL;
+
+    if (argc == 1)   // blank line
+        return 0;
+    if (strcmp(argv[1], "stats") == 0)
+    {
+        reply_stats(d, c->fd);
+        return 0;
+    }
+    if (strcmp(argv[1], "shutdown") == 0)
+    {
+        reply(c->fd, "ok shutting down");
+        d->stop = 1;
+        return 0;
+    }
+
+    const char *why = parse_request(d, c, argc, argv);
+    if (why != NULL)
+    {
+        reply(c->fd, "error %s", why);
+        free_options(&c->opts);
+        return 0;
+    }
+    c->start = stats_now_ms();
+
+    pthread_mutex_lock(&d->lock);
+    d->queued++;
+    pthread_mutex_unlock(&d->lock);
+    c->busy = 1;
+    c->replied = 0;
+    if (pool_submit(&d->pool, run_request, c) == e_failure)
+    {
+        pthread_mutex_lock(&d->lock);
+        d->queued--;
+        pthread_mutex_unlock(&d->lock);
+        c->busy = 0;
+        reply(c->fd, "error unable to queue the request");
+        free_options(&c->opts);
+        return 0;
+    }
+    return 1;
+}
+
+static void close_passed(DaemonClient *c)
+{
+    for (int i = 0; i < c->passed_count; i++)
+        close(c->passed[i]);
+    c->passed_count = 0;
+}
+
+static void drop_client(Daemon *d, DaemonClient *c)
+{
+    close_passed(c);
+    close(c->fd);
+    c->fd = -1;
+    c->len = 0;
+    d->client_count--;
+}
+
+// run every whole request buffered for an idle client, up to the first that needs a worker
+static void serve_buffered(Daemon *d, DaemonClient *c)
+{
+    while (!c->busy && c->fd >= 0 && !d->stop)
+    {
+        char *nl = memchr(c->buf, '\n', c->len);
+        if (nl == NULL)
+        {
+            if (c->len == MAX_MANIFEST_LINE)
+            {
+                reply(c->fd, "error request longer than %d bytes", MAX_MANIFEST_LINE);
+                drop_client(d, c);
+            }
+            return;
+        }
+
+        *nl = '\0';
+        c->used = nl + 1 - c->buf;
+        if (dispatch(d, c, c->buf))
+            return;   // the buffer stays put until the worker is done with it
+
+        close_passed(c);   // descriptors belong to the request they came with
+        c->len -= c->used;
+        memmove(c->buf, c->buf + c->used, c->len);
+    }
+}
+
+// a worker replied: release the request's slot and go on with what the client sent since
+static void finish_request(Daemon *d, DaemonClient *c)
+{
+    close_passed(c);
+    free_options(&c->opts);
+    c->busy = 0;
+    c->len -= c->used;
+    memmove(c->buf, c->buf + c->used, c->len);
+    serve_buffered(d, c);
+}
+
+// read what the client sent, with any descriptors passed along
+static void read_client(Daemon *d, DaemonClient *c)
+{
+    char control[CMSG_SPACE(DAEMON_MAX_FDS * sizeof(int))];
+    struct iovec iov = { c->buf + c->len, MAX_MANIFEST_LINE - c->len };
+    struct msghdr msg = {0};
+
+    msg.msg_iov = &iov;
+    msg.msg_iovlen = 1;
+    msg.msg_control = control;
+    msg.msg_controllen = sizeof(control);
+
+    ssize_t n = recvmsg(c->fd, &msg, MSG_CMSG_CLOEXEC);
+    if (n < 0 && errno == EINTR)
+        return;
+
+    for (struct cmsghdr *cm = CMSG_FIRSTHDR(&msg); cm != NULL; cm = CMSG_NXTHDR(&msg, cm))
+    {
+        if (cm->cmsg_level != SOL_SOCKET || cm->cmsg_type != SCM_RIGHTS)
+            continue;
+        int count = (cm->cmsg_len - CMSG_LEN(0)) / sizeof(int);
+        for (int i = 0; i < count; i++)
+        {
+            int fd;
+            memcpy(&fd, CMSG_DATA(cm) + i * sizeof(int), sizeof(int));
+            if (c->passed_count == DAEMON_MAX_FDS)
+            {
+                close(fd);
+                continue;
+            }
+            snprintf(c->fd_names[c->passed_count], DAEMON_FD_NAME, "/proc/self/fd/%d", fd);   // the jobs open files by name
+            c->passed[c->passed_count++] = fd;
+        }
+    }
+
+    if (n <= 0)   // hung up
+    {
+        drop_client(d, c);
+        return;
+    }
+    c->len += n;
+    serve_buffered(d, c);
+}
+
+static void accept_client(Daemon *d)
+{
+    int fd = accept4(d->listen_fd, NULL, NULL, SOCK_CLOEXEC);
+    if (fd < 0)
+        return;
+
+    for (int i = 0; i < DAEMON_MAX_CLIENTS; i++)
+    {
+        DaemonClient *c = &d->clients[i];
+        if (c->fd < 0 && !c->busy)
+        {
+            c->fd = fd;
+            c->len = 0;
+            c->passed_count = 0;
+            d->client_count++;
+            return;
+        }
+    }
+    reply(fd, "error more than %d clients", DAEMON_MAX_CLIENTS);
+    close(fd);
+}
+
+// bind the socket, taking over a stale one left by a daemon that died
+static int open_socket(const char *path)
+{
+    struct sockaddr_un addr = {0};
+    struct stat st;
+
+    if (strlen(path) >= sizeof(addr.sun_path))
+    {
+        printf("Error: socket path %s is too long\n", path);
+        return -1;
+    }
+    addr.sun_family = AF_UNIX;
+    strcpy(addr.sun_path, path);
+
+    int fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    if (fd < 0)
+        return -1;
+
+    if (lstat(path, &st) == 0)
+    {
+        if (!S_ISSOCK(st.st_mode) || connect(fd, (struct sockaddr *)&addr, sizeof(addr)) == 0)
+        {
+            printf("Error: %s is in use\n", path);
+            close(fd);
+            return -1;
+        }
+        unlink(path);   // nobody is listening on it
+        close(fd);
+        fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    }
+
+    // owner-only from the moment it exists: a chmod after bind leaves a window to connect in;
+    // the workers are not started yet, so nothing else creates files under this umask
+    mode_t mask = umask(S_IXUSR | S_IRWXG | S_IRWXO);
+    int bound = fd >= 0 && bind(fd, (struct sockaddr *)&addr, sizeof(addr)) == 0;
+    umask(mask);
+
+    if (!bound || listen(fd, SOMAXCONN) < 0)
+    {
+        printf("Error: unable to listen on %s\n", path);
+        if (fd >= 0)
+            close(fd);
+        return -1;
+    }
+    return fd;
+}
+
+// worker buffers, io_uring and client slots, all allocated once for the daemon's life
+static Status setup_daemon(Daemon *d, const char *path, const StegoOptions *opts)
+{
+    d->path = path;
+    d->opts = opts;
+    int workers = opts->threads > 0 ? opts->threads : (int)sysconf(_SC_NPROCESSORS_ONLN);
+    if (workers < 1)
+        workers = 1;
+    pthread_mutex_init(&d->lock, NULL);
+
+    d->clients = calloc(DAEMON_MAX_CLIENTS, sizeof(DaemonClient));
+    if (d->clients == NULL || batch_setup_workers(&d->workers, workers, opts) == e_failure)   // same as batch mode
+        return e_failure;
+    for (int i = 0; i < DAEMON_MAX_CLIENTS; i++)
+    {
+        d->clients[i].daemon = d;
+        d->clients[i].fd = -1;
+    }
+
+    d->wake_fd = eventfd(0, EFD_CLOEXEC | EFD_NONBLOCK);
+    d->listen_fd = open_socket(path);
+    if (d->wake_fd < 0 || d->listen_fd < 0)
+        return e_failure;
+    return pool_init(&d->pool, d->workers.count);
+}
+
+static void free_daemon(Daemon *d)
+{
+    for (int i = 0; d->clients != NULL && i < DAEMON_MAX_CLIENTS; i++)
+    {
+        if (d->clients[i].fd >= 0)
+            drop_client(d, &d->clients[i]);
+    }
+    if (d->listen_fd >= 0)
+    {
+        close(d->listen_fd);
+        unlink(d->path);
+    }
+    if (d->wake_fd >= 0)
+        close(d->wake_fd);
+    batch_free_workers(&d->workers);
+    free(d->clients);
+    pthread_mutex_destroy(&d->lock);
+}
+
+// take the replies workers have finished
+static void reap_replies(Daemon *d)
+{
+    uint64_t count;
+
+    if (read(d->wake_fd, &count, sizeof(count)) < 0)   // nothing new, a stale wake-up
+        return;
+    for (int i = 0; i < DAEMON_MAX_CLIENTS; i++)
+    {
+        DaemonClient *c = &d->clients[i];
+        pthread_mutex_lock(&d->lock);
+        int replied = c->busy && c->replied;
+        pthread_mutex_unlock(&d->lock);
+        if (replied)
+            finish_request(d, c);
+    }
+}
+
+Status do_daemon(const char *socket_path, const StegoOptions *opts)
+{
+    static Daemon d;   // the latency rings are too large for the stack
+    struct pollfd fds[2 + DAEMON_MAX_CLIENTS];
+    struct sigaction sa = {0};
+
+    d.listen_fd = d.wake_fd = -1;
+    if (setup_daemon(&d, socket_path, opts) == e_failure)
+    {
+        printf("Error: unable to start stegod on %s\n", socket_path);
+        free_daemon(&d);
+        return e_failure;
+    }
+
+    sa.sa_handler = on_signal;   // no SA_RESTART: poll returns and the loop sees the flag
+    sigaction(SIGINT, &sa, NULL);
+    sigaction(SIGTERM, &sa, NULL);
+    signal(SIGPIPE, SIG_IGN);    // a client closing a passed pipe fails its job, not the daemon
+    printf("stegod listening on %s with %d workers\n", socket_path, d.workers.count);
+    fflush(stdout);
+
+    while (!d.stop && !daemon_signalled)
+    {
+        fds[0] = (struct pollfd){ d.listen_fd, POLLIN, 0 };
+        fds[1] = (struct pollfd){ d.wake_fd, POLLIN, 0 };
+        for (int i = 0; i < DAEMON_MAX_CLIENTS; i++)   // busy clients are not read until they reply
+        {
+            DaemonClient *c = &d.clients[i];
+            fds[2 + i] = (struct pollfd){ c->fd >= 0 && !c->busy ? c->fd : -1, POLLIN, 0 };
+        }
+
+        if (poll(fds, 2 + DAEMON_MAX_CLIENTS, -1) < 0)
+        {
+            if (errno == EINTR)
+                continue;
+            break;
+        }
+
+        if (fds[1].revents & POLLIN)
+            reap_replies(&d);
+        if (fds[0].revents & POLLIN)
+            accept_client(&d);
+        for (int i = 0; i < DAEMON_MAX_CLIENTS; i++)
+        {
+            if (fds[2 + i].revents && d.clients[i].fd == fds[2 + i].fd && !d.clients[i].busy)
+                read_client(&d, &d.clients[i]);
+        }
+    }
+
+    pool_wait(&d.pool);   // requests already queued still get their reply
+    pool_destroy(&d.pool);
+    for (int i = 0; i < DAEMON_MAX_CLIENTS; i++)
+    {
+        if (d.clients[i].busy)
+        {
+            close_passed(&d.clients[i]);
+            free_options(&d.clients[i].opts);
+            d.clients[i].busy = 0;
+        }
+    }
+    printf("stegod stopped: %lu requests, %lu failed\n", d.done, d.failed);
+    free_daemon(&d);
+    return e_success;
+}
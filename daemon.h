@@ -0,0 +1,45 @@
+#ifndef DAEMON_H
+#define DAEMON_H
+
+#include "types.h"    // Contains user-defined types
+#include "options.h"  // Contains command-line options
+
+/*
+ * stegod: a long-running daemon that takes encode / decode requests
+ * over a Unix domain socket, so local services skip process start-up
+ * and the prompts. Requests run on the work-stealing pool like batch
+ * jobs; every worker keeps one block buffer (and io_uring with
+ * --uring) for its whole life, and every client gets a fixed
+ * request slot, so nothing is allocated to dispatch a request.
+ *
+ * One request per line, in the batch manifest syntax plus any
+ * per-job options (-z, --bits, --channels, --key, --pass, ...):
+ *     -e <cover> <secret.ext> <output> <magic> [options]
+ *     -d <stego> <output> <magic> [options]
+ *     stats
+ *     shutdown
+ * answered with one line each:
+ *     ok <ms> | failed <ms> | error <why> | {stats as JSON}
+ * where ms is the latency from the request arriving to its reply.
+ * Descriptors sent with a request (SCM_RIGHTS) are named @0, @1, ...
+ * in the order they were passed, e.g. "-e @0 @1.txt @2 magic" encodes
+ * from and into files or pipes the client opened (a passed secret
+ * carries the extension stored with it); they are closed once the
+ * request has replied. A client has one request running at
+ * a time and may queue the next ones behind it; clients are served
+ * side by side. stats reports the queue depth, running requests and
+ * latency percentiles over the last DAEMON_LATENCY_SAMPLES requests.
+ *
+ * The socket is created owner-only: anyone who can connect can read
+ * and write files as the daemon's user.
+ */
+
+#define DAEMON_MAX_CLIENTS 256          // connections served at once
+#define DAEMON_MAX_FDS 4                // descriptors passed with one request
+#define DAEMON_MAX_TOKENS 32            // words of one request, options included
+#define DAEMON_LATENCY_SAMPLES 4096     // latencies the percentiles are taken over
+
+/* Serve requests on the Unix socket at socket_path until a shutdown request or SIGINT / SIGTERM */
+Status do_daemon(const char *socket_path, const StegoOptions *opts);
+
+#endif
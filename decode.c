@@ -1,245 +1,732 @@
 #include <stdio.h>       // for input/output functions
+#include <stdlib.h>      // for malloc/free
 #include <string.h>      // for string handling functions
+#include <limits.h>      // for LONG_MAX
+#include <unistd.h>      // for ftruncate
+#include <sys/mman.h>    // for mmap/munmap
 #include "decode.h"      // for decode function declarations
 #include "types.h"       // for enum and structure definitions
+#include "lsb.h"         // for the bit layouts
+#include "parallel.h"    // for multithreaded extraction
+#include "stego.h"       // for the in-memory library
+#include "range.h"       // for --range and packed payloads
+#include "container.h"   // for --list and --entry
+#include "crc32c.h"      // for checking a container entry
 
-// Read and validate command-line arguments for decoding
-Status read_and_validate_decode_args(char *argv[], DecodeInfo *decInfo)
+// A piped stego image is read in one forward pass: no mapping, no threads and no prompt on stdin
+static Status check_stdio_args(DecodeInfo *decInfo)
 {
-    if(strstr(argv[2], ".bmp") != NULL)   // check if stego file is a .bmp image
+    int in_stego = is_stdio_name(decInfo->stego_image_fname);
+
+    if(!in_stego && !is_stdio_name(decInfo->output_fname))
+        return e_success;
+    if(in_stego && decInfo->opts.magic == NULL)
     {
-        printf(".bmp file is present\n");
-        decInfo->stego_image_fname = argv[2];   // store stego image file name
+        print_error("reading from stdin needs the magic string as -m <magic>\n");
+        return e_failure;
     }
-    else
+    if(in_stego && decInfo->opts.key != NULL)
     {
-        printf(".bmp file is not present\n");
+        print_error("--key jumps around the image and needs a file, not a pipe\n");
         return e_failure;
     }
 
+    decInfo->opts.use_mmap = 0;
+    decInfo->opts.threads = 1;
+    return e_success;
+}
+
+// Read and validate command-line arguments for decoding
+Status read_and_validate_decode_args(char *argv[], DecodeInfo *decInfo)
+{
+    decInfo->stego_image_fname = argv[2];   // store stego image file name, its format is told by its header
+    print_status(&decInfo->opts, "Stego image is %s\n", argv[2]);
+
     if(argv[3] != NULL)   // if user provided output filename
     {
         decInfo->output_fname = argv[3];   // store output file name
-        printf("Output file name is provided: %s\n", decInfo->output_fname);
+        print_status(&decInfo->opts, "Output file name is provided: %s\n", decInfo->output_fname);
     }
     else
     {
         decInfo->output_fname = "decoded.txt";   // default output filename
-        printf("Default output file name: decoded.txt\n");
+        print_status(&decInfo->opts, "Default output file name: decoded.txt\n");
     }
+    return check_stdio_args(decInfo);
+}
+
+// Take the magic string from the options or ask the user for it
+static Status get_magic_string(DecodeInfo *decInfo)
+{
+    if(decInfo->opts.magic != NULL)   // magic given with --magic or a batch manifest, no prompt
+    {
+        if(strlen(decInfo->opts.magic) > STEGO_MAX_MAGIC)
+        {
+            print_status(&decInfo->opts, "Magic string is too long\n");
+            return e_failure;
+        }
+        strcpy(decInfo->magic_string, decInfo->opts.magic);
+    }
+    else
+    {
+        printf("Enter the magic string used during encoding: ");
+        scanf("%99s", decInfo->magic_string);  // take magic string from user
+    }
+    decInfo->magic_len = strlen(decInfo->magic_string);
     return e_success;
 }
 
-// Perform the full decoding process
-Status do_decoding(DecodeInfo *decInfo)
+// Run every decoding stage in order
+static Status decode_stages(DecodeInfo *decInfo)
 {
-    if(open_decode_files(decInfo) == e_success)    // open required files
+    if(stats_stage(&decInfo->stats, e_stage_open, open_decode_files(decInfo)) == e_success)    // open required files
     {
-        printf("All decode files opened successfully\n");
+        print_status(&decInfo->opts, "All decode files opened successfully\n");
     }
     else
     {
-        printf("Error in opening files\n");
+        print_status(&decInfo->opts, "Error in opening files\n");
         return e_failure;
     }
 
-    if(skip_bmp_header(decInfo->fptr_stego_image) == e_success)  // skip 54-byte BMP header
+    Status header = cover_read(decInfo->fptr_stego_image, &decInfo->bmp);   // format, pixel offset and row layout
+    if(header == e_success && decInfo->opts.use_mmap)
+        header = block_map(&decInfo->block, decInfo->bmp.pixel_offset);   // map the stego image, pixel data starts after the header
+    else if(header == e_success)
+        header = skip_bmp_header(decInfo->fptr_stego_image, &decInfo->bmp);  // skip the image header
+    block_stream_at(&decInfo->block, decInfo->bmp.pixel_offset);   // a piped image is at its pixels now
+    bmp_rows(&decInfo->bmp, &decInfo->block.rows);   // extract row by row, skipping the padding
+
+    if(stats_stage(&decInfo->stats, e_stage_header, header) == e_success)
     {
-        printf("Skipped BMP header bytes successfully\n");
+        print_status(&decInfo->opts, "Skipped %s header bytes successfully\n", cover_format_name(decInfo->bmp.format));
     }
     else
     {
-        printf("Failed to skip BMP header\n");
+        print_status(&decInfo->opts, "Failed to skip BMP header\n");
         return e_failure;
     }
 
-    char magic_string[20];
-    printf("Enter the magic string used during encoding: ");
-    scanf("%s", magic_string);  // take magic string from user
+    if(get_magic_string(decInfo) == e_failure)   // from --magic or the user
+        return e_failure;
 
-    if (decode_magic_string(magic_string, decInfo) == e_success)  // decode & check magic string
+    if (stats_stage(&decInfo->stats, e_stage_magic, decode_magic_string(decInfo->magic_string, decInfo)) == e_success)  // decode & check magic string
     {
-       printf("Magic string decoded successfully\n");
+       print_status(&decInfo->opts, "Magic string decoded successfully\n");
     }
     else
     {
-       printf("Magic string decoding failed\n");
+       print_status(&decInfo->opts, "Magic string decoding failed\n");
        return e_failure;
     }
 
-    if(decode_secret_file_extn_size(decInfo) == e_success)  // decode extension size
+    if(stats_stage(&decInfo->stats, e_stage_extension, decode_secret_file_extn_size(decInfo)) == e_success)  // decode extension size
     {
-        printf("Secret file extension size decoded successfully\n");
+        print_status(&decInfo->opts, "Secret file extension size decoded successfully\n");
     }
     else
     {
-        printf("Secret file extension size decoding failed\n");
+        print_status(&decInfo->opts, "Secret file extension size decoding failed\n");
         return e_failure;
     }
 
-    if(decode_secret_file_extn(decInfo) == e_success)  // decode extension characters
+    if(stats_stage(&decInfo->stats, e_stage_extension, decode_secret_file_extn(decInfo)) == e_success)  // decode extension characters
     {
-        printf("Secret file extension decoded successfully\n");
+        print_status(&decInfo->opts, "Secret file extension decoded successfully\n");
     }
     else
     {
-        printf("Secret file extension decoding failed\n");
+        print_status(&decInfo->opts, "Secret file extension decoding failed\n");
         return e_failure;
     }
 
-    if(decode_secret_file_size(decInfo) == e_success)  // decode secret file size
+    if(stats_stage(&decInfo->stats, e_stage_size, decode_secret_file_size(decInfo)) == e_success)  // decode secret file size
     {
-        printf("Secret file size decoded successfully\n");
+        print_status(&decInfo->opts, "Secret file size decoded successfully\n");
     }
     else
     {
-        printf("Secret file size decoding failed\n");
+        print_status(&decInfo->opts, "Secret file size decoding failed\n");
         return e_failure;
     }
 
-    if(decode_secret_file_data(decInfo) == e_success)  // decode secret file data
+    if(stats_stage(&decInfo->stats, e_stage_data, decode_secret_file_data(decInfo)) == e_success)  // decode secret file data
     {
-        printf("Secret file data decoded successfully\n");
+        print_status(&decInfo->opts, "Secret file data decoded successfully\n");
     }
     else
     {
-        printf("Secret file data decoding failed\n");
+        print_status(&decInfo->opts, "Secret file data decoding failed\n");
         return e_failure;
     }
 
-    fclose(decInfo->fptr_stego_image);   // close stego image file
-    fclose(decInfo->fptr_output);        // close output file
-
-    printf("Decoding completed successfully! Output written to %s\n", decInfo->output_fname);
+    if(!decInfo->opts.list)
+        print_status(&decInfo->opts, "Decoding completed successfully! Output written to %s\n", decInfo->output_fname);
 
     return e_success;
 }
 
-// Open stego image and output file
-Status open_decode_files(DecodeInfo *decInfo)
+// --list and --entry only make sense on a container
+static Status check_container_args(DecodeInfo *decInfo, int flags)
 {
-    decInfo->fptr_stego_image = fopen(decInfo->stego_image_fname, "r");  // open stego image
-    if(decInfo->fptr_stego_image == NULL)
+    if(!(flags & STEGO_FLAG_CONTAINER) && (decInfo->opts.list || decInfo->opts.entry != NULL))
     {
-        printf("Error: Stego image file not found\n");
+        print_error("%s holds a single secret, --list and --entry need a container made with --add\n", decInfo->stego_image_fname);
         return e_failure;
     }
+    return e_success;
+}
 
-    decInfo->fptr_output = fopen(decInfo->output_fname, "w");  // open output file
-    if(decInfo->fptr_output == NULL)
+// Entry named by --entry, printing why there is none
+static const ContainerEntry *pick_entry(DecodeInfo *decInfo, const ContainerDir *dir)
+{
+    const ContainerEntry *entry = NULL;
+
+    if(decInfo->opts.entry == NULL)
+        print_error("%s holds a container of %zu files, pick one with --entry <name> (--list shows them)\n",
+               decInfo->stego_image_fname, dir->count);
+    else if((entry = container_find(dir, decInfo->opts.entry)) == NULL)
+        print_error("the container has no file named %s\n", decInfo->opts.entry);
+    return entry;
+}
+
+// A decoded entry must be whole and match the CRC32C in the directory
+static Status check_entry(const ContainerEntry *entry, size_t written, uint32_t crc)
+{
+    if(written != entry->size || crc != entry->crc)
     {
-        printf("Error: Unable to create output file\n");
-        fclose(decInfo->fptr_stego_image);
+        print_error("%s does not match its CRC32C, the stego image is corrupt or truncated\n", entry->name);
         return e_failure;
     }
-
     return e_success;
 }
 
-// Skip the 54-byte BMP header
-Status skip_bmp_header(FILE *fptr_stego_image)
+typedef struct _MappedSource
 {
-    fseek(fptr_stego_image, 54, SEEK_SET);   // move file pointer to pixel data
-    return e_success;
+    const uint8_t *stego;       // mapped stego image
+    size_t len;
+    const StegoParams *params;
+
+} MappedSource;
+
+// container_read_dir on a mapped image: a range decode through libstego
+static Status read_mapped_range(void *ctx, size_t off, size_t len, uint8_t *out)
+{
+    MappedSource *src = ctx;
+    StegoInfo info;
+    size_t n;
+
+    if(stego_decode_range(src->stego, src->len, src->params, off, len, out, &n, &info) == e_failure)
+        return e_failure;
+    return n == len ? e_success : e_failure;
 }
 
-// Decode 1 byte from 8 LSBs
-Status decode_byte_from_lsb(char *data, unsigned char *image_buffer)
+// Key for the stored salt from --pass / --pass-file; the engine decrypts the data section with it
+static Status setup_cipher(DecodeInfo *decInfo, const uint8_t *salt)
 {
-    unsigned char ch = 0;
-    for(int i = 0; i < 8; i++)
+    if(decInfo->opts.pass == NULL)
     {
-        ch = ch | ((image_buffer[i] & 1) << i);   // extract each bit
+        print_error("the secret data is encrypted, give its passphrase with --pass or --pass-file\n");
+        return e_failure;
     }
-    *data = ch;   // store decoded byte
+    cipher_derive(&decInfo->cipher, decInfo->opts.pass, decInfo->opts.pass_len, salt, decInfo->opts.pass_rounds);
+    decInfo->block.cipher = &decInfo->cipher;
     return e_success;
 }
 
-// Decode a 32-bit number from LSBs
-Status decode_size_from_lsb(long int *size, unsigned char *image_buffer)
+// Memory mapped decoding: libstego extracts straight from the stego mapping into a mapping of the output
+static Status decode_with_library(DecodeInfo *decInfo)
 {
-    *size = 0;
-    for(int i = 0; i < 32; i++)
+    StegoInfo info;
+
+    if(stats_stage(&decInfo->stats, e_stage_open, open_decode_files(decInfo)) == e_failure ||
+       stats_stage(&decInfo->stats, e_stage_header, block_map(&decInfo->block, 0)) == e_failure ||
+       get_magic_string(decInfo) == e_failure)
     {
-        *size = *size | ((image_buffer[i] & 1) << i);   // extract 32 bits
+        print_status(&decInfo->opts, "Files are not ready for decoding\n");
+        return e_failure;
     }
-    return e_success;
+
+    StegoParams params = { decInfo->magic_string, NULL, 0, 0, 0, decInfo->opts.key, NULL };   // layout and flags are read from the payload
+    if(stats_stage(&decInfo->stats, e_stage_magic, stego_peek(decInfo->block.map_src, decInfo->block.len, &params, &info)) == e_failure)
+    {
+        print_status(&decInfo->opts, "Magic string is not matched\n");
+        return e_failure;
+    }
+    if((info.flags & STEGO_FLAG_SCATTER) && decInfo->opts.key == NULL)
+    {
+        print_error("the secret data is scattered, give its key with --key\n");
+        return e_failure;
+    }
+    if(info.flags & STEGO_FLAG_CIPHER)   // key from the stored salt, then the packed header can be read too
+    {
+        if(setup_cipher(decInfo, info.salt) == e_failure)
+            return e_failure;
+        params.cipher = &decInfo->cipher;
+        if(stego_peek(decInfo->block.map_src, decInfo->block.len, &params, &info) == e_failure)
+        {
+            print_error("the secret data does not decrypt, the passphrase is wrong or the stego image is corrupt\n");
+            return e_failure;
+        }
+    }
+    if(info.flags & STEGO_FLAG_SHARD)
+    {
+        print_error("%s holds one shard of a split secret, decode the whole set with shard -d\n", decInfo->stego_image_fname);
+        return e_failure;
+    }
+    if(check_container_args(decInfo, info.flags) == e_failure)
+        return e_failure;
+    strcpy(decInfo->extn_secret_file, info.extension);
+    decInfo->extn_size = strlen(info.extension);
+    decInfo->size_secret_file = info.payload_size;
+
+    size_t off = 0, len = info.payload_size;
+    ContainerDir dir = { NULL, 0 };
+    const ContainerEntry *entry = NULL;
+    if(info.flags & STEGO_FLAG_CONTAINER)   // directory first, then only the entry asked for
+    {
+        MappedSource src = { decInfo->block.map_src, decInfo->block.len, &params };
+        if(container_read_dir(read_mapped_range, &src, &dir) == e_failure)
+            return e_failure;
+        if(decInfo->opts.list)
+        {
+            container_list(&dir);
+            container_free(&dir);
+            return e_success;
+        }
+        if((entry = pick_entry(decInfo, &dir)) == NULL)
+        {
+            container_free(&dir);
+            return e_failure;
+        }
+        off = entry->offset;
+        len = entry->size;
+    }
+    else if(decInfo->opts.has_range)   // only part of the payload
+    {
+        off = decInfo->opts.range_off;
+        if(off > info.payload_size)
+        {
+            print_error("range starts past the end of the %zu byte payload\n", info.payload_size);
+            return e_failure;
+        }
+        len = decInfo->opts.range_len < info.payload_size - off ? decInfo->opts.range_len : info.payload_size - off;
+    }
+
+    Status status = e_success;
+    if(len > 0)
+    {
+        int fd = fileno(decInfo->fptr_output);
+        char *out = MAP_FAILED;
+        if(ftruncate(fd, len) == 0)   // size the output file up front
+            out = mmap(NULL, len, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+        if(out == MAP_FAILED)
+        {
+            print_error("unable to map output file\n");
+            container_free(&dir);
+            return e_failure;
+        }
+
+        if(decInfo->opts.has_range || entry != NULL)
+            status = stego_decode_range(decInfo->block.map_src, decInfo->block.len, &params,
+                                        off, len, (uint8_t *)out, &len, &info);
+        else
+            status = stego_decode(decInfo->block.map_src, decInfo->block.len, &params,
+                                  (uint8_t *)out, info.payload_size, &info);
+        if(status == e_success && entry != NULL && check_entry(entry, len, crc32c(0, out, len)) == e_failure)
+        {
+            container_free(&dir);
+            munmap(out, len);
+            return e_failure;
+        }
+        munmap(out, len);
+    }
+    container_free(&dir);
+    stats_stage(&decInfo->stats, e_stage_data, status);
+
+    if(status == e_failure)
+        print_error("the secret data could not be decoded, %s\n", info.flags & STEGO_FLAG_CIPHER ? "the passphrase is wrong or the stego image is corrupt"
+                                                                                                   : "the stego image is corrupt or truncated");
+    else
+        print_status(&decInfo->opts, "Decoding completed successfully! Output written to %s\n", decInfo->output_fname);
+    return status;
 }
 
-// Decode and verify magic string
-Status decode_magic_string(const char *magic_string, DecodeInfo *decInfo)
+// Close whatever open_decode_files managed to open
+static void close_decode_files(DecodeInfo *decInfo)
 {
-    unsigned char image_buffer[8];
-    char buffer[50];
-    int len = strlen(magic_string);
+    block_free(&decInfo->block);             // release pixel block
+    if(decInfo->fptr_stego_image != NULL)
+        fclose(decInfo->fptr_stego_image);   // close stego image file
+    if(decInfo->fptr_output != NULL)
+        fclose(decInfo->fptr_output);        // close output file
+
+    decInfo->fptr_stego_image = NULL;
+    decInfo->fptr_output = NULL;
+}
 
-    for (int i = 0; i < len; i++)    // decode each character
+// Perform the full decoding process
+Status do_decoding(DecodeInfo *decInfo)
+{
+    Status status;
+
+    stats_start(&decInfo->stats, decInfo->opts.stats);
+    if(decInfo->opts.use_mmap && decInfo->opts.threads <= 1)
+        status = decode_with_library(decInfo);   // zero-copy path is a thin wrapper over libstego
+    else
+        status = decode_stages(decInfo);         // streaming (or multithreaded) stage by stage
+
+    close_decode_files(decInfo);   // files are closed on failure too, batch jobs must not leak them
+    stats_stage(&decInfo->stats, e_stage_close, status);   // closing flushes the decoded file
+    stats_report(&decInfo->stats, "decode", decInfo->stego_image_fname, status);
+    return status;
+}
+
+// Open stego image and output file
+Status open_decode_files(DecodeInfo *decInfo)
+{
+    if(is_stdio_name(decInfo->stego_image_fname))
+        decInfo->fptr_stego_image = stdin;   // stego image piped in
+    else
+        decInfo->fptr_stego_image = fopen(decInfo->stego_image_fname, "r");  // open stego image
+    if(decInfo->fptr_stego_image == NULL)
+    {
+        print_error("Stego image file not found\n");
+        return e_failure;
+    }
+
+    if(decInfo->opts.list)
+        decInfo->fptr_output = NULL;                // only the directory is printed, no output file
+    else if(is_stdio_name(decInfo->output_fname))
+        decInfo->fptr_output = stdout_for_data();   // payload piped out, messages move to stderr
+    else
+        decInfo->fptr_output = fopen(decInfo->output_fname, decInfo->opts.use_mmap ? "w+" : "w");  // open output file, mapping needs read access
+    if(decInfo->fptr_output == NULL && !decInfo->opts.list)
     {
-        fread(image_buffer, 1, 8, decInfo->fptr_stego_image);
-        decode_byte_from_lsb(&buffer[i], image_buffer);
+        print_error("Unable to create output file\n");
+        fclose(decInfo->fptr_stego_image);
+        decInfo->fptr_stego_image = NULL;
+        return e_failure;
     }
 
+    return block_init(&decInfo->block, decInfo->fptr_stego_image, NULL, decInfo->opts.block_size);  // pixel block for extraction
+}
+
+// Skip the image header up to the pixel array
+Status skip_bmp_header(FILE *fptr_stego_image, const BmpInfo *bmp)
+{
+    if(fseek(fptr_stego_image, bmp->pixel_offset, SEEK_SET) == 0)   // move file pointer to pixel data
+        return e_success;
+
+    // a pipe cannot seek: cover_read left it right after the header_len bytes it parsed
+    for(uint left = bmp->pixel_offset - bmp->header_len; left > 0; left--)
+        if(fgetc(fptr_stego_image) == EOF)
+            return e_failure;
+    return e_success;
+}
+
+// Read the magic string and its terminator, returns 1 on a full match
+static int match_magic_string(const char *magic_string, DecodeInfo *decInfo)
+{
+    char buffer[STEGO_MAX_MAGIC + 1];
+    int len = strlen(magic_string);
+
+    if (block_extract(&decInfo->block, buffer, len) == e_failure)    // decode each character
+        return 0;
+
     buffer[len] = '\0';   // terminate decoded string
 
-    unsigned char next_buffer[8];   // decode next character to confirm ending
-    char next_char;
-    fread(next_buffer, 1, 8, decInfo->fptr_stego_image);
-    decode_byte_from_lsb(&next_char, next_buffer);
+    char next_char;   // decode next character to confirm ending
+    if (block_extract(&decInfo->block, &next_char, 1) == e_failure)
+        return 0;
+
+    return (strcmp(buffer, magic_string) == 0) && (next_char == '\0');
+}
+
+// Decode and verify magic string
+Status decode_magic_string(const char *magic_string, DecodeInfo *decInfo)
+{
+    if (strlen(magic_string) > STEGO_MAX_MAGIC)
+        return e_failure;
+
+    int matched = match_magic_string(magic_string, decInfo);
+
+    // payloads written before row parsing ran over the padding of a BMP from byte 54 on
+    if (!matched && decInfo->bmp.format == e_cover_bmp &&
+        (decInfo->bmp.pixel_offset != 54 || decInfo->bmp.stride != decInfo->bmp.row_bytes) &&
+        !decInfo->block.stream && block_seek(&decInfo->block, 54) == e_success)
+    {
+        bmp_rows_flat(&decInfo->block.rows, 54);
+        matched = match_magic_string(magic_string, decInfo);
+    }
 
-    if ((strcmp(buffer, magic_string) == 0) && (next_char == '\0'))  // full match
+    if (matched)  // full match
     {
-        printf("Magic string fully matched\n");
+        print_status(&decInfo->opts, "Magic string fully matched\n");
         return e_success;
     }
     else
     {
-        printf("Magic string is not matched\n");
+        print_status(&decInfo->opts, "Magic string is not matched\n");
         return e_failure;
     }
 }
 
-// Decode extension size (32 bits)
+// Decode extension size (32 bits), or the format word of a k-LSB payload
 Status decode_secret_file_extn_size(DecodeInfo *decInfo)
 {
-    unsigned char image_buffer[32];
-    fread(image_buffer, 1, 32, decInfo->fptr_stego_image);  // read 32 bytes
-    decode_size_from_lsb(&decInfo->extn_size, image_buffer); // extract extension size
-    return e_success;
+    long field;
+    size_t extn_size;
+    LsbLayout layout;
+
+    if(block_extract_size(&decInfo->block, &field) == e_failure)   // extract extension size from next 32 bytes
+        return e_failure;
+
+    if(stego_parse_format(field, &extn_size, &decInfo->flags, &layout) == e_failure)
+    {
+        print_error("unsupported payload format 0x%08lx\n", field);
+        return e_failure;
+    }
+    if(decInfo->flags & STEGO_FLAG_SHARD)
+    {
+        print_error("%s holds one shard of a split secret, decode the whole set with shard -d\n", decInfo->stego_image_fname);
+        return e_failure;
+    }
+    decInfo->extn_size = extn_size;
+
+    return block_set_layout(&decInfo->block, &layout);   // the rest of the payload uses the recorded layout
 }
 
 // Decode extension characters
 Status decode_secret_file_extn(DecodeInfo *decInfo)
 {
-    unsigned char image_buffer[8];
-    for(int i = 0; i < decInfo->extn_size; i++)   // decode each extension char
+    if(decInfo->extn_size < 0 || decInfo->extn_size >= (long)sizeof(decInfo->extn_secret_file))
     {
-        fread(image_buffer, 1, 8, decInfo->fptr_stego_image);
-        decode_byte_from_lsb(&decInfo->extn_secret_file[i], image_buffer);
+        print_error("invalid extension size %ld\n", decInfo->extn_size);
+        return e_failure;
     }
+
+    if(block_extract(&decInfo->block, decInfo->extn_secret_file, decInfo->extn_size) == e_failure)   // decode extension chars
+        return e_failure;
     decInfo->extn_secret_file[decInfo->extn_size] = '\0';   // null-terminate extension
     return e_success;
 }
 
-// Decode size of secret file (32 bits)
+// Decode size of secret file: a 64-bit varint, or 32 bits in a classic header, and the key salt of encrypted data
 Status decode_secret_file_size(DecodeInfo *decInfo)
 {
-    unsigned char image_buffer[32];
-    fread(image_buffer, 1, 32, decInfo->fptr_stego_image);
-    decode_size_from_lsb(&decInfo->size_secret_file, image_buffer);
+    uint64_t size;
+
+    if(block_extract_field(&decInfo->block, decInfo->flags & STEGO_FLAG_VARINT, &size) == e_failure || size > LONG_MAX)
+        return e_failure;
+    decInfo->size_secret_file = size;
+
+    uint8_t salt[CIPHER_SALT_LEN];
+    if(decInfo->flags & STEGO_FLAG_CIPHER)   // the key salt follows the size, in the clear
+    {
+        if(block_extract(&decInfo->block, (char *)salt, CIPHER_SALT_LEN) == e_failure)
+            return e_failure;
+        return setup_cipher(decInfo, salt);
+    }
+    return e_success;
+}
+
+typedef struct _OutputSink
+{
+    FILE *fptr;
+    size_t written;
+    uint32_t crc;        // CRC32C of the bytes written, container entries only
+
+} OutputSink;
+
+// range_read hands the decoded bytes over in order
+static Status write_output(void *ctx, const unsigned char *data, size_t n)
+{
+    OutputSink *sink = ctx;
+
+    if(fwrite(data, 1, n, sink->fptr) != n)
+        return e_failure;
+    sink->written += n;
+    return e_success;
+}
+
+// the same for a container entry, checksummed on the way out
+static Status write_entry(void *ctx, const unsigned char *data, size_t n)
+{
+    OutputSink *sink = ctx;
+
+    sink->crc = crc32c(sink->crc, data, n);
+    return write_output(ctx, data, n);
+}
+
+typedef struct _BufferSink
+{
+    uint8_t *out;
+    size_t len;          // room in out
+    size_t written;
+
+} BufferSink;
+
+static Status write_buffer(void *ctx, const unsigned char *data, size_t n)
+{
+    BufferSink *sink = ctx;
+
+    if(n > sink->len - sink->written)
+        return e_failure;
+    memcpy(sink->out + sink->written, data, n);
+    sink->written += n;
+    return e_success;
+}
+
+typedef struct _StreamSource
+{
+    DecodeInfo *decInfo;
+    long data_off;       // image offset of the data section
+
+} StreamSource;
+
+// container_read_dir on the block engine: a range read of the data section
+static Status read_stream_range(void *ctx, size_t off, size_t len, uint8_t *out)
+{
+    StreamSource *src = ctx;
+    DecodeInfo *decInfo = src->decInfo;
+    BufferSink sink = { out, len, 0 };
+
+    if(range_read(&decInfo->block, src->data_off, decInfo->size_secret_file, decInfo->flags,
+                  off, len, write_buffer, &sink) == e_failure)
+        return e_failure;
+    return sink.written == len ? e_success : e_failure;
+}
+
+// Read the directory of a container, then list it or seek straight to the one entry asked for
+static Status decode_container(DecodeInfo *decInfo)
+{
+    StreamSource src = { decInfo, block_offset(&decInfo->block) };
+    ContainerDir dir;
+
+    if(container_read_dir(read_stream_range, &src, &dir) == e_failure)
+        return e_failure;
+
+    Status status = e_success;
+    const ContainerEntry *entry = NULL;
+    if(decInfo->opts.list)
+        container_list(&dir);
+    else if((entry = pick_entry(decInfo, &dir)) == NULL)
+        status = e_failure;
+    else
+    {
+        OutputSink sink = { decInfo->fptr_output, 0, 0 };
+        status = range_read(&decInfo->block, src.data_off, decInfo->size_secret_file, decInfo->flags,
+                            entry->offset, entry->size, write_entry, &sink);
+        if(status == e_success)
+            status = check_entry(entry, sink.written, sink.crc);
+        else
+            print_error("%s could not be decoded, the stego image is corrupt or truncated\n", entry->name);
+        if(status == e_success)
+            print_status(&decInfo->opts, "Decoded %s: %zu bytes\n", entry->name, sink.written);
+    }
+    container_free(&dir);
+    return status;
+}
+
+// Decode part of the data section (--range), or a packed one which is unpacked chunk by chunk
+static Status decode_data_range(DecodeInfo *decInfo)
+{
+    OutputSink sink = { decInfo->fptr_output, 0, 0 };
+    size_t off = decInfo->opts.has_range ? decInfo->opts.range_off : 0;
+    size_t len = decInfo->opts.has_range ? decInfo->opts.range_len : (size_t)-1;
+
+    if(range_read(&decInfo->block, block_offset(&decInfo->block), decInfo->size_secret_file, decInfo->flags,
+                  off, len, write_output, &sink) == e_failure)
+    {
+        if(!decInfo->opts.has_range)   // whole payload: unpacking or the CRC32C check failed
+            print_error("the secret data is corrupt, the stego image is damaged or truncated\n");
+        else if(decInfo->flags & STEGO_FLAG_LZ)
+            print_error("compressed secret data is corrupt or the range is past its end\n");
+        else
+            print_error("range starts past the end of the %ld byte payload\n", decInfo->size_secret_file);
+        return e_failure;
+    }
+
+    if(decInfo->opts.has_range)
+        print_status(&decInfo->opts, "Decoded %zu payload bytes from offset %zu\n", sink.written, off);
+    else
+        print_status(&decInfo->opts, "Secret file decompressed from %ld to %zu bytes\n", decInfo->size_secret_file, sink.written);
+    return e_success;
+}
+
+// Follow the keyed block order of a scattered data section
+static Status scatter_secret_file_data(DecodeInfo *decInfo)
+{
+    if(decInfo->opts.key == NULL)
+    {
+        print_error("the secret data is scattered, give its key with --key\n");
+        return e_failure;
+    }
+
+    if(block_scatter(&decInfo->block, block_offset(&decInfo->block),
+                     stego_data_len(&decInfo->block.layout, decInfo->size_secret_file, decInfo->flags),
+                     scatter_seed(decInfo->opts.key)) == e_failure)
+    {
+        print_error("the secret data does not fit in the scatter blocks of %s\n", decInfo->stego_image_fname);
+        return e_failure;
+    }
     return e_success;
 }
 
 // Decode actual secret file data
 Status decode_secret_file_data(DecodeInfo *decInfo)
 {
-    unsigned char image_buffer[8];
-    char ch;
+    if(block_align_step(&decInfo->block) == e_failure)   // secret data starts on a fresh layout step
+        return e_failure;
+    if((decInfo->flags & STEGO_FLAG_SCATTER) && scatter_secret_file_data(decInfo) == e_failure)
+        return e_failure;
+
+    if(check_container_args(decInfo, decInfo->flags) == e_failure)
+        return e_failure;
+    if(decInfo->flags & STEGO_FLAG_CONTAINER)   // directory first, then only the entry asked for
+        return decode_container(decInfo);
+    if((decInfo->flags & STEGO_FLAG_LZ) || decInfo->opts.has_range)   // seek straight to the bytes asked for
+        return decode_data_range(decInfo);
 
-    for(long int i = 0; i < decInfo->size_secret_file; i++)   // decode each byte
+    uint32_t crc;
+    if(decInfo->opts.threads > 1 && !(decInfo->flags & STEGO_FLAG_SCATTER))   // one range of the data section per thread
+    {
+        if(parallel_extract(&decInfo->block, fileno(decInfo->fptr_output), decInfo->size_secret_file,
+                            block_offset(&decInfo->block), decInfo->opts.threads, &crc) == e_failure)
+            return e_failure;
+    }
+    else
     {
-        fread(image_buffer, 1, 8, decInfo->fptr_stego_image);
-        decode_byte_from_lsb(&ch, image_buffer);
-        fputc(ch, decInfo->fptr_output);   // write to output file
+        long int chunk = block_payload_size(&decInfo->block);   // secret bytes held by one pixel block
+        char *buffer = malloc(chunk);
+        if(buffer == NULL)
+        {
+            print_error("unable to allocate output buffer\n");
+            return e_failure;
+        }
+
+        block_crc_start(&decInfo->block);   // checksummed by the engine as the bytes come out
+        for(long int i = 0; i < decInfo->size_secret_file; i += chunk)   // decode a block worth of bytes at a time
+        {
+            long int n = decInfo->size_secret_file - i < chunk ? decInfo->size_secret_file - i : chunk;
+
+            if(block_extract(&decInfo->block, buffer, n) == e_failure ||
+               fwrite(buffer, 1, n, decInfo->fptr_output) != (size_t)n)   // write to output file in bulk
+            {
+                free(buffer);
+                return e_failure;
+            }
+        }
+        crc = block_crc_stop(&decInfo->block);
+        free(buffer);
+    }
+
+    if(range_check_crc(&decInfo->block, decInfo->flags, crc) == e_failure)   // trailer on the next fresh layout step
+    {
+        print_error("CRC32C mismatch, %s\n", decInfo->flags & STEGO_FLAG_CIPHER ? "the passphrase is wrong or the stego image is corrupt"
+                                                                                 : "the stego image is corrupt or truncated");
+        return e_failure;
     }
     return e_success;
 }
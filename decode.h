@@ -3,6 +3,10 @@
 
 #include <stdio.h>
 #include "types.h"  // Contains user-defined types
+#include "options.h"  // Contains command-line options
+#include "block.h"  // Contains the block extract engine
+#include "cover.h"  // Contains the cover image header parsers
+#include "stats.h"  // Contains the per-stage statistics
 
 /*
  Structure to store information required for
@@ -18,9 +22,16 @@ typedef struct _DecodeInfo
     long int extn_size;
     char extn_secret_file[10];
     long int size_secret_file;
+    int flags;           // STEGO_FLAG_* from the format word, LZ packed data
     char magic_string[100];
     int magic_len;
-    
+
+    BmpInfo bmp;         // parsed header: pixel offset and row layout
+    StegoOptions opts;   // options given on the command line
+    BlockIO block;       // block buffer shared by all extract stages
+    Cipher cipher;       // data keystream derived from --pass / --pass-file and the stored salt
+    RunStats stats;      // per-stage timings and I/O for --stats
+
 }DecodeInfo; 
 
 /* Decoding function prototypes */
@@ -34,7 +45,8 @@ Status do_decoding(DecodeInfo *decInfo);
 /* Get File pointers for input (stego image) and output files */
 Status open_decode_files(DecodeInfo *decInfo);
 
-Status skip_bmp_header(FILE *fptr_stego_image);
+/* Skip the image header, pixel data starts at bmp->pixel_offset */
+Status skip_bmp_header(FILE *fptr_stego_image, const BmpInfo *bmp);
 
 /* Decode magic string */
 Status decode_magic_string(const char *magic_string , DecodeInfo *decInfo);
@@ -45,15 +57,9 @@ Status decode_secret_file_extn_size(DecodeInfo *decInfo);
 /* Decode the secret file extension */
 Status decode_secret_file_extn(DecodeInfo *decInfo);
 
-/* Decode the secret file size */
+/* Decode the secret file size, and the key salt of encrypted data */
 Status decode_secret_file_size(DecodeInfo *decInfo);
 
 /* Decode the secret file data */
 Status decode_secret_file_data(DecodeInfo *decInfo);
-
-/* Decode a byte from LSB of image data */
-Status decode_byte_from_lsb(char *data, unsigned char *image_buffer);
-
-/* Decode an integer size from LSBs */
-Status decode_size_from_lsb(long int *size, unsigned char *image_buffer);
 #endif
\ No newline at end of file
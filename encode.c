@@ -1,159 +1,392 @@
 #include <stdio.h>      // for standard input/output
+#include <stdlib.h>     // for malloc/free
 #include <string.h>     // for string functions
 #include "types.h"      // for user-defined types
 #include "encode.h"     // for encoding function declarations
-
-// to read and validate command-line arguments for encoding
-Status read_and_validate_encode_args(char *argv[], EncodeInfo *encInfo)
+#include "ring.h"       // for streaming the secret file
+#include "parallel.h"   // for multithreaded embedding
+#include "stego.h"      // for the in-memory library
+#include "copy.h"       // for kernel copies of the unchanged bytes
+#include "container.h"  // for several secrets behind a directory
+#include <sys/mman.h>   // for mapping the secret file
+
+// pipes only go forward: no mapping, no threads, no keyed jumps and no prompt on stdin
+static Status check_stdio_args(EncodeInfo *encInfo)
 {
-    if (strstr(argv[2], ".bmp") != NULL)       // check if source image has .bmp extension
+    int in_cover = is_stdio_name(encInfo->src_image_fname);
+    int in_secret = is_stdio_name(encInfo->secret_fname);
+    int out_stego = is_stdio_name(encInfo->stego_image_fname);
+
+    if (in_secret && encInfo->opts.add_count > 0)
     {
-        printf(".bmp is present\n");
-        encInfo->src_image_fname = argv[2];    // save source image name
+        print_error("--add builds a container from files, the secret cannot come from stdin\n");
+        return e_failure;
     }
-    else
+    if (!in_cover && !in_secret && !out_stego)
+        return e_success;
+    if (in_cover && in_secret)
+    {
+        print_error("the cover and the secret cannot both come from stdin\n");
+        return e_failure;
+    }
+    if ((in_cover || in_secret) && encInfo->opts.magic == NULL)
     {
-        printf(".bmp is not present\n");
+        print_error("reading from stdin needs the magic string as -m <magic>\n");
         return e_failure;
     }
+    if ((in_cover || out_stego) && encInfo->opts.key != NULL)
+    {
+        print_error("--key jumps around the image and needs files, not pipes\n");
+        return e_failure;
+    }
+
+    encInfo->opts.use_mmap = 0;   // one forward pass over the streams
+    encInfo->opts.threads = 1;
+    return e_success;
+}
+
+// output name used when none is given: stego with the cover's extension, stego.bmp for a piped cover
+static char *default_stego_name(EncodeInfo *encInfo)
+{
+    const char *dot = strrchr(encInfo->src_image_fname, '.');
+    const char *extn = ".bmp";
+
+    if (!is_stdio_name(encInfo->src_image_fname) && dot != NULL && strchr(dot, '/') == NULL &&
+        strlen(dot) < MAX_IMAGE_SUFFIX)
+        extn = dot;
+    snprintf(encInfo->default_stego_fname, sizeof(encInfo->default_stego_fname), "%s%s", DEFAULT_STEGO_NAME, extn);
+    return encInfo->default_stego_fname;
+}
+
+// to read and validate command-line arguments for encoding
+Status read_and_validate_encode_args(char *argv[], EncodeInfo *encInfo)
+{
+    encInfo->src_image_fname = argv[2];    // save source image name, its format is told by its header
+    print_status(&encInfo->opts, "Cover image is %s\n", argv[2]);
 
-    if (strstr(argv[3], ".txt") != NULL)       // check if secret file has .txt extension
+    if (is_stdio_name(argv[3]) || strstr(argv[3], ".txt") != NULL)   // check if secret file has .txt extension, or is stdin
     {
-        printf(".txt is present\n");
+        print_status(&encInfo->opts, ".txt is present\n");
         encInfo->secret_fname = argv[3];       // save secret file name
     }
     else
     {
-        printf(".txt is not present\n");
+        print_status(&encInfo->opts, ".txt is not present\n");
         return e_failure;
     }
 
-    if (argv[4] != NULL && strstr(argv[4], ".bmp") != NULL)   // check if output file is .bmp
+    if (encInfo->opts.in_place)   // the cover is the stego image
     {
-        printf(".stego.bmp is present\n");
+        if (argv[4] != NULL || is_stdio_name(argv[2]))
+        {
+            print_error("--in-place rewrites the cover file, give no output name and no piped cover\n");
+            return e_failure;
+        }
+        encInfo->stego_image_fname = argv[2];
+    }
+    else if (argv[4] != NULL)   // output file is written in the cover's format, whatever its name
+    {
+        print_status(&encInfo->opts, "Stego image name is provided: %s\n", argv[4]);
         encInfo->stego_image_fname = argv[4];   // store output stego file name
     }
     else
     {
-        encInfo->stego_image_fname = "stego.bmp";   // use default output file name
+        encInfo->stego_image_fname = default_stego_name(encInfo);   // use default output file name
     }
 
+    return check_stdio_args(encInfo);
+}
+
+// extension stored with the payload, dot included
+static char *secret_extension(EncodeInfo *encInfo)
+{
+    static char stdin_extn[] = STDIN_SECRET_EXTN;   // a secret from stdin has no name to take it from
+    static char container_extn[] = CONTAINER_EXTN;  // the names of the files are in the directory
+
+    if (encInfo->opts.add_count > 0)
+        return container_extn;
+    if (encInfo->secret_extn != NULL)
+        return encInfo->secret_extn;
+    return is_stdio_name(encInfo->secret_fname) ? stdin_extn : strrchr(encInfo->secret_fname, '.');
+}
+
+// format flags describing the data section: packing, a container, encryption and the CRC trailer
+static int data_flags(const EncodeInfo *encInfo)
+{
+    return encInfo->pack_flags | (encInfo->opts.crc ? STEGO_FLAG_CRC : 0) |
+           (encInfo->opts.add_count > 0 ? STEGO_FLAG_CONTAINER : 0) | (encInfo->opts.pass != NULL ? STEGO_FLAG_CIPHER : 0);
+}
+
+// a fresh salt and the key derived from it; the engine encrypts the data section with it
+static Status setup_cipher(EncodeInfo *encInfo)
+{
+    uint8_t salt[CIPHER_SALT_LEN];
+
+    if (encInfo->opts.pass == NULL)
+        return e_success;
+    if (cipher_salt(salt) == e_failure)
+    {
+        print_error("unable to get random bytes for the key salt\n");
+        return e_failure;
+    }
+    cipher_derive(&encInfo->cipher, encInfo->opts.pass, encInfo->opts.pass_len, salt, encInfo->opts.pass_rounds);
+    encInfo->block.cipher = &encInfo->cipher;
     return e_success;
 }
 
-// do encoding function call
-Status do_encoding(EncodeInfo *encInfo)
+// the secret and every --add file behind one directory, read whole into secret_buf
+static Status build_container(EncodeInfo *encInfo)
+{
+    int count = encInfo->opts.add_count + 1;
+    char **files = malloc(count * sizeof(char *));
+    size_t len;
+
+    if (files == NULL)
+        return e_failure;
+    files[0] = encInfo->secret_fname;
+    memcpy(files + 1, encInfo->opts.add_files, encInfo->opts.add_count * sizeof(char *));
+
+    Status status = container_build(files, count, &encInfo->secret_buf, &len);
+    free(files);
+    if (status == e_failure)
+        return e_failure;
+
+    encInfo->size_secret_file = len;
+    if (encInfo->opts.compress && encInfo->opts.chunk_size == 0)   // each file unpacks on its own
+        encInfo->opts.chunk_size = CONTAINER_CHUNK;
+    print_status(&encInfo->opts, "Container of %d files built: %zu bytes\n", count, len);
+    return e_success;
+}
+
+// run every encoding stage in order
+static Status encode_stages(EncodeInfo *encInfo)
 {
-    if (open_files(encInfo) == e_success)      // open input/output files
-        printf("All the files are opened successfully\n");
+    if (stats_stage(&encInfo->stats, e_stage_open, open_files(encInfo)) == e_success)      // open input/output files
+        print_status(&encInfo->opts, "All the files are opened successfully\n");
     else
     {
-        printf("Files are not opened\n");
+        print_status(&encInfo->opts, "Files are not opened\n");
         return e_failure;
     }
 
-    if (check_capacity(encInfo) == e_success)  // verify image can store secret data
-        printf("Check capacity is successful\n");
+    if (stats_stage(&encInfo->stats, e_stage_capacity, check_capacity(encInfo)) == e_success)  // verify image can store secret data
+        print_status(&encInfo->opts, "Check capacity is successful\n");
     else
     {
-        printf("Check capacity is unsuccessful\n");
+        print_status(&encInfo->opts, "Check capacity is unsuccessful\n");
         return e_failure;
     }
 
-    if (copy_bmp_header(encInfo->fptr_src_image, encInfo->fptr_stego_image) == e_success) // copy 54-byte BMP header
-        printf("Header copied successfully\n");
+    Status header;
+    if (encInfo->opts.use_mmap)
+        header = block_map(&encInfo->block, encInfo->bmp.pixel_offset);   // map both images, header is copied between the mappings
+    else if (encInfo->stream_header != NULL)   // already read from the pipe
+        header = fwrite(encInfo->stream_header, 1, encInfo->bmp.pixel_offset, encInfo->fptr_stego_image) == encInfo->bmp.pixel_offset ? e_success : e_failure;
+    else
+        header = copy_bmp_header(encInfo->fptr_src_image, encInfo->fptr_stego_image, encInfo->bmp.pixel_offset); // copy the image header up to the pixels
+    block_stream_at(&encInfo->block, encInfo->bmp.pixel_offset);   // a piped cover is at its pixels now
+    bmp_rows(&encInfo->bmp, &encInfo->block.rows);   // embed row by row, skipping the padding
+
+    if (stats_stage(&encInfo->stats, e_stage_header, header) == e_success)
+        print_status(&encInfo->opts, "Header copied successfully\n");
     else
     {
-        printf("Header is not copied successfully\n");
+        print_status(&encInfo->opts, "Header is not copied successfully\n");
         return e_failure;
     }
 
-    if (encode_magic_string(encInfo) == e_success)   // hide magic string into image
-        printf("Magic string encoded successfully\n");
+    if (stats_stage(&encInfo->stats, e_stage_magic, encode_magic_string(encInfo)) == e_success)   // hide magic string into image
+        print_status(&encInfo->opts, "Magic string encoded successfully\n");
     else
     {
-        printf("Magic string is not encoded successfully\n");
+        print_status(&encInfo->opts, "Magic string is not encoded successfully\n");
         return e_failure;
     }
 
-    int size = strlen(strchr(encInfo->secret_fname, '.'));  // get extension length including dot
+    int size = strlen(secret_extension(encInfo));  // get extension length including dot, paths may contain dots too
+    long stored = encInfo->packed_secret != NULL ? encInfo->packed_size : encInfo->size_secret_file;   // embedded data bytes
+    encInfo->format_flags = stego_format_flags(&encInfo->layout, data_flags(encInfo) | (encInfo->opts.key != NULL ? STEGO_FLAG_SCATTER : 0), stored);
+    uint field = stego_format_word(&encInfo->layout, size, encInfo->format_flags);   // plain extension size unless a k-LSB layout, packing, scattering, a CRC or a 4 GiB secret is used
 
-    if (encode_size_to_lsb(size, encInfo) == e_success)   // encode extension size
-        printf("Size of extension encoded successfully\n");
+    if (stats_stage(&encInfo->stats, e_stage_extension, encode_size_to_lsb(field, encInfo)) == e_success &&   // encode extension size
+        block_set_layout(&encInfo->block, &encInfo->layout) == e_success)   // the rest of the payload uses the layout
+        print_status(&encInfo->opts, "Size of extension encoded successfully\n");
     else
     {
-        printf("Size of extension not encoded successfully\n");
+        print_status(&encInfo->opts, "Size of extension not encoded successfully\n");
         return e_failure;
     }
 
-    if (encode_secret_file_extn(strchr(encInfo->secret_fname, '.'), encInfo) == e_success) // encode extension text
-        printf("Secret file extension encoded successfully\n");
+    if (stats_stage(&encInfo->stats, e_stage_extension, encode_secret_file_extn(secret_extension(encInfo), encInfo)) == e_success) // encode extension text
+        print_status(&encInfo->opts, "Secret file extension encoded successfully\n");
     else
     {
-        printf("Secret file extension not encoded successfully\n");
+        print_status(&encInfo->opts, "Secret file extension not encoded successfully\n");
         return e_failure;
     }
 
-    if (encode_secret_file_size(encInfo->size_secret_file, encInfo) == e_success) // encode secret file size
-        printf("Secret file size encoded successfully\n");
+    if (stats_stage(&encInfo->stats, e_stage_size, encode_secret_file_size(stored, encInfo)) == e_success) // encode secret file size
+        print_status(&encInfo->opts, "Secret file size encoded successfully\n");
     else
     {
-        printf("Secret file size not encoded successfully\n");
+        print_status(&encInfo->opts, "Secret file size not encoded successfully\n");
         return e_failure;
     }
 
-    if (encode_secret_file_data(encInfo) == e_success)   // encode secret file content
-        printf("Secret file data encoded successfully\n");
+    if (stats_stage(&encInfo->stats, e_stage_data, encode_secret_file_data(encInfo)) == e_success)   // encode secret file content
+        print_status(&encInfo->opts, "Secret file data encoded successfully\n");
     else
     {
-        printf("Secret file data not encoded successfully\n");
+        print_status(&encInfo->opts, "Secret file data not encoded successfully\n");
         return e_failure;
     }
 
-    if (copy_remaining_img_data(encInfo->fptr_src_image, encInfo->fptr_stego_image) == e_success) // copy remaining image bytes
-        printf("Remaining data copied\n");
+    Status tail;
+    if (encInfo->opts.key != NULL)
+        tail = e_success;   // copied before the scattered data was embedded
+    else if (encInfo->opts.threads > 1)
+        tail = parallel_copy_tail(&encInfo->block, encInfo->opts.threads);   // each thread copies its share of the tail
+    else if (encInfo->opts.use_mmap)
+        tail = block_copy_tail(&encInfo->block);   // copy the rest of the mapped cover in one go
+    else
+        tail = copy_remaining_img_data(encInfo->fptr_src_image, encInfo->fptr_stego_image); // copy remaining image bytes
+
+    if (stats_stage(&encInfo->stats, e_stage_tail, tail) == e_success)
+        print_status(&encInfo->opts, "Remaining data copied\n");
     else
     {
-        printf("Remaining data not copied\n");
+        print_status(&encInfo->opts, "Remaining data not copied\n");
         return e_failure;
     }
 
-    fclose(encInfo->fptr_src_image);
-    fclose(encInfo->fptr_secret);
-    fclose(encInfo->fptr_stego_image);
-
     return e_success;
 }
 
+// memory mapped encoding: map the files and let libstego embed the whole payload
+static Status encode_with_library(EncodeInfo *encInfo)
+{
+    if (stats_stage(&encInfo->stats, e_stage_open, open_files(encInfo)) == e_failure ||
+        stats_stage(&encInfo->stats, e_stage_capacity, check_capacity(encInfo)) == e_failure)
+    {
+        print_status(&encInfo->opts, "Files are not ready for encoding\n");
+        return e_failure;
+    }
+
+    if (stats_stage(&encInfo->stats, e_stage_header, block_map(&encInfo->block, 0)) == e_failure)   // cover read-only, stego output sized and read-write
+        return e_failure;
+
+    const uint8_t *secret = encInfo->packed_secret != NULL ? encInfo->packed_secret : encInfo->secret_buf;
+    if (secret == NULL && encInfo->size_secret_file > 0)
+    {
+        secret = mmap(NULL, encInfo->size_secret_file, PROT_READ, MAP_SHARED, fileno(encInfo->fptr_secret), 0);
+        if (secret == MAP_FAILED)
+        {
+            print_error("unable to map secret file\n");
+            return e_failure;
+        }
+    }
+
+    StegoParams params = { encInfo->magic, secret_extension(encInfo), encInfo->opts.bits, encInfo->opts.channels,
+                           data_flags(encInfo), encInfo->opts.key, encInfo->block.cipher };
+    long stored = encInfo->packed_secret != NULL ? encInfo->packed_size : encInfo->size_secret_file;
+    Status status = stego_encode(encInfo->block.map_src, encInfo->block.len, secret, stored,
+                                 &params, encInfo->block.map_dest);
+
+    if (secret != NULL && secret != encInfo->packed_secret && secret != encInfo->secret_buf)
+        munmap((void *)secret, encInfo->size_secret_file);
+    stats_stage(&encInfo->stats, e_stage_data, status);   // magic, header fields, data and tail in one pass
+
+    if (status == e_success)
+        print_status(&encInfo->opts, "Payload embedded in the mapped image\n");
+    else
+        print_status(&encInfo->opts, "Payload could not be embedded\n");
+    return status;
+}
+
+// close whatever open_files managed to open
+static void close_files(EncodeInfo *encInfo)
+{
+    block_free(&encInfo->block);
+    free(encInfo->packed_secret);
+    free(encInfo->secret_buf);
+    free(encInfo->stream_header);
+    encInfo->packed_secret = NULL;
+    encInfo->secret_buf = NULL;
+    encInfo->stream_header = NULL;
+    if (encInfo->fptr_src_image != NULL)
+        fclose(encInfo->fptr_src_image);
+    if (encInfo->fptr_secret != NULL)
+        fclose(encInfo->fptr_secret);
+    if (encInfo->fptr_stego_image != NULL)
+        fclose(encInfo->fptr_stego_image);
+
+    encInfo->fptr_src_image = NULL;
+    encInfo->fptr_secret = NULL;
+    encInfo->fptr_stego_image = NULL;
+}
+
+// do encoding function call
+Status do_encoding(EncodeInfo *encInfo)
+{
+    Status status;
+
+    stats_start(&encInfo->stats, encInfo->opts.stats);
+    if (encInfo->opts.use_mmap && encInfo->opts.threads <= 1)
+        status = encode_with_library(encInfo);   // zero-copy path is a thin wrapper over libstego
+    else
+        status = encode_stages(encInfo);         // streaming (or multithreaded) stage by stage
+
+    close_files(encInfo);          // files are closed on failure too, batch jobs must not leak them
+    stats_stage(&encInfo->stats, e_stage_close, status);   // closing flushes the last buffered writes
+    stats_report(&encInfo->stats, "encode", encInfo->src_image_fname, status);
+    return status;
+}
+
 Status open_files(EncodeInfo *encInfo)
 {
-    encInfo->fptr_src_image = fopen(encInfo->src_image_fname, "r");     // open source .bmp file
+    if (is_stdio_name(encInfo->src_image_fname))
+        encInfo->fptr_src_image = stdin;                                   // cover piped in
+    else
+        encInfo->fptr_src_image = fopen(encInfo->src_image_fname, "r");     // open source image file
     if (encInfo->fptr_src_image == NULL)
     {
-        printf("Source file is not present\n");
+        print_error("source file is not present\n");
         return e_failure;
     }
 
-    encInfo->fptr_secret = fopen(encInfo->secret_fname, "r");           // open secret .txt file
+    if (is_stdio_name(encInfo->secret_fname))
+        encInfo->fptr_secret = stdin;                                      // secret piped in
+    else
+        encInfo->fptr_secret = fopen(encInfo->secret_fname, "r");           // open secret .txt file
     if (encInfo->fptr_secret == NULL)
     {
-        printf("Secret file is not present\n");
+        print_error("secret file is not present\n");
         return e_failure;
     }
 
-    encInfo->fptr_stego_image = fopen(encInfo->stego_image_fname, "w"); // open output stego .bmp
+    if (is_stdio_name(encInfo->stego_image_fname))
+        encInfo->fptr_stego_image = stdout_for_data();                     // stego image piped out, messages move to stderr
+    else
+        encInfo->fptr_stego_image = fopen(encInfo->stego_image_fname, encInfo->opts.in_place ? "r+" :   // cover rewritten in place, nothing truncated
+                                          encInfo->opts.use_mmap ? "w+" : "w"); // open output stego image, mapping needs read access
+    if (encInfo->fptr_stego_image == NULL)
+    {
+        print_error("stego file cannot be created\n");
+        return e_failure;
+    }
 
-    return e_success;
+    return block_init(&encInfo->block, encInfo->fptr_src_image, encInfo->fptr_stego_image, encInfo->opts.block_size); // pixel block for embedding
 }
 
-Status check_capacity(EncodeInfo *encInfo)
+// ask the user for the magic string
+static void read_magic_string(EncodeInfo *encInfo)
 {
     printf("Enter magic string length: ");
 scanf("%d", &encInfo->magic_len);
 
-while (encInfo->magic_len <= 0 || encInfo->magic_len >= 100)
+while (encInfo->magic_len <= 0 || encInfo->magic_len >= (int)sizeof(encInfo->magic))
 {
-    printf("Invalid length! Enter a value between 1–99: ");
+    printf("Invalid length! Enter a value between 1–%d: ", (int)sizeof(encInfo->magic) - 1);
     scanf("%d", &encInfo->magic_len);
 }
 
@@ -163,92 +396,189 @@ printf("Magic string length = %d\n", encInfo->magic_len);
 while (1)
 {
     printf("Enter magic string of exactly %d characters: ", encInfo->magic_len);
-    scanf("%s", encInfo->magic);
+    scanf("%19s", encInfo->magic);
 
-    if (strlen(encInfo->magic) == encInfo->magic_len)
+    if ((int)strlen(encInfo->magic) == encInfo->magic_len)
         break;
 
     printf("Error! Length mismatch. Expected %d characters.\n", encInfo->magic_len);
 }
 
-    encInfo->image_capacity = get_image_size_for_bmp(encInfo->fptr_src_image);  // total bytes available
-    encInfo->size_secret_file = get_file_size(encInfo->fptr_secret);           // size of secret file
-
     printf("Enter the magic string: ");
-    scanf("%[^\n]", encInfo->magic);                                           // read magic string
+    scanf("%19[^\n]", encInfo->magic);                                         // read magic string
+}
 
-    if (encInfo->image_capacity > (strlen(encInfo->magic)*8 + 32 + 32 + 32 + encInfo->size_secret_file*8))
-        return e_success;
+Status check_capacity(EncodeInfo *encInfo)
+{
+    if (encInfo->opts.magic != NULL)           // magic given with --magic or a batch manifest, no prompt
+    {
+        if (strlen(encInfo->opts.magic) == 0 || strlen(encInfo->opts.magic) >= sizeof(encInfo->magic))
+        {
+            print_status(&encInfo->opts, "Magic string must be 1-%d characters\n", (int)sizeof(encInfo->magic) - 1);
+            return e_failure;
+        }
+        strcpy(encInfo->magic, encInfo->opts.magic);
+        encInfo->magic_len = strlen(encInfo->magic);
+    }
     else
+        read_magic_string(encInfo);
+
+    Status header;
+    if (ftell(encInfo->fptr_src_image) < 0)   // a pipe is read once: keep the header for the stego image
+        header = cover_read_stream(encInfo->fptr_src_image, &encInfo->bmp, &encInfo->stream_header);
+    else
+        header = cover_read(encInfo->fptr_src_image, &encInfo->bmp);    // format, pixel offset, depth and row layout
+    if (header == e_failure)
+        return e_failure;
+    print_status(&encInfo->opts, "Cover image is a %s image\n", cover_format_name(encInfo->bmp.format));
+    encInfo->image_capacity = bmp_pixel_bytes(&encInfo->bmp);                 // pixel bytes available, padding excluded
+    encInfo->bits_per_pixel = encInfo->bmp.bits_per_pixel;
+    encInfo->secret_stream = ftell(encInfo->fptr_secret) < 0;
+    if (encInfo->opts.add_count > 0)
     {
-        printf("Image capacity failed\n");
+        if (build_container(encInfo) == e_failure)
+            return e_failure;
+    }
+    else if (!encInfo->secret_stream)
+        encInfo->size_secret_file = get_file_size(encInfo->fptr_secret);       // size of secret file
+    else if (encInfo->opts.secret_size > 0)
+        encInfo->size_secret_file = encInfo->opts.secret_size;                 // streamed through the ring, --size long
+    else if (read_secret_stream(encInfo) == e_failure)                         // no size given: buffer it whole
+        return e_failure;
+    if (encInfo->opts.compress && compress_secret_file(encInfo) == e_failure)  // fewer bytes to embed
+        return e_failure;
+
+    if (lsb_get_layout(encInfo->opts.bits, cover_channels(&encInfo->bmp, encInfo->opts.channels),
+                       encInfo->bits_per_pixel / 8, &encInfo->layout) == e_failure)
+    {
+        print_error("%d bit layout with channel mask 0x%x is not possible on a %u bpp image\n",
+               encInfo->opts.bits, encInfo->opts.channels, encInfo->bits_per_pixel);
+        return e_failure;
+    }
+
+    StegoParams params = { encInfo->magic, secret_extension(encInfo), encInfo->opts.bits, encInfo->opts.channels,
+                           data_flags(encInfo), NULL, NULL };
+    long stored = encInfo->packed_secret != NULL ? encInfo->packed_size : encInfo->size_secret_file;
+    size_t needed = stego_cover_needed(&params, &encInfo->layout, stored);
+    if (encInfo->opts.key != NULL)
+        needed += SCATTER_BLOCK;   // the data area is used in whole blocks
+    if (encInfo->image_capacity > needed)
+        return setup_cipher(encInfo);   // the key is only derived for a secret that fits
+    else
+    {
+        print_error("image capacity failed, the secret file does not fit in %s\n", encInfo->src_image_fname);
         return e_failure;
     }
 }
 
-uint get_file_size(FILE *fptr)
+// a secret streamed --size long must end there, or the rest of it would be dropped without a word
+static Status check_stream_end(EncodeInfo *encInfo)
 {
-    fseek(fptr, 0, SEEK_END);
-    return ftell(fptr);                   // return size of file
+    if (!encInfo->secret_stream || getc(encInfo->fptr_secret) == EOF)
+        return e_success;
+    print_error("secret is longer than --size %ld\n", encInfo->size_secret_file);
+    return e_failure;
 }
 
-uint get_image_size_for_bmp(FILE *fptr_image)
+Status read_secret_stream(EncodeInfo *encInfo)
 {
-    uint width, height;
-
-    fseek(fptr_image, 18, SEEK_SET);
-    fread(&width, 4, 1, fptr_image);      // read BMP width
-    fread(&height, 4, 1, fptr_image);     // read BMP height
+    size_t cap = STDIN_SECRET_CHUNK, len = 0, n;
+    unsigned char *buf = malloc(cap);
 
-    return width * height * 3;            // total bytes in pixel data
-}
+    while (buf != NULL && (n = fread(buf + len, 1, cap - len, encInfo->fptr_secret)) > 0)
+    {
+        len += n;
+        if (len == cap)   // full, double it
+        {
+            unsigned char *grown = realloc(buf, cap * 2);
+            if (grown == NULL)
+                free(buf);
+            buf = grown;
+            cap *= 2;
+        }
+    }
+    if (buf == NULL || ferror(encInfo->fptr_secret))
+    {
+        print_error("unable to read the secret from stdin (it must fit in memory without --size)\n");
+        free(buf);
+        return e_failure;
+    }
 
-Status copy_bmp_header(FILE *fptr_src_image, FILE *fptr_dest_image)
-{
-    rewind(fptr_src_image);
-    char buffer[54];
-    fread(buffer, 54, 1, fptr_src_image);     // read 54-byte header
-    fwrite(buffer, 54, 1, fptr_dest_image);   // write 54-byte header
+    print_status(&encInfo->opts, "Secret read from stdin: %zu bytes\n", len);
+    encInfo->secret_buf = buf;
+    encInfo->size_secret_file = len;
     return e_success;
 }
 
-Status encode_magic_string(EncodeInfo *encInfo)
+Status compress_secret_file(EncodeInfo *encInfo)
 {
-    if (encode_data_to_image(encInfo->magic, strlen(encInfo->magic) + 1, encInfo) == e_success)  // encode magic string + '\0'
-        return e_success;
-    else
+    unsigned char *secret = encInfo->secret_buf != NULL ? encInfo->secret_buf : malloc(encInfo->size_secret_file + 1);
+    size_t chunk = encInfo->opts.chunk_size;
+    unsigned char *packed = malloc(stego_pack_bound(encInfo->size_secret_file, chunk));
+
+    if (!encInfo->secret_stream)
+        rewind(encInfo->fptr_secret);
+    if (secret == NULL || packed == NULL || (secret != encInfo->secret_buf &&
+        fread(secret, 1, encInfo->size_secret_file, encInfo->fptr_secret) != (size_t)encInfo->size_secret_file))
+    {
+        print_error("unable to read %s for compression\n", encInfo->secret_fname);
+        if (secret != encInfo->secret_buf)
+            free(secret);
+        free(packed);
         return e_failure;
-}
+    }
+    if (secret != encInfo->secret_buf && check_stream_end(encInfo) == e_failure)
+    {
+        free(secret);
+        free(packed);
+        return e_failure;
+    }
 
-Status encode_data_to_image(char *data, int size, EncodeInfo *encInfo)
-{
-    for (int i = 0; i < size; i++)
+    encInfo->packed_size = stego_pack(secret, encInfo->size_secret_file, chunk, packed);
+    if (encInfo->secret_stream || secret == encInfo->secret_buf)
+        encInfo->secret_buf = secret;   // read from the pipe (or built) once, kept in case it stays unpacked
+    else
+        free(secret);
+    if (encInfo->packed_size == 0)
     {
-        fread(encInfo->image_data, 8, 1, encInfo->fptr_src_image);         // read 8 bytes from image
-        encode_byte_to_lsb(data[i], encInfo->image_data);                  // hide 1 character into 8 bytes
-        fwrite(encInfo->image_data, 8, 1, encInfo->fptr_stego_image);      // write encoded bytes
+        print_status(&encInfo->opts, "Secret file does not compress, storing it as is\n");
+        free(packed);
+        return e_success;
     }
+
+    print_status(&encInfo->opts, "Secret file compressed from %ld to %ld bytes\n", encInfo->size_secret_file, encInfo->packed_size);
+    encInfo->packed_secret = packed;
+    encInfo->pack_flags = STEGO_FLAG_LZ | (chunk > 0 ? STEGO_FLAG_CHUNKED : 0);
     return e_success;
 }
 
-Status encode_byte_to_lsb(char data, char *image_buffer)
+long get_file_size(FILE *fptr)
 {
-    for (int i = 0; i < 8; i++)
-        image_buffer[i] = (image_buffer[i] & 0xFE) | ((data >> i) & 1);    // store each bit in LSB
+    fseek(fptr, 0, SEEK_END);
+    return ftell(fptr);                   // return size of file
+}
 
-    return e_success;
+Status copy_bmp_header(FILE *fptr_src_image, FILE *fptr_dest_image, uint header_size)
+{
+    return copy_image_range(fptr_src_image, fptr_dest_image, 0, header_size);   // file header, info / V4 / V5 header and palette, or a PPM/PAM/TGA header
 }
 
-Status encode_size_to_lsb(int size, EncodeInfo *encInfo)
+Status encode_magic_string(EncodeInfo *encInfo)
 {
-    char buffer[32];
-    fread(buffer, 32, 1, encInfo->fptr_src_image);                         // read 32 bytes
+    if (encode_data_to_image(encInfo->magic, strlen(encInfo->magic) + 1, encInfo) == e_success)  // encode magic string + '\0'
+        return e_success;
+    else
+        return e_failure;
+}
 
-    for (int i = 0; i < 32; i++)
-        buffer[i] = (buffer[i] & 0xFE) | ((size & (1 << i)) >> i);         // encode size bit-by-bit
+Status encode_data_to_image(char *data, long size, EncodeInfo *encInfo)
+{
+    return block_embed(&encInfo->block, data, size);                        // hide size characters block by block
+}
 
-    fwrite(buffer, 32, 1, encInfo->fptr_stego_image);                      // write encoded bytes
-    return e_success;
+Status encode_size_to_lsb(uint size, EncodeInfo *encInfo)
+{
+    return block_embed_size(&encInfo->block, size);                         // encode a 32-bit field (the format word) into the next 32 bytes
 }
 
 Status encode_secret_file_extn(char *file_extn, EncodeInfo *encInfo)
@@ -261,26 +591,100 @@ Status encode_secret_file_extn(char *file_extn, EncodeInfo *encInfo)
 
 Status encode_secret_file_size(long file_size, EncodeInfo *encInfo)
 {
-    encode_size_to_lsb(file_size, encInfo);      // encode secret file size
+    if (block_embed_field(&encInfo->block, encInfo->format_flags & STEGO_FLAG_VARINT, file_size) == e_failure)   // 64-bit varint, or 32 bits in a classic header
+        return e_failure;
+    if (encInfo->format_flags & STEGO_FLAG_CIPHER)   // the key salt follows the size, in the clear
+        return block_embed(&encInfo->block, (char *)encInfo->cipher.salt, CIPHER_SALT_LEN);
+    return e_success;
+}
+
+Status scatter_secret_file_data(EncodeInfo *encInfo)
+{
+    BlockIO *io = &encInfo->block;
+    long data_off = block_offset(io);
+    long stored = encInfo->packed_secret != NULL ? encInfo->packed_size : encInfo->size_secret_file;
+    Status status;
+
+    // the keyed blocks are rewritten in place, so everything after the header goes across first
+    if (encInfo->opts.threads > 1)
+        status = parallel_copy_tail(io, encInfo->opts.threads);
+    else if (encInfo->opts.use_mmap)
+        status = block_copy_tail(io);
+    else if ((status = block_flush(io)) == e_success)
+        status = copy_remaining_img_data(encInfo->fptr_src_image, encInfo->fptr_stego_image);
+    if (status == e_failure)
+        return e_failure;
+
+    if (block_scatter(io, data_off, stego_data_len(&encInfo->layout, stored, data_flags(encInfo)),
+                      scatter_seed(encInfo->opts.key)) == e_failure)
+    {
+        print_error("the secret file does not fit in whole scatter blocks of %s\n", encInfo->src_image_fname);
+        return e_failure;
+    }
     return e_success;
 }
 
 Status encode_secret_file_data(EncodeInfo *encInfo)
 {
-    char buffer[encInfo->size_secret_file];
-    rewind(encInfo->fptr_secret);                // rewind secret file
+    ChunkRing ring;
+    const unsigned char *chunk;
+    size_t len;
+
+    if (block_align_step(&encInfo->block) == e_failure)   // secret data starts on a fresh layout step
+        return e_failure;
+    if (encInfo->opts.key != NULL && scatter_secret_file_data(encInfo) == e_failure)
+        return e_failure;
 
-    fread(buffer, encInfo->size_secret_file, 1, encInfo->fptr_secret);  // read full secret file
-    encode_data_to_image(buffer, encInfo->size_secret_file, encInfo);   // encode secret data
+    Status status = e_success;
+    uint32_t crc;
+    block_crc_start(&encInfo->block);            // checksummed by the engine as the bytes are embedded
 
-    return e_success;
+    if (encInfo->packed_secret != NULL)          // already in memory, small enough for one pass
+    {
+        status = encode_data_to_image((char *)encInfo->packed_secret, encInfo->packed_size, encInfo);
+        crc = block_crc_stop(&encInfo->block);
+    }
+    else if (encInfo->secret_buf != NULL)        // read whole from a pipe
+    {
+        status = encode_data_to_image((char *)encInfo->secret_buf, encInfo->size_secret_file, encInfo);
+        crc = block_crc_stop(&encInfo->block);
+    }
+    else if (encInfo->opts.threads > 1 && encInfo->opts.key == NULL)   // cut the data section into one range per thread
+    {
+        block_crc_stop(&encInfo->block);
+        status = parallel_embed(&encInfo->block, fileno(encInfo->fptr_secret), encInfo->size_secret_file,
+                                block_offset(&encInfo->block), encInfo->opts.threads, &crc);
+    }
+    else
+    {
+        if (!encInfo->secret_stream)
+            rewind(encInfo->fptr_secret);        // rewind secret file, a pipe is read from where it is
+
+        // stream the secret through a fixed ring, one chunk fills one pixel block
+        if (ring_open(&ring, encInfo->fptr_secret, encInfo->size_secret_file, block_payload_size(&encInfo->block)) == e_failure)
+            return e_failure;
+
+        while (status == e_success && ring_next(&ring, &chunk, &len) == e_success && len > 0)
+        {
+            status = encode_data_to_image((char *)chunk, len, encInfo);   // encode secret data
+            ring_release(&ring);
+        }
+
+        if (ring_close(&ring) == e_failure || (status == e_success && check_stream_end(encInfo) == e_failure))
+            status = e_failure;
+        crc = block_crc_stop(&encInfo->block);
+    }
+    if (status == e_failure)
+        return e_failure;
+
+    if (encInfo->opts.crc &&                     // CRC32C trailer on the next fresh layout step
+        (block_align_step(&encInfo->block) == e_failure || block_embed_size(&encInfo->block, crc) == e_failure))
+        return e_failure;
+
+    return block_flush(&encInfo->block);        // write the last partly used block
 }
 
 Status copy_remaining_img_data(FILE *fptr_src, FILE *fptr_dest)
 {
-    char ch;
-    while (fread(&ch, 1, 1, fptr_src))           // read remaining bytes
-        fwrite(&ch, 1, 1, fptr_dest);            // write remaining bytes
-
-    return e_success;
-}
\ No newline at end of file
+    return copy_image_range(fptr_src, fptr_dest, ftell(fptr_src), COPY_TO_END);   // in the kernel, from where the payload ended
+}
@@ -3,6 +3,10 @@
 
 #include <stdio.h>
 #include "types.h" // Contains user defined types
+#include "options.h" // Contains command-line options
+#include "block.h" // Contains the block embed engine
+#include "cover.h" // Contains the cover image header parsers
+#include "stats.h" // Contains the per-stage statistics
 
 /* 
  * Structure to store information required for
@@ -14,29 +18,49 @@
 #define MAX_SECRET_BUF_SIZE 1
 #define MAX_IMAGE_BUF_SIZE (MAX_SECRET_BUF_SIZE * 8)
 #define MAX_FILE_SUFFIX 4
+#define STDIN_SECRET_EXTN ".txt"        // extension stored for a secret read from stdin
+#define STDIN_SECRET_CHUNK (64 * 1024)  // first buffer for a secret read whole from a pipe
+#define DEFAULT_STEGO_NAME "stego"      // output name without its extension, which is the cover's
+#define MAX_IMAGE_SUFFIX 8
 
 typedef struct _EncodeInfo
 {
     /* Source Image info */
     char *src_image_fname;   // to store the src image name
     FILE *fptr_src_image;    // to store the address of the src image
-    uint image_capacity;     // to store the size of image
+    size_t image_capacity;   // to store the size of image
     uint bits_per_pixel;
-    char image_data[MAX_IMAGE_BUF_SIZE];
+    BmpInfo bmp;             // parsed header: pixel offset, depth and row layout
+    unsigned char *stream_header;   // header of a cover read from a pipe, written ahead of the pixels
 
     /* Secret File Info */
     char *secret_fname;    // to store the secret file name
+    char *secret_extn;     // extension stored when the name has none to give (a descriptor passed to stegod), NULL otherwise
     FILE *fptr_secret;     // to store the secret file address
     char extn_secret_file[MAX_FILE_SUFFIX];  // to store the secret file extension
     char secret_data[MAX_SECRET_BUF_SIZE];   // to store the secret data
     long size_secret_file;    // to store the size of secret data
+    int secret_stream;        // secret comes from a pipe and is read once, front to back
+    unsigned char *secret_buf;      // piped secret read whole (no --size, or kept by --compress) or a --add container, NULL otherwise
+    unsigned char *packed_secret;   // LZ packed secret with --compress, NULL when stored as is
+    long packed_size;               // bytes of packed_secret
+    int pack_flags;                 // format flags describing packed_secret
+    int format_flags;               // STEGO_FLAG_* stored in the format word, STEGO_FLAG_VARINT for 64-bit size fields
 
     /* Stego Image Info */
     char *stego_image_fname;   // to store the output file name
+    char default_stego_fname[sizeof(DEFAULT_STEGO_NAME) + MAX_IMAGE_SUFFIX];   // stego.<cover extension> when none is given
     FILE *fptr_stego_image;    // to store the address of stego image 
     char magic[20];
     int magic_len;
 
+    /* Pixel block engine */
+    StegoOptions opts;         // options given on the command line
+    BlockIO block;             // block buffer shared by all embed stages
+    LsbLayout layout;          // k-LSB layout chosen from --bits / --channels
+    Cipher cipher;             // data keystream with --pass / --pass-file, under a fresh salt
+    RunStats stats;            // per-stage timings and I/O for --stats
+
 } EncodeInfo;
 
 
@@ -57,14 +81,17 @@ Status open_files(EncodeInfo *encInfo);
 /* check capacity */
 Status check_capacity(EncodeInfo *encInfo);
 
-/* Get image size */
-uint get_image_size_for_bmp(FILE *fptr_image);
+/* Read a piped secret of unknown length into secret_buf */
+Status read_secret_stream(EncodeInfo *encInfo);
+
+/* Pack the secret with the LZ codec, keeps it unpacked when that does not shrink it */
+Status compress_secret_file(EncodeInfo *encInfo);
 
 /* Get file size */
-uint get_file_size(FILE *fptr);
+long get_file_size(FILE *fptr);
 
-/* Copy bmp image header */
-Status copy_bmp_header(FILE *fptr_src_image, FILE *fptr_dest_image);
+/* Copy the image header (everything before the pixel array) */
+Status copy_bmp_header(FILE *fptr_src_image, FILE *fptr_dest_image, uint header_size);
 
 /* Store Magic String */
 Status encode_magic_string(EncodeInfo *encInfo);
@@ -72,21 +99,23 @@ Status encode_magic_string(EncodeInfo *encInfo);
 /* Encode secret file extenstion */
 Status encode_secret_file_extn(char *file_extn, EncodeInfo *encInfo);
 
-/* Encode secret file size */
+/* Encode secret file size, and the key salt of encrypted data */
 //Status encode_secret_file_size(long file_size, EncodeInfo *encInfo);
 
 Status encode_secret_file_size(long file_size, EncodeInfo *encInfo);
 
 
+/* Copy the image after the header and spread the data section over keyed blocks (--key) */
+Status scatter_secret_file_data(EncodeInfo *encInfo);
+
 /* Encode secret file data*/
 Status encode_secret_file_data(EncodeInfo *encInfo);
 
 /* Encode function, which does the real encoding */
-Status encode_data_to_image(char *data, int size, EncodeInfo *encInfo);
+Status encode_data_to_image(char *data, long size, EncodeInfo *encInfo);
 
-/* Encode a byte into LSB of image data array */
-Status encode_byte_to_lsb(char data, char *image_buffer);
-Status encode_size_to_lsb(int size,EncodeInfo *encInfo); 
+/* Encode a 32-bit field into the LSBs of the image data */
+Status encode_size_to_lsb(uint size,EncodeInfo *encInfo); 
 
 /* Copy remaining image bytes from src to stego image after encoding */
 Status copy_remaining_img_data(FILE *fptr_src, FILE *fptr_dest);
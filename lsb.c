@@ -0,0 +1,437 @@
+#include <string.h>     // for memcpy/strcmp
+#include <stdint.h>     // for fixed width integers
+#include "lsb.h"        // for kernel declarations
+#include "stego.h"      // for stego_error
+
+#if defined(__x86_64__) || defined(__i386__)
+#define LSB_X86 1
+#include <immintrin.h>  // for SSE2 / AVX2 / BMI2 intrinsics
+#endif
+
+#define LSB_BITS_64 0x0101010101010101ULL   // LSB of each of 8 cover bytes
+
+static void embed_auto(unsigned char *out, const unsigned char *cover, const unsigned char *data, size_t n);
+static void extract_auto(const unsigned char *cover, unsigned char *data, size_t n);
+
+LsbEmbedFn lsb_embed = embed_auto;       // resolved to the best kernel on first use
+LsbExtractFn lsb_extract = extract_auto;
+static KernelType selected = e_kernel_auto;
+
+/* ---------- scalar reference kernels ---------- */
+
+static void embed_scalar(unsigned char *out, const unsigned char *cover, const unsigned char *data, size_t n)
+{
+    for (size_t i = 0; i < n; i++)
+        for (int b = 0; b < 8; b++)
+            out[i * 8 + b] = (cover[i * 8 + b] & 0xFE) | ((data[i] >> b) & 1);   // store each bit in LSB
+}
+
+static void extract_scalar(const unsigned char *cover, unsigned char *data, size_t n)
+{
+    for (size_t i = 0; i < n; i++)
+    {
+        unsigned char ch = 0;
+        for (int b = 0; b < 8; b++)
+            ch |= (cover[i * 8 + b] & 1) << b;    // collect each LSB
+        data[i] = ch;
+    }
+}
+
+#ifdef LSB_X86
+
+/* ---------- SSE2: 16 secret bytes / 128 cover bytes per step ---------- */
+
+// spread the 16 bytes held 8x-replicated in pairs (v = d[2j] x8 | d[2j+1] x8) into cover LSBs
+__attribute__((target("sse2")))
+static inline void sse2_store_pair(unsigned char *out, const unsigned char *cover, __m128i v)
+{
+    const __m128i bits = _mm_setr_epi8(1, 2, 4, 8, 16, 32, 64, -128, 1, 2, 4, 8, 16, 32, 64, -128);
+    const __m128i one = _mm_set1_epi8(1);
+    const __m128i keep = _mm_set1_epi8((char)0xFE);
+
+    __m128i set = _mm_cmpeq_epi8(_mm_and_si128(v, bits), bits);   // 0xFF where the bit is 1
+    __m128i c = _mm_loadu_si128((const __m128i *)cover);
+    c = _mm_or_si128(_mm_and_si128(c, keep), _mm_and_si128(set, one));
+    _mm_storeu_si128((__m128i *)out, c);
+}
+
+__attribute__((target("sse2")))
+static void embed_sse2(unsigned char *out, const unsigned char *cover, const unsigned char *data, size_t n)
+{
+    size_t i = 0;
+
+    for (; i + 16 <= n; i += 16)
+    {
+        __m128i d = _mm_loadu_si128((const __m128i *)(data + i));
+        __m128i b2[2] = { _mm_unpacklo_epi8(d, d), _mm_unpackhi_epi8(d, d) };   // each byte x2
+
+        for (int h = 0; h < 2; h++)
+        {
+            __m128i b4[2] = { _mm_unpacklo_epi16(b2[h], b2[h]), _mm_unpackhi_epi16(b2[h], b2[h]) };   // each byte x4
+
+            for (int q = 0; q < 2; q++)
+            {
+                size_t at = (i + h * 8 + q * 4) * 8;   // cover offset of the first of 4 secret bytes
+                sse2_store_pair(out + at, cover + at, _mm_unpacklo_epi32(b4[q], b4[q]));
+                sse2_store_pair(out + at + 16, cover + at + 16, _mm_unpackhi_epi32(b4[q], b4[q]));
+            }
+        }
+    }
+
+    embed_scalar(out + i * 8, cover + i * 8, data + i, n - i);   // leftover bytes
+}
+
+__attribute__((target("sse2")))
+static void extract_sse2(const unsigned char *cover, unsigned char *data, size_t n)
+{
+    size_t i = 0;
+
+    for (; i + 16 <= n; i += 16)
+    {
+        for (int j = 0; j < 8; j++)
+        {
+            __m128i c = _mm_loadu_si128((const __m128i *)(cover + (i + j * 2) * 8));
+            uint16_t m = _mm_movemask_epi8(_mm_slli_epi16(c, 7));   // LSB of each byte -> one bit
+            memcpy(data + i + j * 2, &m, 2);
+        }
+    }
+
+    extract_scalar(cover + i * 8, data + i, n - i);
+}
+
+/* ---------- AVX2: 32 secret bytes / 256 cover bytes per step ---------- */
+
+__attribute__((target("avx2")))
+static void embed_avx2(unsigned char *out, const unsigned char *cover, const unsigned char *data, size_t n)
+{
+    const __m256i spread = _mm256_setr_epi8(0, 0, 0, 0, 0, 0, 0, 0, 1, 1, 1, 1, 1, 1, 1, 1,
+                                            2, 2, 2, 2, 2, 2, 2, 2, 3, 3, 3, 3, 3, 3, 3, 3);
+    const __m256i bits = _mm256_set1_epi64x((long long)0x8040201008040201ULL);
+    const __m256i one = _mm256_set1_epi8(1);
+    const __m256i keep = _mm256_set1_epi8((char)0xFE);
+    size_t i = 0;
+
+    for (; i + 32 <= n; i += 32)
+    {
+        for (int j = 0; j < 8; j++)
+        {
+            uint32_t four;
+            memcpy(&four, data + i + j * 4, 4);
+
+            __m256i v = _mm256_shuffle_epi8(_mm256_set1_epi32((int)four), spread);   // each of 4 bytes x8
+            __m256i set = _mm256_cmpeq_epi8(_mm256_and_si256(v, bits), bits);
+            __m256i c = _mm256_loadu_si256((const __m256i *)(cover + (i + j * 4) * 8));
+            c = _mm256_or_si256(_mm256_and_si256(c, keep), _mm256_and_si256(set, one));
+            _mm256_storeu_si256((__m256i *)(out + (i + j * 4) * 8), c);
+        }
+    }
+
+    embed_sse2(out + i * 8, cover + i * 8, data + i, n - i);
+}
+
+__attribute__((target("avx2")))
+static void extract_avx2(const unsigned char *cover, unsigned char *data, size_t n)
+{
+    size_t i = 0;
+
+    for (; i + 32 <= n; i += 32)
+    {
+        for (int j = 0; j < 8; j++)
+        {
+            __m256i c = _mm256_loadu_si256((const __m256i *)(cover + (i + j * 4) * 8));
+            uint32_t m = _mm256_movemask_epi8(_mm256_slli_epi16(c, 7));
+            memcpy(data + i + j * 4, &m, 4);
+        }
+    }
+
+    extract_sse2(cover + i * 8, data + i, n - i);
+}
+
+/* ---------- BMI2: pdep / pext, 16 secret bytes per step ---------- */
+
+__attribute__((target("bmi2")))
+static void embed_bmi2(unsigned char *out, const unsigned char *cover, const unsigned char *data, size_t n)
+{
+    size_t i = 0;
+
+    for (; i + 16 <= n; i += 16)
+    {
+        for (int j = 0; j < 16; j++)
+        {
+            uint64_t c;
+            memcpy(&c, cover + (i + j) * 8, 8);
+            c = (c & ~LSB_BITS_64) | _pdep_u64(data[i + j], LSB_BITS_64);   // bit b -> LSB of byte b
+            memcpy(out + (i + j) * 8, &c, 8);
+        }
+    }
+
+    embed_scalar(out + i * 8, cover + i * 8, data + i, n - i);
+}
+
+__attribute__((target("bmi2")))
+static void extract_bmi2(const unsigned char *cover, unsigned char *data, size_t n)
+{
+    size_t i = 0;
+
+    for (; i + 16 <= n; i += 16)
+    {
+        for (int j = 0; j < 16; j++)
+        {
+            uint64_t c;
+            memcpy(&c, cover + (i + j) * 8, 8);
+            data[i + j] = (unsigned char)_pext_u64(c, LSB_BITS_64);
+        }
+    }
+
+    extract_scalar(cover + i * 8, data + i, n - i);
+}
+
+#endif /* LSB_X86 */
+
+/* ---------- k-LSB layouts: one specialised kernel per (bits, mask, bytes per pixel) ---------- */
+
+// cover bytes per unit: a whole pixel with a channel mask, a single byte without one
+#define KLSB_UNIT(MASK, BPP)        ((MASK) ? (BPP) : 1)
+#define KLSB_UNIT_BITS(K, MASK)     ((K) * ((MASK) ? __builtin_popcount(MASK) : 1))
+#define KLSB_GCD8(x)                (((x) & 7) == 0 ? 8 : ((x) & 3) == 0 ? 4 : ((x) & 1) == 0 ? 2 : 1)
+#define KLSB_UNITS(K, MASK)         (8 / KLSB_GCD8(KLSB_UNIT_BITS(K, MASK)))   // units per step
+#define KLSB_STEP_DATA(K, MASK)     (KLSB_UNITS(K, MASK) * KLSB_UNIT_BITS(K, MASK) / 8)
+
+// K, MASK and BPP are constants in every caller, so each copy is fully unrolled without per-bit branches
+static inline __attribute__((always_inline))
+void klsb_embed_body(unsigned char *out, const unsigned char *cover, const unsigned char *data, size_t n,
+                     const int K, const int MASK, const int BPP)
+{
+    const int unit = KLSB_UNIT(MASK, BPP), units = KLSB_UNITS(K, MASK), step = KLSB_STEP_DATA(K, MASK);
+    const unsigned char low = (1 << K) - 1;
+
+    for (size_t i = 0; i < n; i++, out += units * unit, cover += units * unit, data += step)
+    {
+        uint32_t bits = 0;
+        for (int s = 0; s < step; s++)
+            bits |= (uint32_t)data[s] << (8 * s);   // payload bytes LSB first, as in the 1 bit layout
+
+        for (int u = 0; u < units * unit; u++)
+        {
+            if (MASK == 0 || (MASK >> (u % unit)) & 1)
+            {
+                out[u] = (cover[u] & ~low) | (bits & low);
+                bits >>= K;
+            }
+            else
+                out[u] = cover[u];   // channel left alone
+        }
+    }
+}
+
+static inline __attribute__((always_inline))
+void klsb_extract_body(const unsigned char *cover, unsigned char *data, size_t n,
+                       const int K, const int MASK, const int BPP)
+{
+    const int unit = KLSB_UNIT(MASK, BPP), units = KLSB_UNITS(K, MASK), step = KLSB_STEP_DATA(K, MASK);
+    const unsigned char low = (1 << K) - 1;
+
+    for (size_t i = 0; i < n; i++, cover += units * unit, data += step)
+    {
+        uint32_t bits = 0;
+        int shift = 0;
+
+        for (int u = 0; u < units * unit; u++)
+        {
+            if (MASK == 0 || (MASK >> (u % unit)) & 1)
+            {
+                bits |= (uint32_t)(cover[u] & low) << shift;
+                shift += K;
+            }
+        }
+
+        for (int s = 0; s < step; s++)
+            data[s] = bits >> (8 * s);
+    }
+}
+
+#define KLSB_KERNEL(K, MASK, BPP) \
+    static void klsb_embed_##K##_##MASK##_##BPP(unsigned char *out, const unsigned char *cover, \
+                                                 const unsigned char *data, size_t n) \
+    { klsb_embed_body(out, cover, data, n, K, MASK, BPP); } \
+    static void klsb_extract_##K##_##MASK##_##BPP(const unsigned char *cover, unsigned char *data, size_t n) \
+    { klsb_extract_body(cover, data, n, K, MASK, BPP); }
+
+#define KLSB_ENTRY(K, MASK, BPP) \
+    { K, MASK, BPP, KLSB_UNITS(K, MASK) * KLSB_UNIT(MASK, BPP), KLSB_STEP_DATA(K, MASK), \
+      klsb_embed_##K##_##MASK##_##BPP, klsb_extract_##K##_##MASK##_##BPP },
+
+// every channel subset short of the full pixel (the full pixel is the unmasked layout)
+#define KLSB_MASKS_24(X, K) X(K, 1, 3) X(K, 2, 3) X(K, 3, 3) X(K, 4, 3) X(K, 5, 3) X(K, 6, 3)
+#define KLSB_MASKS_32(X, K) X(K, 1, 4) X(K, 2, 4) X(K, 3, 4) X(K, 4, 4) X(K, 5, 4) X(K, 6, 4) X(K, 7, 4) \
+                            X(K, 8, 4) X(K, 9, 4) X(K, 10, 4) X(K, 11, 4) X(K, 12, 4) X(K, 13, 4) X(K, 14, 4)
+#define KLSB_ALL(X) X(2, 0, 0) X(4, 0, 0) \
+                    KLSB_MASKS_24(X, 1) KLSB_MASKS_24(X, 2) KLSB_MASKS_24(X, 4) \
+                    KLSB_MASKS_32(X, 1) KLSB_MASKS_32(X, 2) KLSB_MASKS_32(X, 4)
+
+KLSB_ALL(KLSB_KERNEL)
+
+static const LsbLayout klsb_layouts[] = { KLSB_ALL(KLSB_ENTRY) };
+
+/* ---------- dispatch ---------- */
+
+static const char *kernel_names[] = { "auto", "scalar", "sse2", "avx2", "bmi2" };
+
+// check whether the running CPU can execute a kernel
+static int kernel_supported(KernelType type)
+{
+#ifdef LSB_X86
+    __builtin_cpu_init();
+    switch (type)
+    {
+        case e_kernel_sse2: return __builtin_cpu_supports("sse2");
+        case e_kernel_avx2: return __builtin_cpu_supports("avx2");
+        case e_kernel_bmi2: return __builtin_cpu_supports("bmi2");
+        default: break;
+    }
+#endif
+    return type == e_kernel_scalar;
+}
+
+Status lsb_select_kernel(KernelType type)
+{
+    if (type == e_kernel_auto)
+    {
+        // pdep/pext are microcoded on older AMD parts, so AVX2 and SSE2 are preferred over BMI2
+        if (kernel_supported(e_kernel_avx2))
+            type = e_kernel_avx2;
+        else if (kernel_supported(e_kernel_sse2))
+            type = e_kernel_sse2;
+        else if (kernel_supported(e_kernel_bmi2))
+            type = e_kernel_bmi2;
+        else
+            type = e_kernel_scalar;
+    }
+    else if (!kernel_supported(type))
+    {
+        stego_error("%s kernel is not supported on this CPU", kernel_names[type]);
+        return e_failure;
+    }
+
+    switch (type)
+    {
+#ifdef LSB_X86
+        case e_kernel_sse2: lsb_embed = embed_sse2; lsb_extract = extract_sse2; break;
+        case e_kernel_avx2: lsb_embed = embed_avx2; lsb_extract = extract_avx2; break;
+        case e_kernel_bmi2: lsb_embed = embed_bmi2; lsb_extract = extract_bmi2; break;
+#endif
+        default:            lsb_embed = embed_scalar; lsb_extract = extract_scalar; break;
+    }
+
+    selected = type;
+    return e_success;
+}
+
+const char *lsb_kernel_name(void)
+{
+    return kernel_names[selected];
+}
+
+Status lsb_parse_kernel(const char *name, KernelType *type)
+{
+    for (int i = 0; i < (int)(sizeof(kernel_names) / sizeof(kernel_names[0])); i++)
+    {
+        if (strcmp(name, kernel_names[i]) == 0)
+        {
+            *type = (KernelType)i;
+            return e_success;
+        }
+    }
+
+    stego_error("unknown kernel %s (use auto, scalar, sse2, avx2 or bmi2)", name);
+    return e_failure;
+}
+
+// first call through lsb_embed / lsb_extract picks the kernel from cpuid
+static void embed_auto(unsigned char *out, const unsigned char *cover, const unsigned char *data, size_t n)
+{
+    lsb_select_kernel(e_kernel_auto);
+    lsb_embed(out, cover, data, n);
+}
+
+static void extract_auto(const unsigned char *cover, unsigned char *data, size_t n)
+{
+    lsb_select_kernel(e_kernel_auto);
+    lsb_extract(cover, data, n);
+}
+
+// the classic layout goes through whichever SIMD kernel is selected
+static void embed_classic(unsigned char *out, const unsigned char *cover, const unsigned char *data, size_t n)
+{
+    lsb_embed(out, cover, data, n);
+}
+
+static void extract_classic(const unsigned char *cover, unsigned char *data, size_t n)
+{
+    lsb_extract(cover, data, n);
+}
+
+Status lsb_get_layout(int bits, int mask, int bytes_per_pixel, LsbLayout *layout)
+{
+    if (bits != 1 && bits != 2 && bits != 4)
+        return e_failure;
+
+    if (mask != 0)
+    {
+        if (bytes_per_pixel != 3 && bytes_per_pixel != 4)
+            return e_failure;                    // channels only mean something on 24 / 32 bpp pixels
+        if (mask & ~((1 << bytes_per_pixel) - 1))
+            return e_failure;                    // e.g. alpha on a 24 bpp image
+        if (mask == (1 << bytes_per_pixel) - 1)
+            mask = 0;                            // every channel is just every byte
+    }
+    if (mask == 0)
+        bytes_per_pixel = 0;
+
+    if (bits == 1 && mask == 0)
+    {
+        LsbLayout classic = { 1, 0, 0, 8, 1, embed_classic, extract_classic };
+        *layout = classic;
+        return e_success;
+    }
+
+    for (size_t i = 0; i < sizeof(klsb_layouts) / sizeof(klsb_layouts[0]); i++)
+    {
+        if (klsb_layouts[i].bits == bits && klsb_layouts[i].mask == mask &&
+            klsb_layouts[i].bytes_per_pixel == bytes_per_pixel)
+        {
+            *layout = klsb_layouts[i];
+            return e_success;
+        }
+    }
+    return e_failure;
+}
+
+size_t lsb_layout_cover(const LsbLayout *layout, size_t n)
+{
+    return (n + layout->step_data - 1) / layout->step_data * layout->step_cover;
+}
+
+Status lsb_parse_channels(const char *list, int *mask)
+{
+    static const char names[] = "bgra";   // BMP pixel byte order
+    *mask = 0;
+
+    for (const char *c = list; *c != '\0'; c++)
+    {
+        const char *at = strchr(names, *c | 0x20);
+        if (at == NULL)
+        {
+            stego_error("unknown channel '%c' (use b, g, r and a)", *c);
+            return e_failure;
+        }
+        *mask |= 1 << (at - names);
+    }
+
+    if (*mask == 0)
+    {
+        stego_error("no channels given");
+        return e_failure;
+    }
+    return e_success;
+}
@@ -0,0 +1,82 @@
+#ifndef LSB_H
+#define LSB_H
+
+#include <stddef.h>
+#include "types.h"  // Contains user-defined types
+
+/*
+ * LSB embed / extract kernels.
+ * Secret byte i is spread over cover bytes 8*i .. 8*i+7,
+ * bit b of the secret byte going to the LSB of cover byte 8*i+b.
+ * Every kernel produces the same bytes as the scalar one; the
+ * fastest kernel the CPU supports is picked at startup.
+ */
+
+typedef enum
+{
+    e_kernel_auto,
+    e_kernel_scalar,
+    e_kernel_sse2,
+    e_kernel_avx2,
+    e_kernel_bmi2
+} KernelType;
+
+/* Embed n secret bytes: out[0 .. 8n) = cover with LSBs replaced (out may equal cover) */
+typedef void (*LsbEmbedFn)(unsigned char *out, const unsigned char *cover, const unsigned char *data, size_t n);
+
+/* Extract n secret bytes from the LSBs of cover[0 .. 8n) */
+typedef void (*LsbExtractFn)(const unsigned char *cover, unsigned char *data, size_t n);
+
+/*
+ * k-LSB layouts: bits LSBs of every used cover byte carry payload,
+ * optionally only in the channels set in mask (bit c = byte c of a
+ * BMP pixel: 1 blue, 2 green, 4 red, 8 alpha). A layout works in
+ * steps of whole pixels holding a whole number of payload bytes;
+ * each (bits, mask, bytes per pixel) combination has its own
+ * specialised kernel. The 1 bit, every byte layout is the classic
+ * one above and uses the selected SIMD kernel.
+ */
+
+#define LSB_CH_BLUE  1
+#define LSB_CH_GREEN 2
+#define LSB_CH_RED   4
+#define LSB_CH_ALPHA 8
+
+#define LSB_MAX_STEP_DATA 3    // most payload bytes in one layout step
+#define LSB_MAX_STEP_COVER 32  // most cover bytes in one layout step
+
+typedef struct _LsbLayout
+{
+    int bits;               // LSBs used in each cover byte: 1, 2 or 4
+    int mask;               // channels used, 0 for every cover byte
+    int bytes_per_pixel;    // pixel size the mask refers to, 0 without a mask
+    size_t step_cover;      // cover bytes of one kernel step
+    size_t step_data;       // payload bytes of one kernel step
+    LsbEmbedFn embed;       // n counts kernel steps
+    LsbExtractFn extract;
+
+} LsbLayout;
+
+/* Currently selected kernels */
+extern LsbEmbedFn lsb_embed;
+extern LsbExtractFn lsb_extract;
+
+/* Select a kernel, e_kernel_auto picks the best one from cpuid */
+Status lsb_select_kernel(KernelType type);
+
+/* Name of the selected kernel */
+const char *lsb_kernel_name(void);
+
+/* Parse a kernel name given on the command line */
+Status lsb_parse_kernel(const char *name, KernelType *type);
+
+/* Find the kernel for bits per cover byte and channel mask on bytes_per_pixel pixels */
+Status lsb_get_layout(int bits, int mask, int bytes_per_pixel, LsbLayout *layout);
+
+/* Cover bytes needed for n payload bytes (rounded up to whole steps) */
+size_t lsb_layout_cover(const LsbLayout *layout, size_t n);
+
+/* Parse a channel list such as "bgr" or "b" into a mask */
+Status lsb_parse_channels(const char *list, int *mask);
+
+#endif
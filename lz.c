@@ -0,0 +1,155 @@
+#include <stdlib.h>     // for calloc/free
+#include <string.h>     // for memcpy
+#include "lz.h"         // for LZ declarations
+
+#define LZ_LAST_LITERALS 5    // a stream always ends with at least this many literals
+#define LZ_MATCH_LIMIT 12     // no match starts this close to the end of the input
+#define LZ_SKIP_SHIFT 6       // step faster through input that keeps missing
+
+size_t lz_bound(size_t n)
+{
+    return n + n / 255 + 16;
+}
+
+static uint32_t read32(const uint8_t *p)
+{
+    uint32_t v;
+    memcpy(&v, p, 4);
+    return v;
+}
+
+static uint32_t hash4(uint32_t v)
+{
+    return (v * 2654435761u) >> (32 - LZ_HASH_BITS);
+}
+
+// token nibble 15 plus 255-continued length bytes
+static uint8_t *put_length(uint8_t *op, size_t len)
+{
+    for (; len >= 255; len -= 255)
+        *op++ = 255;
+    *op++ = len;
+    return op;
+}
+
+static uint8_t *put_literals(uint8_t *op, uint8_t *token, const uint8_t *lit, size_t n)
+{
+    *token = (n >= 15 ? 15 : n) << 4;
+    if (n >= 15)
+        op = put_length(op, n - 15);
+    memcpy(op, lit, n);
+    return op + n;
+}
+
+size_t lz_compress(const uint8_t *src, size_t n, uint8_t *dst)
+{
+    const uint8_t *ip = src, *anchor = src, *end = src + n;
+    uint8_t *op = dst;
+    size_t *table = n > LZ_MATCH_LIMIT ? calloc(1 << LZ_HASH_BITS, sizeof(size_t)) : NULL;   // input positions, past 4 GiB too
+
+    if (table != NULL)   // without a table (tiny input or no memory) everything is one literal run
+    {
+        const uint8_t *match_end = end - LZ_LAST_LITERALS;
+        const uint8_t *start_limit = end - LZ_MATCH_LIMIT;
+
+        while (ip < start_limit)
+        {
+            uint32_t seq = read32(ip);
+            uint32_t h = hash4(seq);
+            const uint8_t *ref = src + table[h];
+            table[h] = ip - src;
+
+            if (ref >= ip || ip - ref > LZ_MAX_OFFSET || read32(ref) != seq)
+            {
+                ip += 1 + ((ip - anchor) >> LZ_SKIP_SHIFT);
+                continue;
+            }
+
+            while (ip > anchor && ref > src && ip[-1] == ref[-1])   // grow the match backwards
+                ip--, ref--;
+
+            const uint8_t *m = ip + LZ_MIN_MATCH, *r = ref + LZ_MIN_MATCH;
+            while (m < match_end && *m == *r)
+                m++, r++;
+
+            uint8_t *token = op++;
+            size_t match = m - ip - LZ_MIN_MATCH;
+            size_t offset = ip - ref;
+
+            op = put_literals(op, token, anchor, ip - anchor);
+            *token |= match >= 15 ? 15 : match;
+            *op++ = offset;
+            *op++ = offset >> 8;
+            if (match >= 15)
+                op = put_length(op, match - 15);
+
+            ip = anchor = m;
+            if (ip < start_limit)
+                table[hash4(read32(ip - 2))] = ip - 2 - src;
+        }
+        free(table);
+    }
+
+    uint8_t *token = op++;
+    op = put_literals(op, token, anchor, end - anchor);
+    return op - dst;
+}
+
+// read the rest of a length whose nibble was 15
+static Status get_length(const uint8_t **ip, const uint8_t *end, size_t *len)
+{
+    uint8_t b;
+
+    do
+    {
+        if (*ip >= end)
+            return e_failure;
+        b = *(*ip)++;
+        *len += b;
+    } while (b == 255);
+    return e_success;
+}
+
+Status lz_decompress(const uint8_t *src, size_t n, uint8_t *out, size_t out_len)
+{
+    const uint8_t *ip = src, *end = src + n;
+    uint8_t *op = out, *out_end = out + out_len;
+
+    while (ip < end)
+    {
+        unsigned token = *ip++;
+        size_t lit = token >> 4;
+
+        if (lit == 15 && get_length(&ip, end, &lit) == e_failure)
+            return e_failure;
+        if (lit > (size_t)(end - ip) || lit > (size_t)(out_end - op))
+            return e_failure;
+        memcpy(op, ip, lit);
+        op += lit;
+        ip += lit;
+
+        if (ip == end)   // the last sequence has no match
+            break;
+
+        if (end - ip < 2)
+            return e_failure;
+        size_t offset = ip[0] | (ip[1] << 8);
+        size_t match = token & 15;
+        ip += 2;
+        if (match == 15 && get_length(&ip, end, &match) == e_failure)
+            return e_failure;
+        match += LZ_MIN_MATCH;
+
+        if (offset == 0 || offset > (size_t)(op - out) || match > (size_t)(out_end - op))
+            return e_failure;
+
+        const uint8_t *ref = op - offset;
+        if (offset >= match)
+            memcpy(op, ref, match);
+        else
+            for (size_t i = 0; i < match; i++)   // overlapping copy repeats the last offset bytes
+                op[i] = ref[i];
+        op += match;
+    }
+    return op == out_end ? e_success : e_failure;
+}
@@ -0,0 +1,34 @@
+#ifndef LZ_H
+#define LZ_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include "types.h"  // Contains user-defined types
+
+/*
+ * Small LZ77 block codec used to pack secrets before embedding.
+ * The stream is a run of sequences in the LZ4 block layout:
+ *     token | literal length bytes | literals | offset (16 bit) | match length bytes
+ * the token holds 4 bits of literal length and 4 bits of match
+ * length - 4, a nibble of 15 continues in bytes of 255 + a final
+ * byte. The last sequence has literals only. A greedy single hash
+ * table match finder keeps compression fast; decompression checks
+ * every length and offset, so a corrupt stream fails instead of
+ * writing out of bounds.
+ */
+
+#define LZ_MIN_MATCH 4
+#define LZ_MAX_OFFSET 65535
+#define LZ_HASH_BITS 14
+#define LZ_MAX_RATIO 255            // no stream expands to more than this many bytes per input byte
+
+/* Largest stream lz_compress can produce for n input bytes */
+size_t lz_bound(size_t n);
+
+/* Compress n bytes of src into dst (lz_bound(n) bytes), returns the stream length */
+size_t lz_compress(const uint8_t *src, size_t n, uint8_t *dst);
+
+/* Decompress a stream of n bytes that must expand to exactly out_len bytes */
+Status lz_decompress(const uint8_t *src, size_t n, uint8_t *out, size_t out_len);
+
+#endif
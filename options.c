@@ -0,0 +1,321 @@
+#include <stdio.h>      // for printf
+#include <stdarg.h>     // for va_list
+#include <stdlib.h>     // for strtoul
+#include <string.h>     // for strcmp
+#include <unistd.h>     // for dup/dup2
+#include "options.h"    // for option declarations
+#include "parallel.h"   // for MAX_THREADS
+#include "range.h"      // for range_parse
+#include "cipher.h"     // for the key derivation rounds
+
+// set every option to its default value
+void init_options(StegoOptions *opts)
+{
+    memset(opts, 0, sizeof(*opts));
+    opts->block_size = DEFAULT_BLOCK_SIZE;
+    opts->kernel = e_kernel_auto;
+    opts->threads = 0;   // not given: one thread, or one batch worker per CPU
+    opts->bits = 1;      // classic 1 bit per byte layout
+    opts->crc = 1;       // integrity trailer after the data
+}
+
+// release what parse_options allocated, opts can be parsed again afterwards
+void free_options(StegoOptions *opts)
+{
+    free(opts->add_files);
+    opts->add_files = NULL;
+    opts->add_count = 0;
+}
+
+// read a positive number given as the value of an option
+static Status parse_size_value(const char *name, const char *value, size_t *out)
+{
+    char *end;
+
+    if (value == NULL)
+    {
+        printf("Error: %s needs a value\n", name);
+        return e_failure;
+    }
+
+    unsigned long n = strtoul(value, &end, 10);
+    if (end == value || n == 0)
+    {
+        printf("Error: invalid value for %s: %s\n", name, value);
+        return e_failure;
+    }
+
+    if (*end == 'k' || *end == 'K')          // allow 64k, 4M style sizes
+        n *= 1024, end++;
+    else if (*end == 'm' || *end == 'M')
+        n *= 1024 * 1024, end++;
+
+    if (*end != '\0')
+    {
+        printf("Error: invalid value for %s: %s\n", name, value);
+        return e_failure;
+    }
+
+    *out = n;
+    return e_success;
+}
+
+// read a key file for --pass-file, kept for the whole run
+static Status read_key_file(const char *fname, StegoOptions *opts)
+{
+    static unsigned char key[CIPHER_MAX_KEY_FILE + 1];
+    FILE *fptr = fopen(fname, "r");
+    size_t n = fptr != NULL ? fread(key, 1, sizeof(key), fptr) : 0;
+
+    if (fptr != NULL)
+        fclose(fptr);
+    if (n == 0 || n > CIPHER_MAX_KEY_FILE)
+    {
+        printf("Error: key file %s must hold 1 to %d bytes\n", fname, CIPHER_MAX_KEY_FILE);
+        return e_failure;
+    }
+    opts->pass = key;
+    opts->pass_len = n;
+    opts->pass_rounds = CIPHER_FILE_ROUNDS;
+    return e_success;
+}
+
+// pull options out of argv, leaving only the positional arguments behind
+Status parse_options(int *argc, char *argv[], StegoOptions *opts)
+{
+    int out = 2;     // argv[0] is the program and argv[1] the operation
+
+    for (int i = 2; i < *argc; i++)
+    {
+        if (strcmp(argv[i], "-b") == 0 || strcmp(argv[i], "--block-size") == 0)
+        {
+            if (parse_size_value(argv[i], argv[i + 1], &opts->block_size) == e_failure)
+                return e_failure;
+            i++;
+
+            opts->block_size -= opts->block_size % MIN_BLOCK_SIZE;   // keep whole layout steps per block
+            if (opts->block_size < MIN_BLOCK_SIZE)
+                opts->block_size = MIN_BLOCK_SIZE;
+        }
+        else if (strcmp(argv[i], "--kernel") == 0)
+        {
+            if (argv[i + 1] == NULL)
+            {
+                printf("Error: --kernel needs a value\n");
+                return e_failure;
+            }
+            if (lsb_parse_kernel(argv[++i], &opts->kernel) == e_failure)
+                return e_failure;
+        }
+        else if (strcmp(argv[i], "-j") == 0 || strcmp(argv[i], "--threads") == 0)
+        {
+            size_t threads;
+            if (parse_size_value(argv[i], argv[i + 1], &threads) == e_failure)
+                return e_failure;
+            i++;
+            opts->threads = threads > MAX_THREADS ? MAX_THREADS : (int)threads;
+        }
+        else if (strcmp(argv[i], "-m") == 0 || strcmp(argv[i], "--magic") == 0)
+        {
+            if (argv[i + 1] == NULL)
+            {
+                printf("Error: %s needs a value\n", argv[i]);
+                return e_failure;
+            }
+            opts->magic = argv[++i];
+        }
+        else if (strcmp(argv[i], "--bits") == 0)
+        {
+            size_t bits;
+            if (parse_size_value(argv[i], argv[i + 1], &bits) == e_failure)
+                return e_failure;
+            i++;
+            if (bits != 1 && bits != 2 && bits != 4)
+            {
+                printf("Error: --bits must be 1, 2 or 4\n");
+                return e_failure;
+            }
+            opts->bits = bits;
+        }
+        else if (strcmp(argv[i], "--channels") == 0)
+        {
+            if (argv[i + 1] == NULL)
+            {
+                printf("Error: --channels needs a value\n");
+                return e_failure;
+            }
+            if (lsb_parse_channels(argv[++i], &opts->channels) == e_failure)
+                return e_failure;
+        }
+        else if (strcmp(argv[i], "--mmap") == 0)
+        {
+            opts->use_mmap = 1;
+        }
+        else if (strcmp(argv[i], "-q") == 0 || strcmp(argv[i], "--quiet") == 0)
+        {
+            opts->quiet = 1;
+        }
+        else if (strcmp(argv[i], "--stats") == 0)
+        {
+            opts->stats = 1;
+        }
+        else if (strcmp(argv[i], "--size") == 0)
+        {
+            if (parse_size_value(argv[i], argv[i + 1], &opts->secret_size) == e_failure)
+                return e_failure;
+            i++;
+        }
+        else if (strcmp(argv[i], "--in-place") == 0)
+        {
+            opts->in_place = 1;
+        }
+        else if (strcmp(argv[i], "--uring") == 0)
+        {
+            opts->uring = 1;
+        }
+        else if (strcmp(argv[i], "--add") == 0)
+        {
+            if (argv[i + 1] == NULL)
+            {
+                printf("Error: --add needs a file name\n");
+                return e_failure;
+            }
+            char **grown = realloc(opts->add_files, (opts->add_count + 1) * sizeof(char *));   // released by free_options
+            if (grown == NULL)
+                return e_failure;
+            opts->add_files = grown;
+            opts->add_files[opts->add_count++] = argv[++i];
+        }
+        else if (strcmp(argv[i], "--list") == 0)
+        {
+            opts->list = 1;
+        }
+        else if (strcmp(argv[i], "--entry") == 0)
+        {
+            if (argv[i + 1] == NULL || argv[i + 1][0] == '\0')
+            {
+                printf("Error: --entry needs a file name\n");
+                return e_failure;
+            }
+            opts->entry = argv[++i];
+        }
+        else if (strcmp(argv[i], "--pass") == 0)
+        {
+            if (argv[i + 1] == NULL || argv[i + 1][0] == '\0')
+            {
+                printf("Error: --pass needs a passphrase\n");
+                return e_failure;
+            }
+            opts->pass = (const unsigned char *)argv[++i];
+            opts->pass_len = strlen(argv[i]);
+            opts->pass_rounds = CIPHER_PASS_ROUNDS;   // slow on purpose, passphrases are guessable
+        }
+        else if (strcmp(argv[i], "--pass-file") == 0)
+        {
+            if (argv[i + 1] == NULL)
+            {
+                printf("Error: --pass-file needs a file name\n");
+                return e_failure;
+            }
+            if (read_key_file(argv[++i], opts) == e_failure)
+                return e_failure;
+        }
+        else if (strcmp(argv[i], "--no-crc") == 0)
+        {
+            opts->crc = 0;   // classic payload without the CRC32C trailer
+        }
+        else if (strcmp(argv[i], "-z") == 0 || strcmp(argv[i], "--compress") == 0)
+        {
+            opts->compress = 1;
+        }
+        else if (strcmp(argv[i], "--chunk") == 0)
+        {
+            if (parse_size_value(argv[i], argv[i + 1], &opts->chunk_size) == e_failure)
+                return e_failure;
+            i++;
+            opts->compress = 1;   // chunks only exist in packed payloads
+        }
+        else if (strcmp(argv[i], "--range") == 0)
+        {
+            if (argv[i + 1] == NULL || range_parse(argv[i + 1], &opts->range_off, &opts->range_len) == e_failure)
+            {
+                printf("Error: --range needs off:len, e.g. 4k:1M\n");
+                return e_failure;
+            }
+            i++;
+            opts->has_range = 1;
+        }
+        else if (strcmp(argv[i], "--key") == 0)
+        {
+            if (argv[i + 1] == NULL || argv[i + 1][0] == '\0')
+            {
+                printf("Error: --key needs a value\n");
+                return e_failure;
+            }
+            opts->key = argv[++i];
+        }
+        else
+        {
+            argv[out++] = argv[i];   // positional argument, keep it
+        }
+    }
+
+    argv[out] = NULL;   // callers test argv[n] != NULL for optional names
+    *argc = out;
+    return e_success;
+}
+
+// progress output of the encode / decode stages
+void print_status(const StegoOptions *opts, const char *fmt, ...)
+{
+    va_list args;
+
+    if (opts->quiet)
+        return;
+
+    va_start(args, fmt);
+    vprintf(fmt, args);
+    va_end(args);
+}
+
+static _Thread_local const char *error_label;   // set by a batch job on its worker
+
+void print_error(const char *fmt, ...)
+{
+    char msg[1024];
+    va_list args;
+
+    va_start(args, fmt);
+    vsnprintf(msg, sizeof(msg), fmt, args);
+    va_end(args);
+    printf("Error: %s%s", error_label != NULL ? error_label : "", msg);   // one call, so lines of side-by-side jobs do not mix
+}
+
+void print_library_error(const char *msg)
+{
+    print_error("%s\n", msg);
+}
+
+void set_error_label(const char *label)
+{
+    error_label = label;
+}
+
+const char *get_error_label(void)
+{
+    return error_label;
+}
+
+int is_stdio_name(const char *fname)
+{
+    return fname != NULL && strcmp(fname, STDIO_NAME) == 0;
+}
+
+FILE *stdout_for_data(void)
+{
+    // messages still buffered in stdout are written after the switch, so they land on stderr too
+    int fd = dup(STDOUT_FILENO);   // the data keeps the original stdout
+    if (fd < 0 || dup2(STDERR_FILENO, STDOUT_FILENO) < 0)
+        return NULL;
+    return fdopen(fd, "w");
+}
@@ -0,0 +1,80 @@
+#ifndef OPTIONS_H
+#define OPTIONS_H
+
+#include <stddef.h>
+#include "types.h"  // Contains user-defined types
+#include "lsb.h"    // Contains kernel types
+
+/*
+ * Command-line options shared by encoding and decoding.
+ * Options may appear anywhere after the -e / -d selector;
+ * parse_options() removes them from argv so the positional
+ * file names keep their usual argv[2], argv[3], argv[4] slots.
+ */
+
+#define DEFAULT_BLOCK_SIZE (64 * 1024)   // cover bytes moved per block read/write
+#define MIN_BLOCK_SIZE 32                // widest k-LSB layout step in cover bytes
+#define STDIO_NAME "-"                   // file name for stdin (inputs) or stdout (outputs)
+
+typedef struct _StegoOptions
+{
+    size_t block_size;   // size of the pixel block used by the block engine
+    KernelType kernel;   // embed/extract kernel, auto picks from cpuid
+    int use_mmap;        // memory map the images instead of streaming blocks
+    int threads;         // worker threads for the data section and tail copy
+    const char *magic;   // magic string, NULL to prompt for it
+    int quiet;           // suppress the per-stage progress messages (-q)
+    int stats;           // print per-stage timings and I/O as JSON (--stats)
+    int compress;        // LZ pack the secret before embedding (-z)
+    size_t chunk_size;   // pack in chunks of this many bytes behind a chunk table, 0 for one stream (--chunk)
+    int has_range;       // decode only part of the payload (--range)
+    size_t range_off;    // first payload byte to decode
+    size_t range_len;    // payload bytes to decode, (size_t)-1 for the rest
+    const char *key;     // scatter the data over keyed pixel blocks (--key), NULL to keep it linear
+    int crc;             // store a CRC32C of the data after it, on unless --no-crc
+    size_t secret_size;  // length of a secret read from a pipe (--size), 0 to buffer it whole first
+    int in_place;        // embed into the cover itself, only the payload bytes are rewritten (--in-place)
+    int uring;           // batch: read and write the images through io_uring (--uring)
+    char **add_files;    // more files embedded next to the secret in a container (--add), NULL for none
+    int add_count;       // number of add_files
+    int list;            // print the directory of a container instead of decoding (--list)
+    const char *entry;   // file of a container to decode (--entry), NULL for none
+    const unsigned char *pass;   // passphrase (--pass) or key file bytes (--pass-file) the data is encrypted with, NULL for none
+    size_t pass_len;             // bytes of pass
+    unsigned pass_rounds;        // PBKDF2 iterations the key is derived with
+    int bits;            // LSBs used per cover byte when encoding: 1, 2 or 4
+    int channels;        // channel mask used when encoding, 0 for every byte
+
+} StegoOptions;
+
+/* Fill options with their default values */
+void init_options(StegoOptions *opts);
+
+/* Strip recognised options out of argv and store them in opts */
+Status parse_options(int *argc, char *argv[], StegoOptions *opts);
+
+/* Release the memory parse_options allocated (the --add list), also after it failed */
+void free_options(StegoOptions *opts);
+
+/* printf for progress messages, silent when opts->quiet is set */
+void print_status(const StegoOptions *opts, const char *fmt, ...);
+
+/* printf for errors: "Error: ", the calling thread's label, then the message, as one write */
+void print_error(const char *fmt, ...) __attribute__((format(printf, 1, 2)));
+
+/* libstego error handler (see stego_set_error_handler): print_error for its messages */
+void print_library_error(const char *msg);
+
+/* Label put in front of the calling thread's errors (a batch job's manifest line and cover), NULL for none */
+void set_error_label(const char *label);
+
+/* The calling thread's label, for threads started on its behalf */
+const char *get_error_label(void);
+
+/* Whether a file name given on the command line means stdin / stdout */
+int is_stdio_name(const char *fname);
+
+/* Stream for output data written to stdout; messages printed from here on go to stderr */
+FILE *stdout_for_data(void);
+
+#endif
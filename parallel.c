@@ -0,0 +1,264 @@
+#include <stdio.h>      // for printf/fileno
+#include <stdlib.h>     // for malloc/free
+#include <string.h>     // for memcpy
+#include <unistd.h>     // for pread/pwrite
+#include <pthread.h>    // for worker threads
+#include <sys/stat.h>   // for fstat
+#include "parallel.h"   // for parallel declarations
+#include "lsb.h"        // for the embed/extract kernels
+#include "crc32c.h"     // for the data CRC of each range
+#include "copy.h"       // for kernel copies of the tail
+
+#define RANGE_ALIGN 64  // worker ranges start on whole cache lines of layout steps
+
+typedef enum
+{
+    e_job_embed,
+    e_job_extract,
+    e_job_copy
+} JobKind;
+
+typedef struct _Worker
+{
+    BlockIO *io;        // shared engine, only its files and mappings are used
+    JobKind kind;
+    int fd_src;         // cover / stego image being read
+    int fd_dest;        // stego image being written (embed and copy)
+    int fd_data;        // secret file (embed) or output file (extract)
+    long data_off;      // image offset of secret byte 0
+    long first;         // first secret byte (or image byte for copy) of this worker
+    long count;         // number of bytes in this worker's range
+    uint32_t crc;       // CRC32C of the range (embed and extract)
+    Status status;
+    pthread_t thread;
+
+} Worker;
+
+// read exactly len bytes at offset
+static Status pread_full(int fd, void *buf, size_t len, long offset)
+{
+    while (len > 0)
+    {
+        ssize_t n = pread(fd, buf, len, offset);
+        if (n <= 0)
+            return e_failure;
+        buf = (char *)buf + n;
+        len -= n;
+        offset += n;
+    }
+    return e_success;
+}
+
+// write exactly len bytes at offset
+static Status pwrite_full(int fd, const void *buf, size_t len, long offset)
+{
+    while (len > 0)
+    {
+        ssize_t n = pwrite(fd, buf, len, offset);
+        if (n <= 0)
+            return e_failure;
+        buf = (const char *)buf + n;
+        len -= n;
+        offset += n;
+    }
+    return e_success;
+}
+
+// embed or extract one worker's range of secret bytes, a block at a time; each piece
+// runs through its own block engine over the pixel buffer (or the mappings) so row
+// padding and steps running over a row end are handled exactly as in the main engine
+static Status run_data_range(Worker *w, unsigned char *pixels, unsigned char *secret, size_t chunk)
+{
+    BlockIO *io = w->io;
+    const LsbLayout *layout = &io->layout;
+
+    for (long i = w->first; i < w->first + w->count; i += chunk)
+    {
+        long n = w->first + w->count - i < (long)chunk ? w->first + w->count - i : (long)chunk;
+        size_t steps = (n + layout->step_data - 1) / layout->step_data;   // the last one may be padded
+        long from = i == 0 ? w->data_off   // may sit on row padding, which the engine then passes over
+                           : bmp_advance(&io->rows, w->data_off, i / layout->step_data * layout->step_cover);
+        long to = bmp_advance(&io->rows, from, steps * layout->step_cover);
+        BlockIO part = {0};
+
+        if (io->map_src != NULL)
+            block_attach(&part, io->map_src, w->kind == e_job_embed ? io->map_dest : NULL, io->len, from);
+        else
+        {
+            if (pread_full(w->fd_src, pixels, to - from, from) == e_failure)
+                return e_failure;
+            block_attach(&part, pixels, w->kind == e_job_embed ? pixels : NULL, to - from, 0);
+            part.base = from;   // image offset of pixels[0]
+        }
+        part.layout = *layout;
+        part.rows = io->rows;
+        part.cipher = io->cipher;
+        block_cipher_at(&part, i);   // keystream from secret byte i on
+
+        if (w->kind == e_job_embed)
+        {
+            if (pread_full(w->fd_data, secret, n, i) == e_failure ||
+                block_embed(&part, (char *)secret, n) == e_failure || block_align_step(&part) == e_failure)
+                return e_failure;
+            w->crc = crc32c(w->crc, secret, n);
+            if (io->map_src == NULL && pwrite_full(w->fd_dest, pixels, to - from, from) == e_failure)
+                return e_failure;
+        }
+        else
+        {
+            if (block_extract(&part, (char *)secret, n) == e_failure ||
+                pwrite_full(w->fd_data, secret, n, i) == e_failure)
+                return e_failure;
+            w->crc = crc32c(w->crc, secret, n);
+        }
+    }
+    return e_success;
+}
+
+// copy one worker's range of untouched image bytes
+static Status run_copy_range(Worker *w)
+{
+    BlockIO *io = w->io;
+
+    if (io->map_src != NULL)
+    {
+        if (io->map_dest != io->map_src)   // a mapped stego image is a copy of the cover already
+            memcpy(io->map_dest + w->first, io->map_src + w->first, w->count);
+        return e_success;
+    }
+    return copy_fd_range(w->fd_src, w->fd_dest, w->first, w->count);   // in the kernel, explicit offsets keep the threads apart
+}
+
+static void *worker_main(void *arg)
+{
+    Worker *w = arg;
+    const BmpRows *rows = &w->io->rows;
+    size_t block_size = w->io->block_size;
+    size_t chunk = block_payload_size(w->io);              // whole layout steps per block
+    size_t padding = (block_size / rows->row_bytes + 2) * (rows->stride - rows->row_bytes);   // rows a block can cross
+    unsigned char *pixels = malloc(block_size + padding);  // per-worker pixel block
+    unsigned char *secret = malloc(chunk + LSB_MAX_STEP_DATA);   // per-worker secret chunk, room to pad a step
+
+    if (pixels == NULL || secret == NULL)
+        w->status = e_failure;
+    else if (w->kind == e_job_copy)
+        w->status = run_copy_range(w);
+    else
+        w->status = run_data_range(w, pixels, secret, chunk);
+
+    free(pixels);
+    free(secret);
+    return NULL;
+}
+
+// split total bytes into one range per thread, a multiple of align bytes, and wait for all of them;
+// proto->crc receives the CRC32C of the ranges joined in order
+static Status run_workers(Worker *proto, long first, long total, int threads, long align)
+{
+    Worker workers[MAX_THREADS];
+
+    if (threads > MAX_THREADS)
+        threads = MAX_THREADS;
+
+    long per = (total + threads - 1) / threads;
+    per = (per + align - 1) / align * align;
+
+    int started = 0;
+    Status status = e_success;
+    for (long at = 0; at < total; at += per)
+    {
+        Worker *w = &workers[started];
+        *w = *proto;
+        w->first = first + at;
+        w->count = total - at < per ? total - at : per;
+        w->crc = 0;
+        w->status = e_success;
+
+        if (pthread_create(&w->thread, NULL, worker_main, w) != 0)
+        {
+            printf("Error: unable to start worker thread\n");
+            status = e_failure;
+            break;
+        }
+        started++;
+    }
+
+    proto->crc = 0;
+    for (int i = 0; i < started; i++)
+    {
+        pthread_join(workers[i].thread, NULL);
+        if (workers[i].status == e_failure)
+            status = e_failure;
+        proto->crc = crc32c_combine(proto->crc, workers[i].crc, workers[i].count);
+    }
+    return status;
+}
+
+// fill the fields every worker shares
+static void init_worker(Worker *w, BlockIO *io, JobKind kind, long data_off)
+{
+    memset(w, 0, sizeof(*w));
+    w->io = io;
+    w->kind = kind;
+    w->fd_src = fileno(io->fptr_src);
+    w->fd_dest = io->fptr_dest != NULL ? fileno(io->fptr_dest) : -1;
+    w->data_off = data_off;
+}
+
+Status parallel_embed(BlockIO *io, int fd_secret, long size, long data_off, int threads, uint32_t *crc)
+{
+    Worker proto;
+
+    if (block_flush(io) == e_failure)   // header fields must land before the workers write
+        return e_failure;
+    if (io->fptr_dest != NULL)
+        fflush(io->fptr_dest);
+
+    init_worker(&proto, io, e_job_embed, data_off);
+    proto.fd_data = fd_secret;
+
+    if (run_workers(&proto, 0, size, threads, RANGE_ALIGN * io->layout.step_data) == e_failure)
+    {
+        printf("Error: parallel embedding failed\n");
+        return e_failure;
+    }
+    *crc = proto.crc;
+    return block_seek(io, bmp_advance(&io->rows, data_off, lsb_layout_cover(&io->layout, size)));   // continue after the data section
+}
+
+Status parallel_extract(BlockIO *io, int fd_out, long size, long data_off, int threads, uint32_t *crc)
+{
+    Worker proto;
+
+    init_worker(&proto, io, e_job_extract, data_off);
+    proto.fd_data = fd_out;
+
+    if (run_workers(&proto, 0, size, threads, RANGE_ALIGN * io->layout.step_data) == e_failure)
+    {
+        printf("Error: parallel extraction failed\n");
+        return e_failure;
+    }
+    *crc = proto.crc;
+    return block_seek(io, bmp_advance(&io->rows, data_off, lsb_layout_cover(&io->layout, size)));
+}
+
+Status parallel_copy_tail(BlockIO *io, int threads)
+{
+    Worker proto;
+    struct stat st;
+
+    if (block_flush(io) == e_failure || fstat(fileno(io->fptr_src), &st) != 0)
+        return e_failure;
+    long from = block_offset(io);   // first byte no stage has written yet
+    if (io->fptr_dest != NULL)
+        fflush(io->fptr_dest);
+
+    init_worker(&proto, io, e_job_copy, 0);
+
+    if (run_workers(&proto, from, st.st_size - from, threads, RANGE_ALIGN) == e_failure)
+    {
+        printf("Error: parallel tail copy failed\n");
+        return e_failure;
+    }
+    return e_success;
+}
@@ -0,0 +1,31 @@
+#ifndef PARALLEL_H
+#define PARALLEL_H
+
+#include "types.h"  // Contains user-defined types
+#include "block.h"  // Contains the block engine
+
+/*
+ * Multithreaded embed / extract of the secret data section.
+ * Secret byte i always lives in layout step i / step_data after data_off
+ * (counting pixel bytes only, row padding is skipped),
+ * so the data section is cut into one contiguous range per thread.
+ * Every worker has its own block buffers and uses pread/pwrite
+ * (or the mappings when the block engine is memory mapped).
+ * Each worker checksums its range, and the CRC32Cs are joined in
+ * order, so the data CRC costs no extra pass.
+ * With a cipher on the engine every piece starts the keystream at
+ * its own first secret byte, so encrypted ranges split the same way.
+ */
+
+#define MAX_THREADS 256
+
+/* Embed size bytes of fd_secret into the cover bytes starting at data_off, *crc receives their CRC32C */
+Status parallel_embed(BlockIO *io, int fd_secret, long size, long data_off, int threads, uint32_t *crc);
+
+/* Extract size bytes from the cover bytes starting at data_off into fd_out, *crc receives their CRC32C */
+Status parallel_extract(BlockIO *io, int fd_out, long size, long data_off, int threads, uint32_t *crc);
+
+/* Copy the cover bytes from block_offset(io) to the end of the image, one kernel copy per thread */
+Status parallel_copy_tail(BlockIO *io, int threads);
+
+#endif
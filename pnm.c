@@ -0,0 +1,152 @@
+#include <string.h>     // for memcmp
+#include <ctype.h>      // for isspace/isdigit
+#include "pnm.h"        // for PPM/PAM declarations
+#include "cover.h"      // for cover_short
+
+#define PNM_MAX_DIM 0x7fffffff   // widths and heights fit the int32_t of BmpInfo
+
+// move *pos past whitespace and '#' comments, 0 when the header runs out first
+static int skip_space(const uint8_t *header, size_t len, size_t *pos)
+{
+    while (*pos < len)
+    {
+        if (header[*pos] == '#')   // a comment runs to the end of its line
+        {
+            while (*pos < len && header[*pos] != '\n')
+                (*pos)++;
+        }
+        else if (isspace(header[*pos]))
+            (*pos)++;
+        else
+            return 1;
+    }
+    return 0;
+}
+
+// decimal number at *pos, stopping at end; -1 when there are no digits or it is too large
+static long get_number(const uint8_t *header, size_t end, size_t *pos)
+{
+    size_t start = *pos;
+    long value = 0;
+
+    for (; *pos < end && isdigit(header[*pos]); (*pos)++)
+    {
+        value = value * 10 + (header[*pos] - '0');
+        if (value > PNM_MAX_DIM)
+            return -1;
+    }
+    return *pos > start ? value : -1;
+}
+
+// fill the geometry of a top-down, unpadded pixel array of depth 8-bit samples per pixel
+static const char *set_geometry(BmpInfo *info, CoverFormat format, size_t pixel_offset,
+                                long width, long height, long depth, long maxval)
+{
+    if (width <= 0 || height <= 0 || depth <= 0 || maxval <= 0)
+        return format == e_cover_ppm ? "corrupt PPM header" : "corrupt PAM header";
+    if (maxval != PNM_MAXVAL)
+        return maxval > PNM_MAXVAL ? "PPM and PAM images with 16-bit samples are not supported"
+                                   : "PPM and PAM images need a maxval of 255";
+    if (depth > 4)
+        return "unsupported PAM depth";
+
+    info->format = format;
+    info->header_len = pixel_offset;
+    info->file_size = 0;
+    info->pixel_offset = pixel_offset;
+    info->dib_size = 0;
+    info->width = width;
+    info->height = height;
+    info->top_down = 1;
+    info->bits_per_pixel = depth * 8;
+    info->compression = 0;
+    info->rows = height;
+    info->row_bytes = (size_t)width * depth;
+    info->stride = info->row_bytes;   // no row padding
+    return NULL;
+}
+
+// P6: width, height and maxval, then a single whitespace byte before the pixels
+static const char *parse_ppm(const uint8_t *header, size_t len, BmpInfo *info)
+{
+    long field[3];
+    size_t pos = COVER_MAGIC_LEN;
+
+    for (int i = 0; i < 3; i++)
+    {
+        if (pos == len)
+            return cover_short;
+        if (header[pos] != '#' && !isspace(header[pos]))   // fields are kept apart by whitespace or comments
+            return "corrupt PPM header";
+        if (!skip_space(header, len, &pos))
+            return cover_short;
+        field[i] = get_number(header, len, &pos);
+        if (pos == len)   // the digits may go on
+            return cover_short;
+        if (field[i] < 0)
+            return "corrupt PPM header";
+    }
+    if (!isspace(header[pos]))
+        return "corrupt PPM header";
+    return set_geometry(info, e_cover_ppm, pos + 1, field[0], field[1], 3, field[2]);
+}
+
+// P7: "KEY value" lines up to ENDHDR
+static const char *parse_pam(const uint8_t *header, size_t len, BmpInfo *info)
+{
+    static const char *const keys[] = { "WIDTH", "HEIGHT", "DEPTH", "MAXVAL" };
+    long field[4] = { -1, -1, -1, -1 };
+    size_t pos = COVER_MAGIC_LEN;
+
+    if (pos == len)
+        return cover_short;
+    if (header[pos] != '\n')
+        return "corrupt PAM header";
+
+    for (pos++;;)
+    {
+        const uint8_t *nl = memchr(header + pos, '\n', len - pos);
+        if (nl == NULL)   // the line goes on
+            return cover_short;
+        size_t end = nl - header;
+
+        while (pos < end && (header[pos] == ' ' || header[pos] == '\t'))
+            pos++;
+        if (end - pos == 6 && memcmp(header + pos, "ENDHDR", 6) == 0)
+            return set_geometry(info, e_cover_pam, end + 1, field[0], field[1], field[2], field[3]);
+
+        for (int i = 0; i < 4; i++)
+        {
+            size_t key_len = strlen(keys[i]);
+            if (end - pos > key_len && memcmp(header + pos, keys[i], key_len) == 0 && isspace(header[pos + key_len]))
+            {
+                pos += key_len;
+                while (pos < end && isspace(header[pos]))
+                    pos++;
+                field[i] = get_number(header, end, &pos);
+                if (field[i] < 0)
+                    return "corrupt PAM header";
+                break;
+            }
+        }
+        pos = end + 1;   // comments, TUPLTYPE and anything else are passed over
+    }
+}
+
+const char *pnm_parse_header(const uint8_t *header, size_t len, BmpInfo *info)
+{
+    const char *why;
+
+    if (len < COVER_MAGIC_LEN)
+        why = cover_short;
+    else if (header[0] == 'P' && header[1] == '6')
+        why = parse_ppm(header, len, info);
+    else if (header[0] == 'P' && header[1] == '7')
+        why = parse_pam(header, len, info);
+    else
+        return "not a PPM or PAM image";
+
+    if (why == cover_short)
+        info->header_len = len + 1;   // text headers are read a byte at a time
+    return why;
+}
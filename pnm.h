@@ -0,0 +1,26 @@
+#ifndef PNM_H
+#define PNM_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include "bmp.h"    // Contains the pixel row geometry
+
+/*
+ * Binary PPM (P6) and PAM (P7) covers.
+ * A PPM header is "P6", the width, the height and the maxval as
+ * decimal text separated by whitespace or '#' comments, then one
+ * whitespace byte; a PAM header is "P7" and one "KEY value" line
+ * each for WIDTH, HEIGHT, DEPTH and MAXVAL (TUPLTYPE is ignored) up
+ * to an ENDHDR line. Pixels follow top row first with no padding,
+ * PPM in RGB order, PAM with DEPTH samples per pixel. Only 8-bit
+ * samples with a maxval of 255 are used: a lower maxval would be
+ * broken by a changed low bit.
+ */
+
+#define PNM_MAXVAL 255   // the only maxval an LSB may change freely
+
+/* Parse the first len bytes of a PPM or PAM image, returns NULL or why it cannot be
+   used (cover_short with info->header_len bytes asked for when the header runs on) */
+const char *pnm_parse_header(const uint8_t *header, size_t len, BmpInfo *info);
+
+#endif
@@ -0,0 +1,199 @@
+#include <stdio.h>      // for printf
+#include <stdlib.h>     // for malloc/free
+#include "pool.h"       // for thread pool declarations
+
+#define DEQUE_INITIAL_CAP 64
+
+typedef struct _PoolWorker
+{
+    ThreadPool *pool;
+    int index;
+} PoolWorker;
+
+// push a task at the bottom of a deque, growing it when full
+static Status deque_push(PoolDeque *dq, PoolTask task)
+{
+    pthread_mutex_lock(&dq->lock);
+    if (dq->bottom - dq->top == dq->cap)
+    {
+        int cap = dq->cap ? dq->cap * 2 : DEQUE_INITIAL_CAP;
+        PoolTask *tasks = malloc(cap * sizeof(PoolTask));
+        if (tasks == NULL)
+        {
+            pthread_mutex_unlock(&dq->lock);
+            return e_failure;
+        }
+        for (int i = dq->top; i < dq->bottom; i++)
+            tasks[i - dq->top] = dq->tasks[i % dq->cap];
+
+        free(dq->tasks);
+        dq->tasks = tasks;
+        dq->bottom -= dq->top;
+        dq->top = 0;
+        dq->cap = cap;
+    }
+    dq->tasks[dq->bottom % dq->cap] = task;
+    dq->bottom++;
+    pthread_mutex_unlock(&dq->lock);
+    return e_success;
+}
+
+// owner takes its newest task (bottom), thieves take the oldest one (top)
+static int deque_take(PoolDeque *dq, PoolTask *task, int steal)
+{
+    int found = 0;
+
+    pthread_mutex_lock(&dq->lock);
+    if (dq->bottom > dq->top)
+    {
+        if (steal)
+            *task = dq->tasks[dq->top++ % dq->cap];
+        else
+            *task = dq->tasks[--dq->bottom % dq->cap];
+        found = 1;
+    }
+    pthread_mutex_unlock(&dq->lock);
+    return found;
+}
+
+// look in our own deque first, then steal round the others
+static int find_task(ThreadPool *pool, int self, PoolTask *task)
+{
+    if (deque_take(&pool->deques[self], task, 0))
+        return 1;
+
+    for (int i = 1; i < pool->workers; i++)
+        if (deque_take(&pool->deques[(self + i) % pool->workers], task, 1))
+            return 1;
+
+    return 0;
+}
+
+static void *worker_loop(void *arg)
+{
+    PoolWorker *me = arg;
+    ThreadPool *pool = me->pool;
+    PoolTask task;
+
+    while (1)
+    {
+        pthread_mutex_lock(&pool->lock);
+        while (pool->queued == 0 && !pool->shutdown)
+            pthread_cond_wait(&pool->work, &pool->lock);
+        if (pool->queued == 0 && pool->shutdown)
+        {
+            pthread_mutex_unlock(&pool->lock);
+            break;
+        }
+        pool->queued--;    // claim one task, it is already sitting in some deque
+        pthread_mutex_unlock(&pool->lock);
+
+        while (!find_task(pool, me->index, &task))
+            ;              // only racing claimants can hide it for a moment
+
+        task.fn(task.arg, me->index);
+
+        pthread_mutex_lock(&pool->lock);
+        if (--pool->pending == 0)
+            pthread_cond_broadcast(&pool->idle);
+        pthread_mutex_unlock(&pool->lock);
+    }
+
+    free(me);
+    return NULL;
+}
+
+Status pool_init(ThreadPool *pool, int workers)
+{
+    pool->workers = workers;
+    pool->queued = 0;
+    pool->pending = 0;
+    pool->next = 0;
+    pool->shutdown = 0;
+    pool->deques = calloc(workers, sizeof(PoolDeque));
+    pool->threads = calloc(workers, sizeof(pthread_t));
+    if (pool->deques == NULL || pool->threads == NULL)
+    {
+        printf("Error: unable to allocate thread pool\n");
+        free(pool->deques);
+        free(pool->threads);
+        return e_failure;
+    }
+
+    pthread_mutex_init(&pool->lock, NULL);
+    pthread_cond_init(&pool->work, NULL);
+    pthread_cond_init(&pool->idle, NULL);
+
+    for (int i = 0; i < workers; i++)
+        pthread_mutex_init(&pool->deques[i].lock, NULL);
+
+    for (int i = 0; i < workers; i++)
+    {
+        PoolWorker *me = malloc(sizeof(PoolWorker));
+        if (me != NULL)
+        {
+            me->pool = pool;
+            me->index = i;
+        }
+        if (me == NULL || pthread_create(&pool->threads[i], NULL, worker_loop, me) != 0)
+        {
+            printf("Error: unable to start pool worker\n");
+            free(me);
+            pool->workers = i;      // only join the ones that started
+            pool_destroy(pool);
+            return e_failure;
+        }
+    }
+    return e_success;
+}
+
+Status pool_submit(ThreadPool *pool, PoolTaskFn fn, void *arg)
+{
+    PoolTask task = { fn, arg };
+    Status status;
+
+    pthread_mutex_lock(&pool->lock);   // push and count together so workers never see a task uncounted
+    status = deque_push(&pool->deques[pool->next], task);
+    if (status == e_success)
+    {
+        pool->next = (pool->next + 1) % pool->workers;
+        pool->pending++;
+        pool->queued++;
+        pthread_cond_signal(&pool->work);
+    }
+    pthread_mutex_unlock(&pool->lock);
+
+    if (status == e_failure)
+        printf("Error: unable to queue task\n");
+    return status;
+}
+
+void pool_wait(ThreadPool *pool)
+{
+    pthread_mutex_lock(&pool->lock);
+    while (pool->pending > 0)
+        pthread_cond_wait(&pool->idle, &pool->lock);
+    pthread_mutex_unlock(&pool->lock);
+}
+
+void pool_destroy(ThreadPool *pool)
+{
+    pthread_mutex_lock(&pool->lock);
+    pool->shutdown = 1;
+    pthread_cond_broadcast(&pool->work);
+    pthread_mutex_unlock(&pool->lock);
+
+    for (int i = 0; i < pool->workers; i++)
+        pthread_join(pool->threads[i], NULL);
+
+    for (int i = 0; i < pool->workers; i++)
+    {
+        free(pool->deques[i].tasks);
+        pthread_mutex_destroy(&pool->deques[i].lock);
+    }
+    pthread_mutex_destroy(&pool->lock);
+    pthread_cond_destroy(&pool->work);
+    pthread_cond_destroy(&pool->idle);
+    free(pool->deques);
+    free(pool->threads);
+}
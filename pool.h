@@ -0,0 +1,60 @@
+#ifndef POOL_H
+#define POOL_H
+
+#include <pthread.h>
+#include "types.h"  // Contains user-defined types
+
+/*
+ * Work-stealing thread pool.
+ * Every worker owns a deque: it pushes and pops its own tasks at
+ * the bottom and, when it runs dry, steals from the top of the
+ * other workers' deques. Tasks get the index of the worker that
+ * runs them so callers can keep per-worker reusable buffers.
+ */
+
+typedef void (*PoolTaskFn)(void *arg, int worker);
+
+typedef struct _PoolTask
+{
+    PoolTaskFn fn;
+    void *arg;
+} PoolTask;
+
+typedef struct _PoolDeque
+{
+    PoolTask *tasks;         // ring of tasks
+    int cap;                 // allocated slots
+    int top;                 // oldest task, thieves take from here
+    int bottom;              // one past the newest task, owner works here
+    pthread_mutex_t lock;
+} PoolDeque;
+
+typedef struct _ThreadPool
+{
+    int workers;             // number of worker threads
+    PoolDeque *deques;       // one deque per worker
+    pthread_t *threads;
+
+    pthread_mutex_t lock;    // protects the counters below
+    pthread_cond_t work;     // signalled when a task is queued or on shutdown
+    pthread_cond_t idle;     // signalled when the last pending task finished
+    int queued;              // tasks sitting in deques
+    int pending;             // tasks queued or running
+    int next;                // deque the next submitted task goes to
+    int shutdown;
+
+} ThreadPool;
+
+/* Start a pool with the given number of workers */
+Status pool_init(ThreadPool *pool, int workers);
+
+/* Queue a task, tasks are spread round robin over the worker deques */
+Status pool_submit(ThreadPool *pool, PoolTaskFn fn, void *arg);
+
+/* Block until every submitted task has finished */
+void pool_wait(ThreadPool *pool);
+
+/* Stop the workers and free the pool */
+void pool_destroy(ThreadPool *pool);
+
+#endif
@@ -0,0 +1,216 @@
+#include <stdlib.h>     // for malloc/strtoul
+#include <string.h>     // for memcpy
+#include "range.h"      // for range declarations
+#include "stego.h"      // for the packed payload layout
+#include "lz.h"         // for unpacking chunks
+#include "varint.h"     // for version 2 chunk headers
+
+#define RANGE_COPY_SIZE (64 * 1024)   // plain payload bytes handed out per write call
+
+static uint32_t get_le32(const unsigned char *p)
+{
+    return p[0] | (p[1] << 8) | (p[2] << 16) | ((uint32_t)p[3] << 24);
+}
+
+// one size with an optional k/M suffix, returns the character after it
+static const char *parse_size(const char *text, size_t *out)
+{
+    char *end;
+    unsigned long long n = strtoull(text, &end, 10);
+
+    if (end == text)
+        return NULL;
+    if (*end == 'k' || *end == 'K')
+        n *= 1024, end++;
+    else if (*end == 'm' || *end == 'M')
+        n *= 1024 * 1024, end++;
+    *out = n;
+    return end;
+}
+
+Status range_parse(const char *text, size_t *off, size_t *len)
+{
+    const char *p = parse_size(text, off);
+
+    *len = RANGE_ALL;
+    if (p == NULL || (*p != ':' && *p != '\0'))
+        return e_failure;
+    if (*p == ':' && p[1] != '\0')
+    {
+        p = parse_size(p + 1, len);
+        if (p == NULL || *p != '\0')
+            return e_failure;
+    }
+    return e_success;
+}
+
+// fit the range into a payload of size bytes
+static Status clip(size_t size, size_t off, size_t *len)
+{
+    if (off > size)
+        return e_failure;
+    if (*len > size - off)
+        *len = size - off;
+    return e_success;
+}
+
+// continue io at data byte off: seek to its layout step and drop the bytes before it
+static Status seek_data(BlockIO *io, long data_off, size_t off)
+{
+    char skip[LSB_MAX_STEP_DATA];
+
+    if (block_seek_step(io, data_off, off / io->layout.step_data) == e_failure)
+        return e_failure;
+    block_cipher_at(io, off / io->layout.step_data * io->layout.step_data);   // the keystream follows the seek
+    return block_extract(io, skip, off % io->layout.step_data);
+}
+
+static Status read_plain(BlockIO *io, long data_off, size_t stored, size_t off, size_t len,
+                         RangeWriteFn write, void *ctx)
+{
+    if (clip(stored, off, &len) == e_failure || seek_data(io, data_off, off) == e_failure)
+        return e_failure;
+
+    unsigned char *buf = malloc(len < RANGE_COPY_SIZE ? len + 1 : RANGE_COPY_SIZE);
+    Status status = buf != NULL ? e_success : e_failure;
+    while (status == e_success && len > 0)
+    {
+        size_t n = len < RANGE_COPY_SIZE ? len : RANGE_COPY_SIZE;
+        status = block_extract(io, (char *)buf, n);
+        if (status == e_success)
+            status = write(ctx, buf, n);
+        len -= n;
+    }
+    free(buf);
+    return status;
+}
+
+// packed without a chunk table: unpack everything, hand out the range
+static Status read_stream(BlockIO *io, long data_off, size_t stored, int flags, size_t off, size_t len,
+                          RangeWriteFn write, void *ctx)
+{
+    unsigned char *packed = malloc(stored + 1);
+    unsigned char *out = NULL;
+    Status status = e_failure;
+
+    if (packed != NULL && seek_data(io, data_off, 0) == e_success &&
+        block_extract(io, (char *)packed, stored) == e_success)
+    {
+        size_t head;
+        size_t size = stego_unpacked_size(packed, stored, flags, &head);
+        out = malloc(size + 1);
+        if (out != NULL && lz_decompress(packed + head, stored - head, out, size) == e_success &&
+            clip(size, off, &len) == e_success)
+            status = write(ctx, out + off, len);
+    }
+    free(packed);
+    free(out);
+    return status;
+}
+
+// original size, chunk size and chunk count ahead of the chunk table; *head_len receives their bytes
+static Status read_chunk_header(BlockIO *io, size_t stored, int flags, uint64_t field[3], size_t *head_len)
+{
+    int varint = flags & STEGO_FLAG_VARINT;
+
+    *head_len = 0;
+    for (int i = 0; i < 3; i++)
+    {
+        if (*head_len + (varint ? 1 : 4) > stored || block_extract_field(io, varint, &field[i]) == e_failure)
+            return e_failure;
+        *head_len += varint ? varint_len(field[i]) : 4;
+    }
+    return *head_len <= stored ? e_success : e_failure;
+}
+
+// walk the chunk table, then extract and unpack only the chunks covering the range
+static Status read_chunks(BlockIO *io, long data_off, size_t stored, int flags, size_t off, size_t len,
+                          RangeWriteFn write, void *ctx)
+{
+    uint64_t field[3];
+    size_t head;
+
+    if (seek_data(io, data_off, 0) == e_failure || read_chunk_header(io, stored, flags, field, &head) == e_failure)
+        return e_failure;
+
+    uint64_t size = field[0], chunk = field[1], count = field[2];
+    if (chunk == 0 || chunk > UINT32_MAX || count != (size + chunk - 1) / chunk || count > (stored - head) / 4 ||
+        clip(size, off, &len) == e_failure)
+        return e_failure;
+    if (len == 0)
+        return e_success;
+
+    unsigned char *table = malloc(count * 4 + 1);
+    unsigned char *packed = malloc(lz_bound(chunk));
+    unsigned char *raw = malloc(chunk);
+    Status status = table != NULL && packed != NULL && raw != NULL ? e_success : e_failure;
+
+    if (status == e_success)
+        status = block_extract(io, (char *)table, count * 4);
+
+    size_t first = off / chunk, last = (off + len - 1) / chunk;
+    size_t pos = head + count * 4;   // data offset of chunk k
+    for (size_t k = 0; status == e_success && k < first; k++)
+        pos += get_le32(table + k * 4);
+
+    if (status == e_success && first > 0 && pos < stored)   // chunk 0 follows the table
+        status = seek_data(io, data_off, pos);
+
+    for (size_t k = first; status == e_success && k <= last; k++)
+    {
+        size_t plen = get_le32(table + k * 4);
+        size_t rlen = size - k * chunk < chunk ? size - k * chunk : chunk;
+        const unsigned char *data = packed;
+
+        if (plen > lz_bound(chunk) || pos + plen > stored ||
+            block_extract(io, (char *)packed, plen) == e_failure)
+            status = e_failure;
+        else if (plen != rlen)   // chunks that did not shrink are stored as is
+        {
+            status = lz_decompress(packed, plen, raw, rlen);
+            data = raw;
+        }
+
+        size_t from = k == first ? off - k * chunk : 0;
+        size_t to = off + len - k * chunk < rlen ? off + len - k * chunk : rlen;
+        if (status == e_success)
+            status = write(ctx, data + from, to - from);
+        pos += plen;
+    }
+
+    free(table);
+    free(packed);
+    free(raw);
+    return status;
+}
+
+Status range_check_crc(BlockIO *io, int flags, uint32_t crc)
+{
+    long stored;
+
+    if (!(flags & STEGO_FLAG_CRC))
+        return e_success;
+    if (block_align_step(io) == e_failure || block_extract_size(io, &stored) == e_failure)
+        return e_failure;
+    return (uint32_t)stored == crc ? e_success : e_failure;
+}
+
+Status range_read(BlockIO *io, long data_off, size_t stored, int flags, size_t off, size_t len,
+                  RangeWriteFn write, void *ctx)
+{
+    int whole = off == 0 && len == RANGE_ALL;   // every data byte passes, in order
+    Status status;
+
+    block_crc_start(io);
+    if (!(flags & STEGO_FLAG_LZ))
+        status = read_plain(io, data_off, stored, off, len, write, ctx);
+    else if (flags & STEGO_FLAG_CHUNKED)
+        status = read_chunks(io, data_off, stored, flags, off, len, write, ctx);
+    else
+        status = read_stream(io, data_off, stored, flags, off, len, write, ctx);
+
+    uint32_t crc = block_crc_stop(io);
+    if (status == e_success && whole)
+        status = range_check_crc(io, flags, crc);
+    return status;
+}
@@ -0,0 +1,40 @@
+#ifndef RANGE_H
+#define RANGE_H
+
+#include <stddef.h>
+#include "types.h"  // Contains user-defined types
+#include "block.h"  // Contains the block engine
+
+/*
+ * Random-access reads of a payload's data section (--range).
+ * Data byte i sits in layout step i / step_data after the first
+ * data byte, so a plain payload is read from any offset after one
+ * seek (through the keyed block order when the data is scattered).
+ * Packed payloads with STEGO_FLAG_CHUNKED start with a chunk
+ * table (see stego.h); every chunk is packed on its own, so only
+ * the chunks covering the range are extracted and unpacked. A
+ * packed payload without a table has to be unpacked from its start.
+ * Reading the whole data section from offset 0 also checks its
+ * CRC32C (STEGO_FLAG_CRC) in the same pass.
+ */
+
+#define RANGE_ALL ((size_t)-1)   // length of a range running to the end of the payload
+
+/* Receives the requested bytes in order */
+typedef Status (*RangeWriteFn)(void *ctx, const unsigned char *data, size_t n);
+
+/* Parse "off:len" (sizes take k/M suffixes), len may be omitted for the rest of the payload */
+Status range_parse(const char *text, size_t *off, size_t *len);
+
+/* Hand bytes [off, off + len) of the payload to write. io may be anywhere; data_off is the
+   image offset of the first data byte, stored the data bytes embedded, flags the format flags.
+   len is clipped to the end of the payload, off past the end fails, and so does a CRC32C
+   mismatch when off is 0 and len RANGE_ALL */
+Status range_read(BlockIO *io, long data_off, size_t stored, int flags, size_t off, size_t len,
+                  RangeWriteFn write, void *ctx);
+
+/* With STEGO_FLAG_CRC in flags, read the trailer after the data io just went through and
+   compare it with crc */
+Status range_check_crc(BlockIO *io, int flags, uint32_t crc);
+
+#endif
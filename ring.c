@@ -0,0 +1,138 @@
+#include <stdio.h>      // for fread/printf
+#include <stdlib.h>     // for malloc/free
+#include "ring.h"       // for chunk ring declarations
+#include "options.h"    // for print_error
+
+// reader thread: fill free chunks until the file is consumed
+static void *ring_reader(void *arg)
+{
+    ChunkRing *ring = arg;
+    int tail = 0;
+
+    set_error_label(ring->label);   // errors name the job that streams this secret
+
+    while (1)
+    {
+        pthread_mutex_lock(&ring->lock);
+        while (ring->count == RING_CHUNKS && !ring->stop)
+            pthread_cond_wait(&ring->not_full, &ring->lock);
+        int quit = ring->stop || ring->remaining == 0;
+        pthread_mutex_unlock(&ring->lock);
+
+        if (quit)
+            break;
+
+        size_t want = ring->remaining < (long)ring->chunk_size ? (size_t)ring->remaining : ring->chunk_size;
+        size_t got = fread(ring->chunks[tail], 1, want, ring->fptr);   // read outside the lock
+
+        pthread_mutex_lock(&ring->lock);
+        if (got != want)
+        {
+            print_error("secret file ended %ld bytes early\n", ring->remaining - (long)got);
+            ring->status = e_failure;
+            pthread_mutex_unlock(&ring->lock);
+            break;
+        }
+        ring->lens[tail] = got;
+        ring->remaining -= got;
+        ring->count++;
+        pthread_cond_signal(&ring->not_empty);
+        pthread_mutex_unlock(&ring->lock);
+
+        tail = (tail + 1) % RING_CHUNKS;
+    }
+
+    pthread_mutex_lock(&ring->lock);
+    ring->done = 1;
+    pthread_cond_signal(&ring->not_empty);
+    pthread_mutex_unlock(&ring->lock);
+    return NULL;
+}
+
+Status ring_open(ChunkRing *ring, FILE *fptr, long size, size_t chunk_size)
+{
+    ring->fptr = fptr;
+    ring->remaining = size;
+    ring->chunk_size = chunk_size;
+    ring->head = 0;
+    ring->count = 0;
+    ring->done = 0;
+    ring->stop = 0;
+    ring->status = e_success;
+    ring->label = get_error_label();
+
+    for (int i = 0; i < RING_CHUNKS; i++)
+    {
+        ring->chunks[i] = malloc(chunk_size);
+        if (ring->chunks[i] == NULL)
+        {
+            print_error("unable to allocate secret chunk\n");
+            while (i--)
+                free(ring->chunks[i]);
+            return e_failure;
+        }
+    }
+
+    pthread_mutex_init(&ring->lock, NULL);
+    pthread_cond_init(&ring->not_empty, NULL);
+    pthread_cond_init(&ring->not_full, NULL);
+
+    if (pthread_create(&ring->reader, NULL, ring_reader, ring) != 0)
+    {
+        print_error("unable to start secret reader\n");
+        for (int i = 0; i < RING_CHUNKS; i++)
+            free(ring->chunks[i]);
+        return e_failure;
+    }
+    return e_success;
+}
+
+Status ring_next(ChunkRing *ring, const unsigned char **data, size_t *len)
+{
+    pthread_mutex_lock(&ring->lock);
+    while (ring->count == 0 && !ring->done)
+        pthread_cond_wait(&ring->not_empty, &ring->lock);
+
+    Status status = ring->status;
+    if (ring->count > 0)
+    {
+        *data = ring->chunks[ring->head];
+        *len = ring->lens[ring->head];
+    }
+    else
+    {
+        *data = NULL;
+        *len = 0;   // reader finished and every chunk was consumed
+    }
+    pthread_mutex_unlock(&ring->lock);
+
+    return status;
+}
+
+void ring_release(ChunkRing *ring)
+{
+    pthread_mutex_lock(&ring->lock);
+    ring->head = (ring->head + 1) % RING_CHUNKS;
+    ring->count--;
+    pthread_cond_signal(&ring->not_full);
+    pthread_mutex_unlock(&ring->lock);
+}
+
+Status ring_close(ChunkRing *ring)
+{
+    pthread_mutex_lock(&ring->lock);
+    ring->stop = 1;
+    pthread_cond_signal(&ring->not_full);
+    pthread_mutex_unlock(&ring->lock);
+
+    pthread_join(ring->reader, NULL);
+
+    pthread_mutex_destroy(&ring->lock);
+    pthread_cond_destroy(&ring->not_empty);
+    pthread_cond_destroy(&ring->not_full);
+
+    for (int i = 0; i < RING_CHUNKS; i++)
+        free(ring->chunks[i]);
+
+    return ring->status;
+}
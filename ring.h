@@ -0,0 +1,52 @@
+#ifndef RING_H
+#define RING_H
+
+#include <stdio.h>
+#include <stddef.h>
+#include <pthread.h>
+#include "types.h"  // Contains user-defined types
+
+/*
+ * Fixed-size ring of chunks used to stream the secret file.
+ * A reader thread fills free chunks from the file while the
+ * embedding loop consumes full ones, so memory use stays at
+ * RING_CHUNKS * chunk_size no matter how large the secret is.
+ */
+
+#define RING_CHUNKS 4
+
+typedef struct _ChunkRing
+{
+    FILE *fptr;                          // file the chunks are read from
+    long remaining;                      // bytes the reader still has to read
+    size_t chunk_size;                   // capacity of every chunk
+
+    unsigned char *chunks[RING_CHUNKS];  // chunk buffers
+    size_t lens[RING_CHUNKS];            // valid bytes in each full chunk
+    int head;                            // next chunk the consumer takes
+    int count;                           // number of full chunks
+    int done;                            // reader has finished (eof or error)
+    int stop;                            // consumer asked the reader to quit
+    Status status;                       // e_failure when the file came up short
+    const char *label;                   // error label of the consumer, for the reader's messages
+
+    pthread_mutex_t lock;
+    pthread_cond_t not_empty;
+    pthread_cond_t not_full;
+    pthread_t reader;
+
+} ChunkRing;
+
+/* Start streaming size bytes of fptr through the ring */
+Status ring_open(ChunkRing *ring, FILE *fptr, long size, size_t chunk_size);
+
+/* Wait for the next full chunk, len is 0 once the whole file was consumed */
+Status ring_next(ChunkRing *ring, const unsigned char **data, size_t *len);
+
+/* Hand the chunk returned by ring_next back to the reader */
+void ring_release(ChunkRing *ring);
+
+/* Stop the reader and free the chunks, fails if the file was short */
+Status ring_close(ChunkRing *ring);
+
+#endif
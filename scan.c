@@ -0,0 +1,277 @@
+#define _GNU_SOURCE     // for d_type and O_CLOEXEC
+#include <stdio.h>      // for file and console I/O
+#include <stdlib.h>     // for malloc/qsort
+#include <string.h>     // for string handling functions
+#include <strings.h>    // for strcasecmp
+#include <limits.h>     // for PATH_MAX
+#include <dirent.h>     // for opendir/readdir
+#include <fcntl.h>      // for open/posix_fadvise
+#include <unistd.h>     // for pread/sysconf
+#include <sys/stat.h>   // for fstat/lstat
+#include "scan.h"       // for scan declarations
+#include "stego.h"      // for stego_probe
+#include "cover.h"      // for COVER_MAGIC_LEN
+#include "pool.h"       // for the work-stealing pool
+#include "parallel.h"   // for MAX_THREADS
+#include "stats.h"      // for stats_now_ms
+
+typedef struct _ScanFile
+{
+    char *path;
+    const StegoParams *params;
+    unsigned char **buffers;   // per-worker read buffers
+    int found;                 // a payload header was read
+    int unreadable;            // open or read failed
+    size_t bytes_read;
+    StegoInfo info;
+
+} ScanFile;
+
+typedef struct _ScanList
+{
+    ScanFile **files;
+    int count;
+    int cap;
+
+} ScanList;
+
+// read the header and first pixel bytes of one file and look for a payload
+static void probe_file(void *arg, int worker)
+{
+    ScanFile *file = arg;
+    unsigned char *buf = file->buffers[worker];
+    struct stat st;
+
+    int fd = open(file->path, O_RDONLY | O_CLOEXEC);
+    if (fd < 0 || fstat(fd, &st) < 0)
+    {
+        file->unreadable = 1;
+        if (fd >= 0)
+            close(fd);
+        return;
+    }
+    posix_fadvise(fd, 0, 0, POSIX_FADV_RANDOM);   // no readahead into pixels we never look at
+
+    ssize_t got = pread(fd, buf, SCAN_READ_SIZE, 0);
+    if (got < 0)
+        file->unreadable = 1;
+    else if (got >= COVER_MAGIC_LEN)
+    {
+        // large palettes, V5 headers or long image IDs push the payload header past the first read
+        size_t need = stego_probe_len(buf, got, file->params);
+        if (need > SCAN_MAX_READ)
+            need = SCAN_MAX_READ;
+        if (need > (size_t)got && got == SCAN_READ_SIZE)
+        {
+            ssize_t more = pread(fd, buf + got, need - got, got);
+            if (more > 0)
+                got += more;
+        }
+
+        file->found = stego_probe(buf, got, st.st_size, file->params, &file->info) == e_success;
+    }
+    file->bytes_read = got > 0 ? got : 0;
+    close(fd);
+}
+
+// cheap filter on the walk; the format itself is told by the header
+static int has_image_extension(const char *name)
+{
+    static const char *const extns[] = { ".bmp", ".ppm", ".pnm", ".pam", ".tga" };
+    const char *dot = strrchr(name, '.');
+
+    for (size_t i = 0; dot != NULL && i < sizeof(extns) / sizeof(extns[0]); i++)
+    {
+        if (strcasecmp(dot, extns[i]) == 0)
+            return 1;
+    }
+    return 0;
+}
+
+// queue one image on the pool, keeping it in the list for the index
+static Status add_file(ScanList *list, ThreadPool *pool, const char *path, const StegoParams *params,
+                       unsigned char **buffers)
+{
+    if (list->count == list->cap)
+    {
+        int cap = list->cap ? list->cap * 2 : 256;
+        ScanFile **grown = realloc(list->files, cap * sizeof(ScanFile *));
+        if (grown == NULL)
+            return e_failure;
+        list->files = grown;
+        list->cap = cap;
+    }
+
+    ScanFile *file = calloc(1, sizeof(ScanFile));
+    if (file == NULL || (file->path = strdup(path)) == NULL)
+    {
+        free(file);
+        return e_failure;
+    }
+    file->params = params;
+    file->buffers = buffers;
+    list->files[list->count++] = file;
+
+    return pool_submit(pool, probe_file, file);
+}
+
+// walk dir depth first without following symlinks, probing images as they are found
+static Status walk_dir(const char *dir, ScanList *list, ThreadPool *pool, const StegoParams *params,
+                       unsigned char **buffers)
+{
+    DIR *dp = opendir(dir);
+    if (dp == NULL)
+    {
+        printf("Warning: cannot open directory %s\n", dir);
+        return e_success;   // keep scanning the rest of the tree
+    }
+
+    char path[PATH_MAX];
+    struct dirent *ent;
+    Status status = e_success;
+
+    while (status == e_success && (ent = readdir(dp)) != NULL)
+    {
+        if (strcmp(ent->d_name, ".") == 0 || strcmp(ent->d_name, "..") == 0)
+            continue;
+        if (snprintf(path, sizeof(path), "%s/%s", dir, ent->d_name) >= (int)sizeof(path))
+            continue;
+
+        unsigned char type = ent->d_type;
+        if (type == DT_UNKNOWN)   // file systems without d_type
+        {
+            struct stat st;
+            if (lstat(path, &st) < 0)
+                continue;
+            type = S_ISDIR(st.st_mode) ? DT_DIR : S_ISREG(st.st_mode) ? DT_REG : DT_UNKNOWN;
+        }
+
+        if (type == DT_DIR)
+            status = walk_dir(path, list, pool, params, buffers);
+        else if (type == DT_REG && has_image_extension(ent->d_name))
+            status = add_file(list, pool, path, params, buffers);
+    }
+    closedir(dp);
+    return status;
+}
+
+static int compare_path(const void *a, const void *b)
+{
+    return strcmp((*(ScanFile *const *)a)->path, (*(ScanFile *const *)b)->path);
+}
+
+// write one line per payload found, sorted by path; an index on stdout moves the messages to stderr
+static Status write_index(ScanList *list, const char *index_fname, int *found)
+{
+    FILE *fptr = index_fname != NULL ? fopen(index_fname, "w") : stdout_for_data();
+    if (fptr == NULL)
+    {
+        printf("Error: unable to create index %s\n", index_fname != NULL ? index_fname : "on stdout");
+        return e_failure;
+    }
+
+    qsort(list->files, list->count, sizeof(ScanFile *), compare_path);
+
+    *found = 0;
+    fprintf(fptr, "# path\textension\tsize\toffset\n");
+    for (int i = 0; i < list->count; i++)
+    {
+        ScanFile *file = list->files[i];
+        if (!file->found)
+            continue;
+        fprintf(fptr, "%s\t%s\t%zu\t%zu\n", file->path, file->info.extension,
+                file->info.payload_size, file->info.data_offset);
+        (*found)++;
+    }
+
+    if (fclose(fptr) != 0)
+    {
+        printf("Error: unable to write index %s\n", index_fname != NULL ? index_fname : "on stdout");
+        return e_failure;
+    }
+    return e_success;
+}
+
+Status do_scan(const char *root, const char *index_fname, const StegoOptions *opts)
+{
+    if (opts->magic == NULL || opts->magic[0] == '\0' || strlen(opts->magic) > STEGO_MAX_MAGIC)
+    {
+        printf("Error: scan needs a magic string of 1 to %d characters (-m <magic>)\n", STEGO_MAX_MAGIC);
+        return e_failure;
+    }
+
+    struct stat st;
+    if (stat(root, &st) < 0)
+    {
+        printf("Error: %s not found\n", root);
+        return e_failure;
+    }
+
+    int workers = opts->threads;
+    if (workers <= 0)
+    {
+        long cpus = sysconf(_SC_NPROCESSORS_ONLN);
+        workers = (cpus > 0 ? cpus : 1) * SCAN_WORKERS_PER_CPU;
+        if (workers > MAX_THREADS)
+            workers = MAX_THREADS;
+    }
+
+    // one read buffer per worker, reused for every file that worker probes
+    unsigned char **buffers = calloc(workers, sizeof(unsigned char *));
+    Status status = buffers != NULL ? e_success : e_failure;
+    for (int i = 0; status == e_success && i < workers; i++)
+    {
+        buffers[i] = malloc(SCAN_MAX_READ);
+        if (buffers[i] == NULL)
+            status = e_failure;
+    }
+
+    StegoParams params = { opts->magic, NULL, 0, 0, 0, NULL, NULL };
+    ScanList list = {0};
+    ThreadPool pool;
+    double start = stats_now_ms();
+
+    if (status == e_success && pool_init(&pool, workers) == e_success)
+    {
+        if (S_ISDIR(st.st_mode))
+            status = walk_dir(root, &list, &pool, &params, buffers);
+        else
+            status = add_file(&list, &pool, root, &params, buffers);   // a single image
+        pool_wait(&pool);
+        pool_destroy(&pool);
+        if (status == e_failure)
+            printf("Error: out of memory while scanning %s\n", root);
+    }
+    else
+    {
+        printf("Error: unable to set up %d scan workers\n", workers);
+        status = e_failure;
+    }
+
+    double total = stats_now_ms() - start;
+    int found = 0, unreadable = 0;
+    size_t bytes = 0;
+
+    if (status == e_success)
+        status = write_index(&list, index_fname, &found);
+
+    for (int i = 0; i < list.count; i++)
+    {
+        unreadable += list.files[i]->unreadable;
+        bytes += list.files[i]->bytes_read;
+        free(list.files[i]->path);
+        free(list.files[i]);
+    }
+    free(list.files);
+
+    if (status == e_success)
+        print_status(opts, "Scan finished: %d images, %d payloads, %d unreadable, %d workers, %.2f ms "
+                     "(%.1f files/s, %.1f KB read)\n", list.count, found, unreadable, workers, total,
+                     total > 0 ? list.count * 1000.0 / total : 0.0, bytes / 1024.0);
+
+    for (int i = 0; buffers != NULL && i < workers; i++)
+        free(buffers[i]);
+    free(buffers);
+
+    return status;
+}
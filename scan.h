@@ -0,0 +1,27 @@
+#ifndef SCAN_H
+#define SCAN_H
+
+#include "types.h"    // Contains user-defined types
+#include "options.h"  // Contains command-line options
+
+/*
+ * Scan mode: walk a directory tree and index every cover image that
+ * carries a payload under the given magic. Only the image header
+ * and the first pixel bytes (enough for the magic, extension and
+ * size fields) are read from each file, so the rest of the image
+ * is never touched; files are probed in parallel on the
+ * work-stealing pool since the scan is bound by I/O latency.
+ *
+ * Index format, one payload per line, sorted by path:
+ *     <path> TAB <extension> TAB <payload size> TAB <data offset>
+ */
+
+#define SCAN_READ_SIZE (4 * 1024)     // first read of every file, covers most headers
+#define SCAN_MAX_READ (64 * 1024)     // most bytes read from one file
+#define SCAN_WORKERS_PER_CPU 4        // probes mostly wait on the disk
+
+/* Probe every .bmp, .ppm, .pnm, .pam and .tga file under root and write the index to index_fname
+   (stdout when NULL, the messages then go to stderr) */
+Status do_scan(const char *root, const char *index_fname, const StegoOptions *opts);
+
+#endif
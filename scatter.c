@@ -0,0 +1,72 @@
+#include "scatter.h"    // for scatter declarations
+
+// splitmix64 finaliser, spreads every input bit over the whole word
+static uint64_t mix64(uint64_t x)
+{
+    x ^= x >> 30;
+    x *= 0xbf58476d1ce4e5b9ull;
+    x ^= x >> 27;
+    x *= 0x94d049bb133111ebull;
+    return x ^ (x >> 31);
+}
+
+uint64_t scatter_seed(const char *key)
+{
+    uint64_t h = 0xcbf29ce484222325ull;   // FNV-1a over the key text
+
+    for (; *key != '\0'; key++)
+        h = (h ^ (unsigned char)*key) * 0x100000001b3ull;
+    return mix64(h);
+}
+
+Status scatter_init(Scatter *sc, const BmpRows *rows, const LsbLayout *layout, long data_off,
+                    size_t data_len, uint64_t seed)
+{
+    size_t steps = (data_len + layout->step_data - 1) / layout->step_data;
+
+    sc->seed = seed;
+    sc->rows = *rows;
+    sc->data_off = data_off;
+    sc->step_cover = layout->step_cover;
+    sc->block_steps = SCATTER_BLOCK / layout->step_cover;
+    sc->count = bmp_bytes_left(rows, data_off) / (sc->block_steps * sc->step_cover);
+
+    sc->half_bits = 1;
+    while (sc->half_bits < 32 && ((uint64_t)1 << (2 * sc->half_bits)) < sc->count)
+        sc->half_bits++;
+
+    if ((steps + sc->block_steps - 1) / sc->block_steps > sc->count)
+    {
+        sc->count = 0;
+        return e_failure;
+    }
+    return e_success;
+}
+
+// keyed permutation of the block numbers 0 .. count - 1
+static size_t permute(const Scatter *sc, size_t block)
+{
+    uint64_t mask = ((uint64_t)1 << sc->half_bits) - 1;
+    uint64_t x = block;
+
+    do   // the network permutes 4^half_bits numbers, walk on until one is a block
+    {
+        uint64_t left = x >> sc->half_bits, right = x & mask;
+        for (int round = 0; round < SCATTER_ROUNDS; round++)
+        {
+            uint64_t next = left ^ (mix64(sc->seed + round * 0x9e3779b97f4a7c15ull + right) & mask);
+            left = right;
+            right = next;
+        }
+        x = left << sc->half_bits | right;
+    } while (x >= sc->count);
+    return x;
+}
+
+long scatter_offset(const Scatter *sc, size_t step)
+{
+    size_t block = permute(sc, step / sc->block_steps);
+    size_t cover = (block * sc->block_steps + step % sc->block_steps) * sc->step_cover;
+
+    return bmp_advance(&sc->rows, sc->data_off, cover);
+}
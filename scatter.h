@@ -0,0 +1,47 @@
+#ifndef SCATTER_H
+#define SCATTER_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include "types.h"  // Contains user-defined types
+#include "lsb.h"    // Contains the kernel layouts
+#include "bmp.h"    // Contains the pixel row geometry
+
+/*
+ * Keyed scattering of the data section (--key).
+ * The pixel bytes from the first data byte to the end of the
+ * pixel array are cut into blocks of SCATTER_BLOCK cover bytes
+ * (whole layout steps). Logical block k of the payload goes to
+ * physical block P(k), where P is a keyed permutation: a small
+ * Feistel network over the block numbers, walking the cycle until
+ * it lands inside the block count. P(k) needs no table, so any
+ * block (and so any --range) is found in O(1), and inside a block
+ * the engine still walks the cover bytes front to back.
+ */
+
+#define SCATTER_BLOCK 4096    // cover bytes per scattered block, rounded down to whole layout steps
+#define SCATTER_ROUNDS 4      // Feistel rounds of the block permutation
+
+typedef struct _Scatter
+{
+    uint64_t seed;          // from the key
+    BmpRows rows;           // pixel rows the blocks are counted in
+    long data_off;          // image offset of the first data byte
+    size_t step_cover;      // cover bytes of one layout step
+    size_t block_steps;     // layout steps in a block
+    size_t count;           // whole blocks in the data area, 0 when not scattering
+    int half_bits;          // width of each Feistel half
+
+} Scatter;
+
+/* Seed for a key given on the command line */
+uint64_t scatter_seed(const char *key);
+
+/* Cut the pixel bytes from data_off on into blocks for data_len payload bytes, fails when they do not fit */
+Status scatter_init(Scatter *sc, const BmpRows *rows, const LsbLayout *layout, long data_off,
+                    size_t data_len, uint64_t seed);
+
+/* Image offset of layout step `step` of the data section */
+long scatter_offset(const Scatter *sc, size_t step);
+
+#endif
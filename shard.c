@@ -0,0 +1,541 @@
+#define _GNU_SOURCE     // for O_CLOEXEC
+#include <stdio.h>      // for console I/O
+#include <stdlib.h>     // for malloc/qsort
+#include <string.h>     // for string handling functions
+#include <limits.h>     // for PATH_MAX
+#include <fcntl.h>      // for open
+#include <unistd.h>     // for ftruncate/sysconf
+#include <sys/mman.h>   // for mmap/munmap
+#include <sys/stat.h>   // for fstat
+#include "shard.h"      // for shard declarations
+#include "stego.h"      // for the in-memory encode/decode
+#include "crc32c.h"     // for the whole-secret check
+#include "pool.h"       // for the work-stealing pool
+#include "parallel.h"   // for MAX_THREADS
+#include "copy.h"       // for kernel copies of the covers
+#include "stats.h"      // for stats_now_ms
+
+typedef struct _ShardSet
+{
+    const StegoParams *params;
+    const uint8_t *secret;      // whole secret (encode)
+    uint8_t *out;               // reassembled secret (decode)
+    size_t total;               // secret bytes
+    uint32_t count;             // shards in the set
+    uint32_t crc;               // CRC32C of the whole secret
+
+} ShardSet;
+
+typedef struct _ShardHeader
+{
+    uint64_t total;             // secret bytes
+    uint32_t count;             // shards in the set
+    uint32_t crc;               // CRC32C of the whole secret
+
+} ShardHeader;
+
+typedef struct _Shard
+{
+    const ShardSet *set;
+    const char *image;          // cover (encode) or stego image (decode)
+    char output[PATH_MAX];      // stego image written (encode)
+    int fd;
+    uint8_t *map;               // image mapped read-only
+    size_t len;
+    size_t capacity;            // secret bytes the cover takes next to the shard header (encode)
+    uint32_t index;
+    size_t offset;              // first secret byte of this shard
+    size_t size;                // secret bytes in this shard
+    uint32_t crc;               // CRC32C of the piece (decode)
+    size_t head_len;            // bytes of its shard header, shorter in version 1 payloads (decode)
+    Status status;
+    double ms;                  // wall time of the shard
+
+} Shard;
+
+static void put_le32(uint8_t *p, uint32_t v)
+{
+    p[0] = v;
+    p[1] = v >> 8;
+    p[2] = v >> 16;
+    p[3] = v >> 24;
+}
+
+static void put_le64(uint8_t *p, uint64_t v)
+{
+    put_le32(p, v);
+    put_le32(p + 4, v >> 32);
+}
+
+static uint32_t get_le32(const uint8_t *p)
+{
+    return p[0] | (p[1] << 8) | (p[2] << 16) | ((uint32_t)p[3] << 24);
+}
+
+static uint64_t get_le64(const uint8_t *p)
+{
+    return get_le32(p) | (uint64_t)get_le32(p + 4) << 32;
+}
+
+// map an image read-only for the whole run
+static Status map_image(Shard *sh)
+{
+    struct stat st;
+
+    sh->map = MAP_FAILED;
+    sh->fd = open(sh->image, O_RDONLY | O_CLOEXEC);
+    if (sh->fd >= 0 && fstat(sh->fd, &st) == 0 && st.st_size > 0)
+    {
+        sh->len = st.st_size;
+        sh->map = mmap(NULL, sh->len, PROT_READ, MAP_SHARED, sh->fd, 0);
+    }
+    if (sh->map == MAP_FAILED)
+    {
+        printf("Error: unable to map %s\n", sh->image);
+        return e_failure;
+    }
+    return e_success;
+}
+
+static void unmap_shards(Shard *shards, int count)
+{
+    for (int i = 0; i < count; i++)
+    {
+        if (shards[i].map != MAP_FAILED && shards[i].map != NULL)
+            munmap(shards[i].map, shards[i].len);
+        if (shards[i].fd >= 0)
+            close(shards[i].fd);
+    }
+    free(shards);
+}
+
+static Shard *alloc_shards(char *images[], int count)
+{
+    Shard *shards = calloc(count, sizeof(Shard));
+
+    for (int i = 0; shards != NULL && i < count; i++)
+    {
+        shards[i].image = images[i];
+        shards[i].fd = -1;
+        shards[i].map = MAP_FAILED;
+        shards[i].status = e_failure;
+    }
+    return shards;
+}
+
+// run fn for every shard on the pool
+static Status run_shards(Shard *shards, int count, PoolTaskFn fn, const StegoOptions *opts, double *ms)
+{
+    int workers = opts->threads > 0 ? opts->threads : (int)sysconf(_SC_NPROCESSORS_ONLN);
+    if (workers < 1)
+        workers = 1;
+    if (workers > count)
+        workers = count;
+    if (workers > MAX_THREADS)
+        workers = MAX_THREADS;
+
+    ThreadPool pool;
+    double start = stats_now_ms();
+
+    if (pool_init(&pool, workers) == e_failure)
+    {
+        printf("Error: unable to set up %d shard workers\n", workers);
+        return e_failure;
+    }
+    for (int i = 0; i < count; i++)
+        if (pool_submit(&pool, fn, &shards[i]) == e_failure)
+            break;
+    pool_wait(&pool);
+    pool_destroy(&pool);
+    *ms = stats_now_ms() - start;
+
+    Status status = e_success;
+    for (int i = 0; i < count; i++)   // one result line per shard
+    {
+        Shard *sh = &shards[i];
+        if (!opts->quiet)
+            printf("shard %u/%u: %s: %zu bytes at %zu: %s (%.2f ms)\n", sh->index + 1, sh->set->count,
+                   sh->output[0] != '\0' ? sh->output : sh->image, sh->size, sh->offset,
+                   sh->status == e_success ? "ok" : "FAILED", sh->ms);
+        if (sh->status == e_failure)
+            status = e_failure;
+    }
+    return status;
+}
+
+/* ---------- encoding ---------- */
+
+// shard header and piece into one buffer, then the whole payload into a new stego image
+static void embed_shard(void *arg, int worker)
+{
+    Shard *sh = arg;
+    const ShardSet *set = sh->set;
+    double start = stats_now_ms();
+    uint8_t *data = malloc(SHARD_HEADER + sh->size);
+    uint8_t *out = MAP_FAILED;
+    (void)worker;
+
+    int fd = open(sh->output, O_RDWR | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+    if (fd >= 0 && copy_fd_range(sh->fd, fd, 0, sh->len) == e_success)   // kernel copy of its cover, embedded in place
+        out = mmap(NULL, sh->len, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+
+    if (data != NULL && out != MAP_FAILED)
+    {
+        put_le64(data, set->total);
+        put_le64(data + 8, sh->offset);
+        put_le32(data + 16, sh->index);
+        put_le32(data + 20, set->count);
+        put_le32(data + 24, set->crc);
+        if (sh->size > 0)
+            memcpy(data + SHARD_HEADER, set->secret + sh->offset, sh->size);
+        sh->status = stego_encode(out, sh->len, data, SHARD_HEADER + sh->size, set->params, out);
+    }
+
+    if (out != MAP_FAILED)
+        munmap(out, sh->len);
+    if (fd >= 0)
+        close(fd);
+    free(data);
+    sh->ms = stats_now_ms() - start;
+}
+
+// give every cover a share of the secret in proportion to its capacity
+static void split_secret(Shard *shards, int count, size_t total, size_t capacity)
+{
+    size_t offset = 0;
+
+    for (int i = 0; i < count; i++)
+    {
+        shards[i].size = (size_t)((double)total * shards[i].capacity / capacity);
+        if (shards[i].size > shards[i].capacity)
+            shards[i].size = shards[i].capacity;
+        offset += shards[i].size;
+    }
+    for (int i = 0; i < count && offset < total; i++)   // rounding leftovers go where there is room
+    {
+        size_t more = shards[i].capacity - shards[i].size;
+        if (more > total - offset)
+            more = total - offset;
+        shards[i].size += more;
+        offset += more;
+    }
+
+    offset = 0;
+    for (int i = 0; i < count; i++)
+    {
+        shards[i].offset = offset;
+        offset += shards[i].size;
+    }
+}
+
+// output path: out_dir plus the cover's file name, never the cover itself nor the output of an earlier shard
+static Status output_name(Shard *shards, int i, const char *out_dir)
+{
+    Shard *sh = &shards[i];
+    const char *slash = strrchr(sh->image, '/');
+    const char *base = slash != NULL ? slash + 1 : sh->image;
+    struct stat cover, out;
+
+    if (snprintf(sh->output, sizeof(sh->output), "%s/%s", out_dir, base) >= (int)sizeof(sh->output))
+    {
+        printf("Error: output path for %s is too long\n", sh->image);
+        return e_failure;
+    }
+    if (stat(sh->output, &out) == 0 && fstat(sh->fd, &cover) == 0 &&
+        out.st_dev == cover.st_dev && out.st_ino == cover.st_ino)
+    {
+        printf("Error: %s would overwrite its cover, pick another output directory\n", sh->output);
+        return e_failure;
+    }
+    for (int j = 0; j < i; j++)   // the workers would truncate one file under each other
+    {
+        if (strcmp(shards[j].output, sh->output) == 0)
+        {
+            printf("Error: %s and %s would both be written to %s, give covers distinct file names\n",
+                   shards[j].image, sh->image, sh->output);
+            return e_failure;
+        }
+    }
+    return e_success;
+}
+
+Status do_shard_encode(const char *secret_fname, const char *out_dir, char *covers[], int count,
+                       const StegoOptions *opts)
+{
+    const char *dot = strrchr(secret_fname, '.');
+    const char *slash = strrchr(secret_fname, '/');
+
+    if (opts->magic == NULL || opts->magic[0] == '\0' || strlen(opts->magic) > STEGO_MAX_MAGIC)
+    {
+        printf("Error: shard mode needs a magic string of 1 to %d characters (-m <magic>)\n", STEGO_MAX_MAGIC);
+        return e_failure;
+    }
+    if (opts->compress)
+    {
+        printf("Error: shards are stored unpacked, leave out -z and --chunk\n");
+        return e_failure;
+    }
+    if (opts->pass != NULL)
+    {
+        printf("Error: shards are stored unencrypted, leave out --pass and --pass-file\n");
+        return e_failure;
+    }
+    if (dot == NULL || (slash != NULL && dot < slash) || strlen(dot) > STEGO_MAX_EXTN)
+    {
+        printf("Error: secret file %s needs an extension of up to %d characters\n", secret_fname, STEGO_MAX_EXTN);
+        return e_failure;
+    }
+
+    StegoParams params = { opts->magic, dot, opts->bits, opts->channels,
+                           STEGO_FLAG_SHARD | (opts->crc ? STEGO_FLAG_CRC : 0), opts->key, NULL };
+    ShardSet set = { &params, NULL, NULL, 0, count, 0 };
+    Shard secret = { .image = secret_fname, .fd = -1, .map = MAP_FAILED };
+    Shard *shards = alloc_shards(covers, count);
+    Status status = shards != NULL ? e_success : e_failure;
+
+    struct stat st;
+    secret.fd = open(secret_fname, O_RDONLY | O_CLOEXEC);
+    if (secret.fd < 0 || fstat(secret.fd, &st) < 0)
+    {
+        printf("Error: unable to read secret file %s\n", secret_fname);
+        status = e_failure;
+    }
+    else if (st.st_size > 0 && map_image(&secret) == e_success)
+    {
+        set.secret = secret.map;
+        set.total = secret.len;
+        set.crc = crc32c(0, set.secret, set.total);
+    }
+    else if (st.st_size > 0)
+        status = e_failure;
+
+    size_t capacity = 0;
+    for (int i = 0; status == e_success && i < count; i++)   // how much each cover takes
+    {
+        Shard *sh = &shards[i];
+        sh->set = &set;
+        sh->index = i;
+        if (map_image(sh) == e_failure || output_name(shards, i, out_dir) == e_failure)
+        {
+            status = e_failure;
+            break;
+        }
+
+        size_t cap = stego_capacity(sh->map, sh->len, &params);
+        if (cap <= SHARD_HEADER)
+        {
+            printf("Error: %s is not a usable cover for these options\n", sh->image);
+            status = e_failure;
+            break;
+        }
+        sh->capacity = cap - SHARD_HEADER;
+        capacity += sh->capacity;
+    }
+
+    if (status == e_success && set.total > capacity)
+    {
+        printf("Error: the %zu byte secret does not fit, the %d covers hold %zu bytes\n", set.total, count, capacity);
+        status = e_failure;
+    }
+
+    double ms = 0;
+    if (status == e_success)
+    {
+        split_secret(shards, count, set.total, capacity);
+        status = run_shards(shards, count, embed_shard, opts, &ms);
+    }
+    if (status == e_success)
+        printf("Shards written: %d covers, %zu bytes, %.2f ms (%.1f MB/s)\n", count, set.total, ms,
+               ms > 0 ? set.total / (ms * 1000.0) : 0.0);
+
+    if (shards != NULL)
+        unmap_shards(shards, count);
+    if (secret.map != MAP_FAILED)
+        munmap(secret.map, secret.len);
+    if (secret.fd >= 0)
+        close(secret.fd);
+    return status;
+}
+
+/* ---------- decoding ---------- */
+
+// extract one piece straight into its place in the output, checksumming it there
+static void extract_shard(void *arg, int worker)
+{
+    Shard *sh = arg;
+    const ShardSet *set = sh->set;
+    double start = stats_now_ms();
+    StegoInfo info;
+    size_t got = 0;
+    (void)worker;
+
+    sh->status = stego_decode_range(sh->map, sh->len, set->params, sh->head_len, sh->size,
+                                    set->out + sh->offset, &got, &info);
+    if (sh->status == e_success && got != sh->size)
+        sh->status = e_failure;
+    if (sh->status == e_success)
+        sh->crc = crc32c(0, set->out + sh->offset, sh->size);
+    sh->ms = stats_now_ms() - start;
+}
+
+// read the shard header of one stego image, head receives its set fields
+static Status read_shard_header(Shard *sh, const StegoParams *params, ShardHeader *head, StegoInfo *info)
+{
+    uint8_t bytes[SHARD_HEADER];
+    size_t got = 0;
+
+    if (stego_peek(sh->map, sh->len, params, info) == e_failure)
+    {
+        printf("Error: no payload under this magic in %s (scattered ones need --key)\n", sh->image);
+        return e_failure;
+    }
+    if ((info->flags & STEGO_FLAG_SCATTER) && params->key == NULL)
+    {
+        printf("Error: the shard in %s is scattered, give its key with --key\n", sh->image);
+        return e_failure;
+    }
+    sh->head_len = info->flags & STEGO_FLAG_VARINT ? SHARD_HEADER : SHARD_HEADER_V1;
+    if (!(info->flags & STEGO_FLAG_SHARD) || info->payload_size < sh->head_len ||
+        stego_decode_range(sh->map, sh->len, params, 0, sh->head_len, bytes, &got, info) == e_failure ||
+        got != sh->head_len)
+    {
+        printf("Error: %s does not hold a shard\n", sh->image);
+        return e_failure;
+    }
+
+    int wide = sh->head_len == SHARD_HEADER;   // 64-bit total and offset
+    const uint8_t *rest = bytes + (wide ? 16 : 8);
+    head->total = wide ? get_le64(bytes) : get_le32(bytes);
+    head->count = get_le32(rest + 4);
+    head->crc = get_le32(rest + 8);
+    sh->offset = wide ? get_le64(bytes + 8) : get_le32(bytes + 4);
+    sh->index = get_le32(rest);
+    sh->size = info->payload_size - sh->head_len;
+    return e_success;
+}
+
+static int by_index(const void *a, const void *b)
+{
+    const Shard *x = a, *y = b;
+    return x->index < y->index ? -1 : x->index > y->index;
+}
+
+// every shard of one set, each once, the pieces covering the secret end to end
+static Status check_set(Shard *shards, int count, const ShardSet *set)
+{
+    size_t offset = 0;
+
+    if (set->count != (uint32_t)count)
+    {
+        printf("Error: the set has %u shards, %d images given\n", set->count, count);
+        return e_failure;
+    }
+    qsort(shards, count, sizeof(Shard), by_index);
+    for (int i = 0; i < count; i++)
+    {
+        if (shards[i].index != (uint32_t)i)
+        {
+            printf("Error: shard %d of the set is missing or given twice\n", i + 1);
+            return e_failure;
+        }
+        if (shards[i].offset != offset || shards[i].size > set->total - offset)
+        {
+            printf("Error: shard %d of the set does not line up with the others\n", i + 1);
+            return e_failure;
+        }
+        offset += shards[i].size;
+    }
+    if (offset != set->total)
+    {
+        printf("Error: the shards hold %zu of the %zu secret bytes\n", offset, set->total);
+        return e_failure;
+    }
+    return e_success;
+}
+
+Status do_shard_decode(const char *output_fname, char *stegos[], int count, const StegoOptions *opts)
+{
+    if (opts->magic == NULL || opts->magic[0] == '\0' || strlen(opts->magic) > STEGO_MAX_MAGIC)
+    {
+        printf("Error: shard mode needs a magic string of 1 to %d characters (-m <magic>)\n", STEGO_MAX_MAGIC);
+        return e_failure;
+    }
+
+    StegoParams params = { opts->magic, NULL, 0, 0, 0, opts->key, NULL };   // layout and flags are read from the payloads
+    ShardSet set = { &params, NULL, NULL, 0, 0, 0 };
+    Shard *shards = alloc_shards(stegos, count);
+    Status status = shards != NULL ? e_success : e_failure;
+    char extension[STEGO_MAX_EXTN + 1] = "";
+
+    for (int i = 0; status == e_success && i < count; i++)   // headers first, they say where each piece goes
+    {
+        ShardHeader head;
+        StegoInfo info;
+
+        shards[i].set = &set;
+        if (map_image(&shards[i]) == e_failure || read_shard_header(&shards[i], &params, &head, &info) == e_failure)
+        {
+            status = e_failure;
+            break;
+        }
+        if (i == 0)
+        {
+            set.total = head.total;
+            set.count = head.count;
+            set.crc = head.crc;
+            strcpy(extension, info.extension);
+        }
+        else if (head.total != set.total || head.count != set.count || head.crc != set.crc)
+        {
+            printf("Error: %s belongs to another shard set than %s\n", shards[i].image, shards[0].image);
+            status = e_failure;
+        }
+    }
+    if (status == e_success)
+        status = check_set(shards, count, &set);
+
+    int fd = -1;
+    if (status == e_success)
+    {
+        fd = open(output_fname, O_RDWR | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+        if (fd < 0 || ftruncate(fd, set.total) != 0)   // size the output file up front
+        {
+            printf("Error: Unable to create output file %s\n", output_fname);
+            status = e_failure;
+        }
+        else if (set.total > 0)
+        {
+            set.out = mmap(NULL, set.total, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+            if (set.out == MAP_FAILED)
+            {
+                printf("Error: unable to map output file\n");
+                set.out = NULL;
+                status = e_failure;
+            }
+        }
+    }
+
+    double ms = 0;
+    if (status == e_success)
+        status = run_shards(shards, count, extract_shard, opts, &ms);
+
+    uint32_t crc = 0;
+    for (int i = 0; status == e_success && i < count; i++)   // pieces joined in index order
+        crc = crc32c_combine(crc, shards[i].crc, shards[i].size);
+    if (status == e_success && crc != set.crc)
+    {
+        printf("Error: the reassembled secret does not match its CRC32C\n");
+        status = e_failure;
+    }
+    if (status == e_success)
+        printf("Shards reassembled: %d images, %zu bytes (%s secret) in %s, %.2f ms (%.1f MB/s)\n", count,
+               set.total, extension, output_fname, ms, ms > 0 ? set.total / (ms * 1000.0) : 0.0);
+
+    if (set.out != NULL)
+        munmap(set.out, set.total);
+    if (fd >= 0)
+        close(fd);
+    if (shards != NULL)
+        unmap_shards(shards, count);
+    return status;
+}
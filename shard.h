@@ -0,0 +1,37 @@
+#ifndef SHARD_H
+#define SHARD_H
+
+#include <stddef.h>
+#include "types.h"    // Contains user-defined types
+#include "options.h"  // Contains command-line options
+
+/*
+ * Shard mode: split one secret over several cover images.
+ * Every cover gets a share of the secret in proportion to its
+ * capacity, so the embedding work is even, and the shards are
+ * embedded (or extracted) side by side on the work-stealing pool,
+ * each through the in-memory library on mapped images.
+ *
+ * A shard is an ordinary payload with STEGO_FLAG_SHARD set whose
+ * data starts with a shard header (little-endian fields):
+ *     total size (64 bit) | offset (64 bit) | shard index | shard count | CRC32C of the whole secret
+ * Version 1 payloads (no STEGO_FLAG_VARINT) hold 32-bit total size
+ * and offset fields; they are still read.
+ * followed by the secret bytes [offset, offset + data size - header).
+ * Decoding takes the stego images in any order, writes every shard
+ * at its offset and checks the joined CRC32C of the pieces against
+ * the one in the headers.
+ */
+
+#define SHARD_HEADER 28       // total size, offset, index, count and secret CRC
+#define SHARD_HEADER_V1 20    // the same with 32-bit total size and offset
+
+/* Embed secret_fname across the covers, writing each stego image to out_dir under its cover's name
+   (covers sharing a file name are refused before anything is written) */
+Status do_shard_encode(const char *secret_fname, const char *out_dir, char *covers[], int count,
+                       const StegoOptions *opts);
+
+/* Extract the shards held by the stego images and reassemble the secret into output_fname */
+Status do_shard_decode(const char *output_fname, char *stegos[], int count, const StegoOptions *opts);
+
+#endif
@@ -0,0 +1,134 @@
+#include <stdio.h>          // for printf
+#include <stdlib.h>         // for strtoull
+#include <string.h>         // for memset/strncmp
+#include <time.h>           // for clock_gettime
+#include <fcntl.h>          // for open
+#include <unistd.h>         // for read/close
+#include <sys/resource.h>   // for getrusage
+#include "stats.h"          // for stats declarations
+
+static const char *stage_names[STATS_STAGES] =
+{
+    "open", "capacity", "header", "magic", "extension", "size", "data", "tail_copy", "close"
+};
+
+double stats_now_ms(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000.0 + ts.tv_nsec / 1e6;
+}
+
+// value of "name: N" in /proc/self/io
+static unsigned long long io_field(const char *text, const char *name)
+{
+    const char *p = strstr(text, name);
+    return p != NULL ? strtoull(p + strlen(name), NULL, 10) : 0;
+}
+
+// take the process counters, returns 0 without /proc/self/io
+static int snapshot(IoCounters *io)
+{
+    char text[512];
+    struct rusage ru;
+    ssize_t got = -1;
+
+    memset(io, 0, sizeof(*io));
+    int fd = open("/proc/self/io", O_RDONLY);
+    if (fd >= 0)
+    {
+        got = read(fd, text, sizeof(text) - 1);
+        close(fd);
+    }
+
+    if (getrusage(RUSAGE_SELF, &ru) == 0)
+        io->faults = ru.ru_minflt + ru.ru_majflt;
+    if (got <= 0)
+        return 0;
+
+    text[got] = '\0';
+    io->rchar = io_field(text, "rchar:");
+    io->wchar = io_field(text, "wchar:");
+    io->syscr = io_field(text, "syscr:");
+    io->syscw = io_field(text, "syscw:");
+    io->self = got;   // counted by the next snapshot, not by the stage
+    return 1;
+}
+
+void stats_start(RunStats *stats, int enabled)
+{
+    memset(stats, 0, sizeof(*stats));
+    stats->enabled = enabled;
+    if (!enabled)
+        return;
+
+    stats->have_io = snapshot(&stats->last);
+    stats->start_ms = stats->last_ms = stats_now_ms();
+}
+
+Status stats_stage(RunStats *stats, StatsStage stage, Status status)
+{
+    if (!stats->enabled)
+        return status;
+
+    IoCounters now;
+    double ms = stats_now_ms();
+    snapshot(&now);
+
+    StageStats *st = &stats->stages[stage];
+    const IoCounters *last = &stats->last;
+    st->ran = 1;
+    st->ms += ms - stats->last_ms;
+    st->io.rchar += now.rchar - last->rchar - last->self;   // minus the previous snapshot's own read
+    st->io.wchar += now.wchar - last->wchar;
+    st->io.syscr += now.syscr - last->syscr - (last->self > 0);
+    st->io.syscw += now.syscw - last->syscw;
+    st->io.faults += now.faults - last->faults;
+
+    stats->last = now;
+    stats->last_ms = stats_now_ms();   // the snapshot is not charged to the next stage
+    return status;
+}
+
+// image name as a JSON string
+static void print_json_string(const char *s)
+{
+    putchar('"');
+    for (; s != NULL && *s != '\0'; s++)
+    {
+        if (*s == '"' || *s == '\\')
+            printf("\\%c", *s);
+        else if ((unsigned char)*s < 0x20)
+            printf("\\u%04x", *s);
+        else
+            putchar(*s);
+    }
+    putchar('"');
+}
+
+void stats_report(const RunStats *stats, const char *operation, const char *image, Status status)
+{
+    if (!stats->enabled)
+        return;
+
+    printf("{\"operation\":\"%s\",\"image\":", operation);
+    print_json_string(image);
+    printf(",\"status\":\"%s\",\"total_ms\":%.3f,\"io_counters\":%s,\"stages\":[",
+           status == e_success ? "ok" : "failed", stats->last_ms - stats->start_ms,
+           stats->have_io ? "true" : "false");
+
+    int first = 1;
+    for (int i = 0; i < STATS_STAGES; i++)
+    {
+        const StageStats *st = &stats->stages[i];
+        if (!st->ran)
+            continue;
+        printf("%s{\"stage\":\"%s\",\"ms\":%.3f,\"bytes_read\":%llu,\"bytes_written\":%llu,"
+               "\"read_syscalls\":%llu,\"write_syscalls\":%llu,\"page_faults\":%llu}",
+               first ? "" : ",", stage_names[i], st->ms, st->io.rchar, st->io.wchar,
+               st->io.syscr, st->io.syscw, st->io.faults);
+        first = 0;
+    }
+    printf("]}\n");
+    fflush(stdout);
+}
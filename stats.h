@@ -0,0 +1,71 @@
+#ifndef STATS_H
+#define STATS_H
+
+#include "types.h"  // Contains user-defined types
+
+/*
+ * Per-stage statistics for --stats.
+ * Each stage records its wall time and the process-wide I/O done
+ * while it ran: bytes and read/write syscalls from /proc/self/io
+ * (worker threads included, console output too) and page faults,
+ * which is where memory mapped images do their I/O. The report is
+ * one JSON object printed when the operation finishes.
+ */
+
+typedef enum
+{
+    e_stage_open,
+    e_stage_capacity,
+    e_stage_header,
+    e_stage_magic,
+    e_stage_extension,
+    e_stage_size,
+    e_stage_data,
+    e_stage_tail,
+    e_stage_close,
+    STATS_STAGES
+} StatsStage;
+
+typedef struct _IoCounters
+{
+    unsigned long long rchar;     // bytes read
+    unsigned long long wchar;     // bytes written
+    unsigned long long syscr;     // read syscalls
+    unsigned long long syscw;     // write syscalls
+    unsigned long long faults;    // minor + major page faults
+    unsigned long long self;      // bytes the snapshot itself read from /proc
+
+} IoCounters;
+
+typedef struct _StageStats
+{
+    int ran;                        // stage was reached
+    double ms;
+    IoCounters io;                  // counters spent in the stage
+
+} StageStats;
+
+typedef struct _RunStats
+{
+    int enabled;                    // --stats given
+    int have_io;                    // /proc/self/io could be read
+    double start_ms;
+    double last_ms;                 // end of the previous stage
+    IoCounters last;                // counters at the end of the previous stage
+    StageStats stages[STATS_STAGES];
+
+} RunStats;
+
+/* Monotonic wall clock in milliseconds, for timing stages, jobs and requests */
+double stats_now_ms(void);
+
+/* Reset the counters and start timing when enabled */
+void stats_start(RunStats *stats, int enabled);
+
+/* Charge the time and I/O since the previous stage to stage, returns status unchanged */
+Status stats_stage(RunStats *stats, StatsStage stage, Status status);
+
+/* Print the JSON report of a finished operation */
+void stats_report(const RunStats *stats, const char *operation, const char *image, Status status);
+
+#endif
@@ -0,0 +1,475 @@
+#include <stdio.h>      // for vsnprintf
+#include <stdlib.h>     // for malloc/free
+#include <string.h>     // for memcpy/strlen
+#include <stdarg.h>     // for va_list
+#include "stego.h"      // for libstego declarations
+#include "block.h"      // for the block engine over caller memory
+#include "lz.h"         // for packed payloads
+#include "range.h"      // for random-access reads of the data
+#include "varint.h"     // for version 2 size fields
+#include "cover.h"      // for the image header in any cover format
+
+static StegoErrorFn error_handler;   // set once by the program before it calls in
+
+void stego_set_error_handler(StegoErrorFn fn)
+{
+    error_handler = fn;
+}
+
+void stego_error(const char *fmt, ...)
+{
+    char msg[512];
+    va_list args;
+
+    if (error_handler == NULL)
+        return;
+
+    va_start(args, fmt);
+    vsnprintf(msg, sizeof(msg), fmt, args);
+    va_end(args);
+    error_handler(msg);
+}
+
+// parse the image header and make sure the whole pixel array is inside an image of len bytes
+static Status check_image(const uint8_t *image, size_t head_len, size_t len, BmpInfo *bmp)
+{
+    if (image == NULL || cover_parse(image, head_len, bmp) == e_failure ||
+        bmp->pixel_offset + bmp->stride * (bmp->rows - 1) + bmp->row_bytes > len)
+        return e_failure;
+    return e_success;
+}
+
+// layout asked for by params on this cover's pixel size
+static Status params_layout(const BmpInfo *bmp, const StegoParams *params, LsbLayout *layout)
+{
+    return lsb_get_layout(params->bits ? params->bits : 1, cover_channels(bmp, params->channels), bmp->bits_per_pixel / 8, layout);
+}
+
+// pixel bytes left after the engine's current position in an image of len bytes
+static size_t cover_left(BlockIO *io, size_t len)
+{
+    size_t left = bmp_bytes_left(&io->rows, block_offset(io));
+    return left < len - block_offset(io) ? left : len - block_offset(io);
+}
+
+static size_t extension_len(const StegoParams *params)
+{
+    return params->extension != NULL ? strlen(params->extension) : 0;
+}
+
+// bytes of the size field for a payload stored with these flags
+static size_t size_field_len(int flags, size_t size)
+{
+    return flags & STEGO_FLAG_VARINT ? varint_len(size) : 4;
+}
+
+// bytes of the key salt after the size field
+static size_t salt_len(int flags)
+{
+    return flags & STEGO_FLAG_CIPHER ? CIPHER_SALT_LEN : 0;
+}
+
+// flags params describe, the scatter key and the cipher included
+static int params_flags(const StegoParams *params)
+{
+    return params->flags | (params->key != NULL ? STEGO_FLAG_SCATTER : 0) | (params->cipher != NULL ? STEGO_FLAG_CIPHER : 0);
+}
+
+size_t stego_header_len(const StegoParams *params, size_t secret_len)
+{
+    int flags = params_flags(params);
+    int classic = params->bits <= 1 && params->channels == 0 && flags == 0 && secret_len <= UINT32_MAX;
+
+    return strlen(params->magic) + 1 + 4 + extension_len(params) +
+           (classic ? 4 : varint_len(secret_len) + salt_len(flags));
+}
+
+int stego_format_flags(const LsbLayout *layout, int flags, size_t secret_len)
+{
+    if (layout->bits == 1 && layout->mask == 0 && flags == 0 && secret_len <= UINT32_MAX)
+        return 0;                                // classic payload, readable by older builds
+    return flags | STEGO_FLAG_VARINT;
+}
+
+uint32_t stego_format_word(const LsbLayout *layout, size_t extn_len, int flags)
+{
+    if (layout->bits == 1 && layout->mask == 0 && flags == 0)
+        return extn_len;                         // classic payload, readable by older builds
+
+    return STEGO_FORMAT_WORD | layout->bits | layout->mask << 4 | layout->bytes_per_pixel << 8 |
+           (uint32_t)(flags >> 7) << 12 | extn_len << 16 | (uint32_t)(flags & 0x7F) << 24;
+}
+
+Status stego_parse_format(uint32_t word, size_t *extn_len, int *flags, LsbLayout *layout)
+{
+    if (!(word & STEGO_FORMAT_WORD))
+    {
+        *extn_len = word;
+        *flags = 0;
+        lsb_get_layout(1, 0, 0, layout);
+    }
+    else
+    {
+        *extn_len = STEGO_FORMAT_EXTN(word);
+        *flags = STEGO_FORMAT_FLAGS(word);
+        if ((*flags & ~STEGO_KNOWN_FLAGS) != 0 ||    // written by a newer build
+            lsb_get_layout(STEGO_FORMAT_BITS(word), STEGO_FORMAT_MASK(word), STEGO_FORMAT_BPP(word), layout) == e_failure)
+            return e_failure;
+    }
+    return *extn_len <= STEGO_MAX_EXTN ? e_success : e_failure;
+}
+
+static void put_le32(uint8_t *p, uint32_t v)
+{
+    p[0] = v;
+    p[1] = v >> 8;
+    p[2] = v >> 16;
+    p[3] = v >> 24;
+}
+
+static uint32_t get_le32(const uint8_t *p)
+{
+    return p[0] | (p[1] << 8) | (p[2] << 16) | ((uint32_t)p[3] << 24);
+}
+
+size_t stego_pack_bound(size_t len, size_t chunk)
+{
+    if (chunk == 0)
+        return VARINT_MAX_LEN + lz_bound(len);
+
+    size_t count = (len + chunk - 1) / chunk;
+    return STEGO_PACK_HEADER_MAX + count * 4 + lz_bound(len) + count * 16;   // each chunk may carry a stream's overhead
+}
+
+size_t stego_pack(const uint8_t *secret, size_t len, size_t chunk, uint8_t *out)
+{
+    if (chunk > UINT32_MAX)   // packed chunk lengths are 32-bit table entries
+        return 0;
+
+    size_t head = varint_put(out, len);   // always a version 2 header, packing sets a format word
+    if (chunk == 0)
+    {
+        size_t packed = head + lz_compress(secret, len, out + head);
+        return packed < len ? packed : 0;
+    }
+
+    size_t count = (len + chunk - 1) / chunk;
+    head += varint_put(out + head, chunk);
+    head += varint_put(out + head, count);
+    uint8_t *table = out + head;
+    size_t packed = head + count * 4;
+
+    for (size_t k = 0; k < count; k++)   // every chunk on its own, so ranges unpack independently
+    {
+        const uint8_t *raw = secret + k * chunk;
+        size_t rlen = len - k * chunk < chunk ? len - k * chunk : chunk;
+        size_t n = lz_compress(raw, rlen, out + packed);
+        if (n >= rlen)
+        {
+            memcpy(out + packed, raw, rlen);
+            n = rlen;
+        }
+        put_le32(table + k * 4, n);
+        packed += n;
+    }
+    return packed < len ? packed : 0;
+}
+
+size_t stego_unpacked_size(const uint8_t *packed, size_t len, int flags, size_t *head_len)
+{
+    uint64_t size;
+
+    *head_len = 0;
+    if (!(flags & STEGO_FLAG_VARINT))
+    {
+        if (len < 4)
+            return 0;
+        size = get_le32(packed);
+        *head_len = 4;
+    }
+    else if ((*head_len = varint_get(packed, len, &size)) == 0)
+        return 0;
+
+    return size <= (len - *head_len) * LZ_MAX_RATIO ? size : 0;   // more than any stream of len bytes can hold
+}
+
+
+// magic and format word always use 1 bit per byte, a channel mask may need to skip to the next pixel
+static size_t fixed_cover(const StegoParams *params, const LsbLayout *layout, size_t secret_len)
+{
+    size_t fixed = (strlen(params->magic) + 1 + 4) * 8;
+    int flags = stego_format_flags(layout, params_flags(params), secret_len);
+
+    if (layout->mask != 0)
+        fixed += layout->bytes_per_pixel - 1;
+    return fixed + lsb_layout_cover(layout, extension_len(params) + size_field_len(flags, secret_len) + salt_len(flags));
+}
+
+size_t stego_data_len(const LsbLayout *layout, size_t stored, int flags)
+{
+    if (!(flags & STEGO_FLAG_CRC))
+        return stored;
+    return (stored + layout->step_data - 1) / layout->step_data * layout->step_data + STEGO_CRC_LEN;
+}
+
+size_t stego_cover_needed(const StegoParams *params, const LsbLayout *layout, size_t secret_len)
+{
+    return fixed_cover(params, layout, secret_len) + lsb_layout_cover(layout, stego_data_len(layout, secret_len, params->flags));
+}
+
+size_t stego_capacity(const uint8_t *cover, size_t cover_len, const StegoParams *params)
+{
+    LsbLayout layout;
+    BmpInfo bmp;
+
+    if (check_image(cover, cover_len, cover_len, &bmp) == e_failure || params->magic == NULL ||
+        params_layout(&bmp, params, &layout) == e_failure)
+        return 0;
+
+    size_t pixels = bmp_pixel_bytes(&bmp);
+    size_t fixed = fixed_cover(params, &layout, pixels) +   // no secret is larger than the pixels, nor is its size field
+                   (params->key != NULL ? SCATTER_BLOCK : 0);   // scattering leaves part of a block
+    if (params->flags & STEGO_FLAG_CRC)
+        fixed += lsb_layout_cover(&layout, STEGO_CRC_LEN);
+    return pixels > fixed ? (pixels - fixed) / layout.step_cover * layout.step_data : 0;
+}
+
+Status stego_encode(const uint8_t *cover, size_t cover_len, const uint8_t *secret, size_t secret_len,
+                    const StegoParams *params, uint8_t *out)
+{
+    BlockIO io = {0};
+    LsbLayout layout;
+    BmpInfo bmp;
+    const char *extn = params->extension != NULL ? params->extension : "";
+    size_t magic_len = params->magic != NULL ? strlen(params->magic) : 0;
+    int flags = params_flags(params);
+
+    if (magic_len == 0 || magic_len > STEGO_MAX_MAGIC || strlen(extn) > STEGO_MAX_EXTN ||
+        ((flags & STEGO_FLAG_CIPHER) && params->cipher == NULL) || secret_len > stego_capacity(cover, cover_len, params) ||
+        check_image(cover, cover_len, cover_len, &bmp) == e_failure || params_layout(&bmp, params, &layout) == e_failure)
+        return e_failure;
+    flags = stego_format_flags(&layout, flags, secret_len);
+
+    if (out != cover)
+        memcpy(out, cover, bmp.pixel_offset);   // image header (and palette) goes across unchanged
+    block_attach(&io, cover, out, cover_len, bmp.pixel_offset);
+    bmp_rows(&bmp, &io.rows);
+
+    if (block_embed(&io, params->magic, magic_len + 1) == e_failure ||       // magic + '\0'
+        block_embed_size(&io, stego_format_word(&layout, strlen(extn), flags)) == e_failure ||
+        block_set_layout(&io, &layout) == e_failure ||
+        block_embed(&io, extn, strlen(extn)) == e_failure ||
+        block_embed_field(&io, flags & STEGO_FLAG_VARINT, secret_len) == e_failure ||
+        ((flags & STEGO_FLAG_CIPHER) && block_embed(&io, (const char *)params->cipher->salt, CIPHER_SALT_LEN) == e_failure) ||
+        block_align_step(&io) == e_failure)
+        return e_failure;
+
+    long data_off = block_offset(&io);
+    if (params->key != NULL &&   // the whole data area goes across first, the blocks are rewritten after
+        (block_copy_tail(&io) == e_failure ||
+         block_scatter(&io, data_off, stego_data_len(&layout, secret_len, flags), scatter_seed(params->key)) == e_failure))
+        return e_failure;
+
+    io.cipher = params->cipher;   // encrypted on the way into the kernels
+    block_crc_start(&io);
+    if (block_embed(&io, (const char *)secret, secret_len) == e_failure)
+        return e_failure;
+    uint32_t crc = block_crc_stop(&io);
+
+    if ((flags & STEGO_FLAG_CRC) &&
+        (block_align_step(&io) == e_failure || block_embed_size(&io, crc) == e_failure))
+        return e_failure;
+
+    if (params->key != NULL)
+        return block_align_step(&io);
+    return block_copy_tail(&io);   // untouched pixels after the payload
+}
+
+// look for the magic with io walking rows over the first head_len bytes of the image
+static Status match_magic(BlockIO *io, const uint8_t *stego, size_t head_len, const BmpRows *rows,
+                          const StegoParams *params)
+{
+    char magic[STEGO_MAX_MAGIC + 1];
+    size_t magic_len = strlen(params->magic);
+
+    block_attach(io, stego, NULL, head_len, rows->first);
+    io->rows = *rows;
+    if (cover_left(io, head_len) < (magic_len + 1 + 4) * 8 ||
+        block_extract(io, magic, magic_len + 1) == e_failure ||
+        memcmp(magic, params->magic, magic_len + 1) != 0)      // magic and its terminating '\0'
+        return e_failure;
+    return e_success;
+}
+
+// read the payload header from the first head_len bytes of a stego_len byte image,
+// leaving io at the first secret byte
+static Status read_header(BlockIO *io, const uint8_t *stego, size_t head_len, size_t stego_len,
+                          const StegoParams *params, StegoInfo *info)
+{
+    BmpInfo bmp;
+    long word;
+    uint64_t size;
+    size_t extn_size;
+    size_t magic_len = params->magic != NULL ? strlen(params->magic) : 0;
+
+    if (check_image(stego, head_len, stego_len, &bmp) == e_failure || magic_len == 0 || magic_len > STEGO_MAX_MAGIC)
+        return e_failure;
+
+    BmpRows rows;
+    bmp_rows(&bmp, &rows);
+    if (match_magic(io, stego, head_len, &rows, params) == e_failure)
+    {
+        // payloads written before row parsing ran over padding from byte 54 on, and only in a BMP
+        if (bmp.format != e_cover_bmp || (bmp.pixel_offset == STEGO_BMP_HEADER_SIZE && bmp.stride == bmp.row_bytes))
+            return e_failure;
+        bmp_rows_flat(&rows, STEGO_BMP_HEADER_SIZE);
+        if (match_magic(io, stego, head_len, &rows, params) == e_failure)
+            return e_failure;
+    }
+
+    if (block_extract_size(io, &word) == e_failure ||
+        stego_parse_format(word, &extn_size, &info->flags, &info->layout) == e_failure ||
+        block_set_layout(io, &info->layout) == e_failure ||
+        cover_left(io, head_len) < lsb_layout_cover(&info->layout, extn_size + size_field_len(info->flags, 0) + salt_len(info->flags)))
+        return e_failure;
+
+    int varint = info->flags & STEGO_FLAG_VARINT;
+    if (block_extract(io, info->extension, extn_size) == e_failure ||
+        block_extract_field(io, varint, &size) == e_failure ||
+        ((info->flags & STEGO_FLAG_CIPHER) && block_extract(io, (char *)info->salt, CIPHER_SALT_LEN) == e_failure) ||
+        block_align_step(io) == e_failure)
+        return e_failure;
+    info->extension[extn_size] = '\0';
+
+    if (size > stego_len ||   // truncated or not a payload
+        cover_left(io, stego_len) < lsb_layout_cover(&info->layout, stego_data_len(&info->layout, size, info->flags)))
+        return e_failure;
+
+    info->payload_size = info->stored_size = size;
+    info->data_offset = block_offset(io);
+
+    if (info->flags & STEGO_FLAG_SCATTER)
+    {
+        if (params->key == NULL)   // found, but only the key tells where the data is
+            return e_success;
+        if (block_scatter(io, info->data_offset, stego_data_len(&info->layout, size, info->flags),
+                          scatter_seed(params->key)) == e_failure ||
+            block_seek_step(io, info->data_offset, 0) == e_failure)
+            return e_failure;
+    }
+
+    if (info->flags & STEGO_FLAG_CIPHER)
+    {
+        if (params->cipher == NULL)   // found, but the packed header is encrypted
+            return e_success;
+        if (memcmp(params->cipher->salt, info->salt, CIPHER_SALT_LEN) != 0)   // derived for another payload
+            return e_failure;
+        io->cipher = params->cipher;
+        block_cipher_at(io, 0);
+    }
+
+    if (info->flags & STEGO_FLAG_LZ)   // the original size leads the packed data
+    {
+        uint64_t original;
+        size_t field = size_field_len(info->flags, 0);
+        if (size < field || cover_left(io, head_len) < lsb_layout_cover(&info->layout, field) ||
+            block_extract_field(io, varint, &original) == e_failure)
+            return e_failure;
+        field = size_field_len(info->flags, original);
+        if (size < field || original > (size - field) * LZ_MAX_RATIO)   // more than the packed bytes can hold
+            return e_failure;
+        info->payload_size = original;
+    }
+    return e_success;
+}
+
+Status stego_peek(const uint8_t *stego, size_t stego_len, const StegoParams *params, StegoInfo *info)
+{
+    BlockIO io = {0};
+
+    return read_header(&io, stego, stego_len, stego_len, params, info);
+}
+
+size_t stego_probe_len(const uint8_t *header, size_t header_len, const StegoParams *params)
+{
+    BmpInfo bmp;
+    BmpRows rows;
+
+    if (params->magic == NULL || cover_parse(header, header_len, &bmp) == e_failure)
+        return 0;
+
+    // magic and format word, a pixel of alignment, then the longest extension, size, salt and
+    // packed size fields under the sparsest layout and the step the data is aligned to
+    size_t pixels = (strlen(params->magic) + 1 + 4) * 8 + 4 +
+                    (STEGO_MAX_EXTN + 2 * VARINT_MAX_LEN + CIPHER_SALT_LEN + 1) * LSB_MAX_STEP_COVER;
+    bmp_rows(&bmp, &rows);
+    size_t len = bmp_advance(&rows, rows.first, pixels);
+    size_t legacy = bmp.format == e_cover_bmp ? STEGO_BMP_HEADER_SIZE + pixels : 0;   // room for the pre-row-parsing fallback
+    return len > legacy ? len : legacy;
+}
+
+Status stego_probe(const uint8_t *head, size_t head_len, size_t image_len, const StegoParams *params,
+                   StegoInfo *info)
+{
+    BlockIO io = {0};
+
+    return read_header(&io, head, head_len, image_len, params, info);
+}
+
+// whether params hold what the data needs: the scatter key and the cipher
+static int data_readable(const StegoParams *params, const StegoInfo *info)
+{
+    return !((info->flags & STEGO_FLAG_SCATTER) && params->key == NULL) &&
+           !((info->flags & STEGO_FLAG_CIPHER) && params->cipher == NULL);
+}
+
+Status stego_decode(const uint8_t *stego, size_t stego_len, const StegoParams *params,
+                    uint8_t *out, size_t out_cap, StegoInfo *info)
+{
+    BlockIO io = {0};
+
+    if (read_header(&io, stego, stego_len, stego_len, params, info) == e_failure || info->payload_size > out_cap ||
+        !data_readable(params, info))
+        return e_failure;
+
+    if (!(info->flags & STEGO_FLAG_LZ))   // straight into out, checksummed on the way
+    {
+        block_crc_start(&io);
+        if (block_extract(&io, (char *)out, info->payload_size) == e_failure)
+            return e_failure;
+        return range_check_crc(&io, info->flags, block_crc_stop(&io));
+    }
+
+    size_t len;
+    return stego_decode_range(stego, stego_len, params, 0, RANGE_ALL, out, &len, info);
+}
+
+typedef struct _MemorySink
+{
+    uint8_t *out;
+    size_t len;
+
+} MemorySink;
+
+static Status write_memory(void *ctx, const unsigned char *data, size_t n)
+{
+    MemorySink *sink = ctx;
+
+    memcpy(sink->out + sink->len, data, n);
+    sink->len += n;
+    return e_success;
+}
+
+Status stego_decode_range(const uint8_t *stego, size_t stego_len, const StegoParams *params,
+                          size_t off, size_t len, uint8_t *out, size_t *out_len, StegoInfo *info)
+{
+    BlockIO io = {0};
+    MemorySink sink = { out, 0 };
+
+    if (read_header(&io, stego, stego_len, stego_len, params, info) == e_failure || !data_readable(params, info) ||
+        range_read(&io, info->data_offset, info->stored_size, info->flags, off, len, write_memory, &sink) == e_failure)
+        return e_failure;
+
+    *out_len = sink.len;
+    return e_success;
+}
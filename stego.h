@@ -0,0 +1,191 @@
+#ifndef STEGO_H
+#define STEGO_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include "types.h"  // Contains user-defined types
+#include "lsb.h"    // Contains the kernel layouts
+#include "cipher.h" // Contains the data keystream
+
+/*
+ * libstego: in-memory LSB steganography.
+ * Every function works on caller-owned buffers only (apart from
+ * scratch memory for packed payloads); nothing here opens files or
+ * prints to the console (failures are reported to the handler given
+ * to stego_set_error_handler, if any), so it can be linked into
+ * other programs: compile stego.c, block.c, lsb.c, bmp.c, cover.c,
+ * pnm.c, tga.c, lz.c, range.c, scatter.c, crc32c.c, copy.c, varint.c
+ * and cipher.c into the library, which links on its own:
+ *     gcc -shared -fPIC -Wl,--no-undefined -o libstego.so <those files>
+ * The io_uring backend (uring.c) stays outside, it hooks itself into
+ * the block engine when a ring is set up. The command-line tool's
+ * memory mapped path is a thin wrapper around these calls.
+ *
+ * Payload layout, embedded in the pixel bytes of each row (row
+ * padding skipped) from the first pixel on, one secret byte per
+ * 8 cover bytes:
+ *     magic '\0' | extension length (32 bit) | extension | size (32 bit) | data
+ * This classic (version 1) header is still written when it can
+ * describe the payload, so older builds read it.
+ *
+ * With a k-LSB layout or a channel mask the extension length is
+ * replaced by a format word (top bit set, so never a valid length)
+ * and everything after it uses that layout, starting on a pixel
+ * boundary when a mask is set; the data starts on a new layout step:
+ *     magic '\0' | format word (32 bit) | extension | size | data
+ *
+ * Flags in the format word describe the data. STEGO_FLAG_VARINT
+ * marks a version 2 header: the size field and the size fields of
+ * a packed header are varints of up to 64 bits (see varint.h), one
+ * byte for sizes below 128. Every payload with a format word is
+ * written as version 2; version 1 format words are still read.
+ * With STEGO_FLAG_LZ the data is a packed secret, size counting the
+ * packed bytes:
+ *     original size | LZ stream
+ * and with STEGO_FLAG_CHUNKED as well the secret is packed in
+ * fixed-size chunks behind a table of their packed lengths, so any
+ * range can be unpacked on its own (a chunk that does not shrink is
+ * stored as is):
+ *     original size | chunk size | chunk count | packed length of each chunk (32 bit) | chunks
+ * The fields before the table are 32 bits each in version 1.
+ * STEGO_FLAG_SCATTER spreads the data (not the fields before it)
+ * over keyed pixel blocks, see scatter.h; reading it needs the key.
+ * STEGO_FLAG_CRC appends the CRC32C of the data bytes, starting on
+ * a fresh layout step after them, so it is taken in the embedding
+ * pass and checked in the extracting one:
+ *     ... | size | data | CRC32C (32 bit)
+ * STEGO_FLAG_SHARD marks one piece of a secret split over several
+ * covers; the data starts with a shard header, see shard.h.
+ * STEGO_FLAG_CONTAINER marks several files behind a directory, see
+ * container.h.
+ * STEGO_FLAG_CIPHER marks data encrypted with ChaCha20 (see cipher.h);
+ * the salt of its key follows the size field:
+ *     ... | size | salt (16 bytes) | data | CRC32C
+ * Everything from the data on is encrypted, the CRC32C is taken over
+ * the plaintext. The flag is the first one past bit 30 and lives in
+ * the format word's bits 12-15, which older builds ignore; they see a
+ * plain payload there and fail its CRC32C.
+ */
+
+#define STEGO_BMP_HEADER_SIZE 54   // where payloads written before row parsing start
+#define STEGO_MAX_MAGIC 99         // longest magic string
+#define STEGO_MAX_EXTN 9           // longest stored extension, dot included
+
+#define STEGO_FORMAT_WORD       0x80000000u             // field after the magic is a format word
+#define STEGO_FORMAT_BITS(w)    ((w) & 0x0F)            // LSBs per cover byte
+#define STEGO_FORMAT_MASK(w)    (((w) >> 4) & 0x0F)     // channel mask, 0 for every byte
+#define STEGO_FORMAT_BPP(w)     (((w) >> 8) & 0x0F)     // bytes per pixel the mask refers to
+#define STEGO_FORMAT_EXTN(w)    (((w) >> 16) & 0xFF)    // extension length
+#define STEGO_FORMAT_FLAGS(w)   ((((w) >> 24) & 0x7F) | (((w) >> 5) & 0x780))   // STEGO_FLAG_* bits, 7-10 from bits 12-15
+
+#define STEGO_FLAG_LZ      0x01     // data is an LZ packed secret (stego_pack)
+#define STEGO_FLAG_CHUNKED 0x02     // packed in chunks behind a chunk table (stego_pack with a chunk size)
+#define STEGO_FLAG_SCATTER 0x04     // data spread over keyed pixel blocks (params->key)
+#define STEGO_FLAG_CRC     0x08     // a CRC32C of the data follows it
+#define STEGO_FLAG_SHARD   0x10     // data is one shard of a split secret
+#define STEGO_FLAG_VARINT  0x20     // version 2 header: 64-bit varint size fields
+#define STEGO_FLAG_CONTAINER 0x40   // data is a directory and several files
+#define STEGO_FLAG_CIPHER  0x80     // data encrypted with ChaCha20 (params->cipher)
+#define STEGO_KNOWN_FLAGS  (STEGO_FLAG_LZ | STEGO_FLAG_CHUNKED | STEGO_FLAG_SCATTER | STEGO_FLAG_CRC | \
+                            STEGO_FLAG_SHARD | STEGO_FLAG_VARINT | STEGO_FLAG_CONTAINER | STEGO_FLAG_CIPHER)
+
+#define STEGO_CHUNK_HEADER 12       // original size, chunk size and chunk count of a version 1 packed header
+#define STEGO_PACK_HEADER_MAX 30    // the same as three varints
+#define STEGO_CRC_LEN 4             // CRC32C trailer
+
+typedef struct _StegoParams
+{
+    const char *magic;       // magic string identifying the payload
+    const char *extension;   // extension stored with the payload (encode only, may be NULL)
+    int bits;                // LSBs per cover byte (encode only, 0 means 1)
+    int channels;            // LSB_CH_* channel mask (encode only, 0 for every byte)
+    int flags;               // STEGO_FLAG_* describing the secret (encode only)
+    const char *key;         // scatter key, NULL for data right after the header
+    const Cipher *cipher;    // data keystream, NULL for plain data; decoding needs the one derived from the stored salt
+
+} StegoParams;
+
+typedef struct _StegoInfo
+{
+    char extension[STEGO_MAX_EXTN + 1];   // extension stored with the payload
+    size_t payload_size;                  // secret bytes, after unpacking (stored bytes for scattered
+                                          // or encrypted packed data read without the key or cipher)
+    size_t stored_size;                   // data bytes embedded in the image
+    int flags;                            // STEGO_FLAG_* of the payload
+    size_t data_offset;                   // image offset of the first secret byte
+    LsbLayout layout;                     // layout of the extension, size and data
+    uint8_t salt[CIPHER_SALT_LEN];        // salt of the key of encrypted data
+
+} StegoInfo;
+
+/* Receives the message of a failure inside the library, one line without its newline */
+typedef void (*StegoErrorFn)(const char *msg);
+
+/* Send the library's failure messages to fn; NULL (the default) keeps the library silent */
+void stego_set_error_handler(StegoErrorFn fn);
+
+/* Report a failure to the handler, for the library's own sources */
+void stego_error(const char *fmt, ...) __attribute__((format(printf, 1, 2)));
+
+/* Bytes of payload header (magic, extension and size fields) for a secret_len byte secret */
+size_t stego_header_len(const StegoParams *params, size_t secret_len);
+
+/* Flags stored for a payload: flags plus STEGO_FLAG_VARINT, unless the classic
+   version 1 header (no format word, 32-bit size) can still describe it */
+int stego_format_flags(const LsbLayout *layout, int flags, size_t secret_len);
+
+/* Field stored after the magic: the plain extension length, or a format word for other layouts or flags */
+uint32_t stego_format_word(const LsbLayout *layout, size_t extn_len, int flags);
+
+/* Split the field stored after the magic into the extension length, flags and layout */
+Status stego_parse_format(uint32_t word, size_t *extn_len, int *flags, LsbLayout *layout);
+
+/* Bytes stego_pack may need for a len byte secret */
+size_t stego_pack_bound(size_t len, size_t chunk);
+
+/* Pack a secret in chunk byte chunks (0 for one stream) for embedding with STEGO_FLAG_LZ
+   (and STEGO_FLAG_CHUNKED), returns the packed length or 0 when packing does not make it smaller */
+size_t stego_pack(const uint8_t *secret, size_t len, size_t chunk, uint8_t *out);
+
+/* Original size of a packed secret written with these flags, 0 when the header is implausible;
+   *head_len receives the bytes of its header (up to the LZ stream or chunk table) */
+size_t stego_unpacked_size(const uint8_t *packed, size_t len, int flags, size_t *head_len);
+
+/* Payload bytes of the data section: stored bytes of data and, with STEGO_FLAG_CRC, the step aligned CRC */
+size_t stego_data_len(const LsbLayout *layout, size_t stored, int flags);
+
+/* Pixel bytes a payload of secret_len bytes takes under layout */
+size_t stego_cover_needed(const StegoParams *params, const LsbLayout *layout, size_t secret_len);
+
+/* Largest secret that fits into the cover, 0 when the cover is unusable */
+size_t stego_capacity(const uint8_t *cover, size_t cover_len, const StegoParams *params);
+
+/* Hide secret in cover, out receives cover_len bytes (out may equal cover).
+   With STEGO_FLAG_LZ in params->flags secret must come from stego_pack */
+Status stego_encode(const uint8_t *cover, size_t cover_len, const uint8_t *secret, size_t secret_len,
+                    const StegoParams *params, uint8_t *out);
+
+/* Check the magic and read the payload header without extracting the data.
+   Scattered data is only located (and checked) with params->key */
+Status stego_peek(const uint8_t *stego, size_t stego_len, const StegoParams *params, StegoInfo *info);
+
+/* Bytes from the start of an image that stego_probe needs, from its first header_len
+   bytes (enough for the image header); 0 when the header is unusable or cut short */
+size_t stego_probe_len(const uint8_t *header, size_t header_len, const StegoParams *params);
+
+/* stego_peek on only the first head_len bytes of an image_len byte image */
+Status stego_probe(const uint8_t *head, size_t head_len, size_t image_len, const StegoParams *params,
+                   StegoInfo *info);
+
+/* Extract the payload into out (out_cap bytes, unpacked), info receives the header fields.
+   Fails when the data does not match its CRC32C */
+Status stego_decode(const uint8_t *stego, size_t stego_len, const StegoParams *params,
+                    uint8_t *out, size_t out_cap, StegoInfo *info);
+
+/* Extract payload bytes [off, off + len) into out, len clipped to the end of the payload
+   (*out_len receives the count). Only the chunks covering the range are unpacked; the CRC32C
+   is checked when len is RANGE_ALL from offset 0 */
+Status stego_decode_range(const uint8_t *stego, size_t stego_len, const StegoParams *params,
+                          size_t off, size_t len, uint8_t *out, size_t *out_len, StegoInfo *info);
+
+#endif
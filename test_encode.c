@@ -22,35 +22,92 @@ Key Features    : -> Magic string + magic length validation
 #include "encode.h"       // Header file for encoding operations
 #include "decode.h"      // Header file for decoding operations 
 #include "types.h"      // Header file containing enum definitions and constants
+#include "options.h"    // Header file for command-line options
+#include "lsb.h"        // Header file for the LSB kernels
+#include "batch.h"      // Header file for batch mode
+#include "scan.h"       // Header file for scan mode
+#include "bench.h"      // Header file for benchmark mode
+#include "shard.h"      // Header file for shard mode
+#include "daemon.h"     // Header file for the stegod daemon
+#include "stego.h"      // Header file for the library error handler
 #include <string.h>    // For string handling functions
 
+static int run_operation(int argc, char *argv[], StegoOptions *opts);
+
 int main(int argc,char *argv[])
 {
     if (argc < 2)
     {
         printf("Usage:\n");
-        printf("  Encoding: %s -e <.bmp file> <secret.txt> [output_stego.bmp]\n", argv[0]);
-        printf("  Decoding: %s -d <stego.bmp> [output.txt]\n", argv[0]);
+        printf("  Encoding: %s -e <cover image> <secret.txt> [output_stego image]\n", argv[0]);
+        printf("  Decoding: %s -d <stego image> [output.txt]\n", argv[0]);
+        printf("            images may be BMP, binary PPM/PAM or uncompressed TGA, told apart by their header\n");
+        printf("            any of these files may be - for stdin / stdout (needs -m when reading stdin)\n");
+        printf("  Batch   : %s --batch <manifest> [-j workers]\n", argv[0]);
+        printf("  Scan    : %s scan <directory> [index.tsv] -m <magic> [-j workers]\n", argv[0]);
+        printf("  Bench   : %s bench [megapixels ...] [-b bytes] [-j threads] [--kernel k]\n", argv[0]);
+        printf("  Shard   : %s shard -e <secret.txt> <output_dir> <cover.bmp>... -m <magic> [-j workers]\n", argv[0]);
+        printf("            %s shard -d <output.txt> <stego.bmp>... -m <magic> [-j workers]\n", argv[0]);
+        printf("  Daemon  : %s stegod <socket> [-j workers] [--uring]   one batch job per line on a Unix socket\n", argv[0]);
+        printf("  Options : -b <bytes>  pixel block size (default %d)\n", DEFAULT_BLOCK_SIZE);
+        printf("            --kernel <auto|scalar|sse2|avx2|bmi2>  force an LSB kernel\n");
+        printf("            --mmap      memory map the images instead of streaming them\n");
+        printf("            -j <n>      split the data section and tail copy across n threads\n");
+        printf("            -m <magic>  magic string, skips the interactive prompts\n");
+        printf("            --bits <1|2|4>      LSBs used per cover byte when encoding (default 1)\n");
+        printf("            --channels <bgra>   only embed in these channels, e.g. b or bgr\n");
+        printf("            -z, --compress      LZ pack the secret before embedding\n");
+        printf("            --chunk <bytes>     pack in independent chunks so ranges decode on their own\n");
+        printf("            --range <off:len>   decode only these payload bytes (len may be omitted)\n");
+        printf("            --key <text>        scatter the data over keyed pixel blocks (needed to decode it)\n");
+        printf("            --pass <text>       encrypt the data with ChaCha20 under this passphrase (needed to decode it)\n");
+        printf("            --pass-file <file>  the same with a key file instead of a passphrase\n");
+        printf("            --no-crc    leave out the CRC32C check of the secret data\n");
+        printf("            --size <bytes>      length of a secret piped in on stdin, streamed instead of buffered\n");
+        printf("            --in-place  embed into the cover itself, only the payload bytes are rewritten\n");
+        printf("            --uring     batch: keep cover reads and stego writes in flight with io_uring\n");
+        printf("            --add <file>        embed this file too, in a container with a directory (repeatable)\n");
+        printf("            --list              print the directory of a container\n");
+        printf("            --entry <name>      decode only this file of a container\n");
+        printf("            -q, --quiet  no progress messages\n");
+        printf("            --stats      print per-stage timings and I/O counters as JSON\n");
         return 1;
     }
 
+    StegoOptions opts;   // options shared by encoding and decoding
+    stego_set_error_handler(print_library_error);       // engine and parser failures are printed as errors
+    init_options(&opts);
+    int status = 1;
+    if (parse_options(&argc, argv, &opts) == e_success)   // remove options, keep file names in place
+        status = run_operation(argc, argv, &opts);
+    free_options(&opts);   // the --add list
+    return status;
+}
+
+// run the operation selected on the command line, argv holds only file names by now
+static int run_operation(int argc, char *argv[], StegoOptions *opts)
+{
+    if (lsb_select_kernel(opts->kernel) == e_failure)      // pick the embed/extract kernel once at startup
+        return 1;
+
     if(check_operation_type(argv) == e_encode) // check if the user selected "-e"
     {
         if (argc < 4)  // check if the user passed enough arguments for encoding
         {
             printf("Error: Not enough arguments for encoding.\n");
-            printf("Usage: %s -e <.bmp file> <secret.txt> [output_stego.bmp]\n", argv[0]);
+            printf("Usage: %s -e <cover image> <secret.txt> [output_stego image]\n", argv[0]);
             return 1;
         }
 
-        printf("You have choosed encoding\n");  // Inform user that encoding mode is selected
-        EncodeInfo encInfo;  // Structure to store encoding info
+        print_status(opts, "You have choosed encoding\n");  // Inform user that encoding mode is selected
+        EncodeInfo encInfo = {0};  // Structure to store encoding info
+        encInfo.opts = *opts;
         if(read_and_validate_encode_args(argv,&encInfo) == e_success)   // Validate command-line arguments for encoding
         {
-            printf("Raed and validate is successfull\n");  // Inform user that encoding arguments are read and validated successfully
+            print_status(opts, "Raed and validate is successfull\n");  // Inform user that encoding arguments are read and validated successfully
             if(do_encoding(&encInfo) == e_success)  //Perform encoding
             {
-                printf("Encoding is successfull\n");  // Success message for encoding
+                print_status(opts, "Encoding is successfull\n");  // Success message for encoding
             }
             else
             {
@@ -69,20 +126,21 @@ int main(int argc,char *argv[])
         if (argc < 3)  // check if the user passed enough arguments for decoding
         {
             printf("Error: Not enough arguments for decoding.\n");
-            printf("Usage: %s -d <stego.bmp> [output.txt]\n", argv[0]);
+            printf("Usage: %s -d <stego image> [output.txt]\n", argv[0]);
             return 1;
         }
         
-        printf("You have choosed decoding\n"); // Inform user that decoding mode is selected
-        DecodeInfo decInfo;  //Structure to store decoding info
+        print_status(opts, "You have choosed decoding\n"); // Inform user that decoding mode is selected
+        DecodeInfo decInfo = {0};  //Structure to store decoding info
+        decInfo.opts = *opts;
 
         if (read_and_validate_decode_args(argv, &decInfo) == e_success) // Validate command-line arguments for decoding
         {
-            printf("Read and validate for decoding is successful\n"); // Inform user that decoding arguments are read and validated successfully
+            print_status(opts, "Read and validate for decoding is successful\n"); // Inform user that decoding arguments are read and validated successfully
 
             if (do_decoding(&decInfo) == e_success)  //Perform decoding
             {
-                printf("Decoding is successful\n");  // Success message for decoding
+                print_status(opts, "Decoding is successful\n");  // Success message for decoding
             }
             else
             {
@@ -96,6 +154,67 @@ int main(int argc,char *argv[])
             return e_failure;  //Exit program
         } 
     }
+    else if(check_operation_type(argv) == e_batch)  // Check if the user selected "--batch"
+    {
+        if (argc < 3)  // check if the user passed a manifest
+        {
+            printf("Error: Missing manifest file.\n");
+            printf("Usage: %s --batch <manifest> [-j workers]\n", argv[0]);
+            return 1;
+        }
+
+        if (do_batch(argv[2], opts) == e_failure)  // run every job of the manifest
+            return e_failure;  //Exit program with failure status
+    }
+    else if(check_operation_type(argv) == e_scan)  // Check if the user selected "scan"
+    {
+        if (argc < 3)  // check if the user passed a directory
+        {
+            printf("Error: Missing directory to scan.\n");
+            printf("Usage: %s scan <directory> [index.tsv] -m <magic> [-j workers]\n", argv[0]);
+            return 1;
+        }
+
+        if (do_scan(argv[2], argv[3], opts) == e_failure)  // index every payload under the directory
+            return e_failure;  //Exit program with failure status
+    }
+    else if(check_operation_type(argv) == e_bench)  // Check if the user selected "bench"
+    {
+        if (do_bench(argv + 2, opts) == e_failure)  // time every stage on synthetic covers
+            return e_failure;  //Exit program with failure status
+    }
+    else if(check_operation_type(argv) == e_shard)  // Check if the user selected "shard"
+    {
+        if (argc >= 6 && strcmp(argv[2], "-e") == 0)  // one secret over every cover given
+        {
+            if (do_shard_encode(argv[3], argv[4], argv + 5, argc - 5, opts) == e_failure)
+                return e_failure;  //Exit program with failure status
+        }
+        else if (argc >= 5 && strcmp(argv[2], "-d") == 0)  // the stego images of one set, in any order
+        {
+            if (do_shard_decode(argv[3], argv + 4, argc - 4, opts) == e_failure)
+                return e_failure;  //Exit program with failure status
+        }
+        else
+        {
+            printf("Error: Not enough arguments for shard mode.\n");
+            printf("Usage: %s shard -e <secret.txt> <output_dir> <cover.bmp>... -m <magic>\n", argv[0]);
+            printf("       %s shard -d <output.txt> <stego.bmp>... -m <magic>\n", argv[0]);
+            return 1;
+        }
+    }
+    else if(check_operation_type(argv) == e_daemon)  // Check if the user selected "stegod"
+    {
+        if (argc < 3)  // check if the user passed a socket path
+        {
+            printf("Error: Missing socket path.\n");
+            printf("Usage: %s stegod <socket> [-j workers] [--uring]\n", argv[0]);
+            return 1;
+        }
+
+        if (do_daemon(argv[2], opts) == e_failure)  // serve requests until shut down
+            return e_failure;  //Exit program with failure status
+    }
     else  // If the user didn't provide enough arguments that time this block will executed
     {   
         printf("Pass correct arguments\n");
@@ -112,6 +231,16 @@ OperationType check_operation_type(char *argv[])  // Function to check if user s
        return e_encode;             
     else if(strcmp(argv[1],"-d")==0)  // compare input with "-d"
        return e_decode;
+    else if(strcmp(argv[1],"--batch")==0)  // compare input with "--batch"
+       return e_batch;
+    else if(strcmp(argv[1],"scan")==0 || strcmp(argv[1],"--scan")==0)  // compare input with "scan"
+       return e_scan;
+    else if(strcmp(argv[1],"bench")==0 || strcmp(argv[1],"--bench")==0)  // compare input with "bench"
+       return e_bench;
+    else if(strcmp(argv[1],"shard")==0 || strcmp(argv[1],"--shard")==0)  // compare input with "shard"
+       return e_shard;
+    else if(strcmp(argv[1],"stegod")==0 || strcmp(argv[1],"--daemon")==0)  // compare input with "stegod"
+       return e_daemon;
     else                             // this is for invalid input
        return e_unsupported;
 }
\ No newline at end of file
@@ -0,0 +1,64 @@
+#include "tga.h"        // for TGA declarations
+#include "cover.h"      // for cover_short
+
+#define TGA_MAPPED 1          // colour-mapped image type
+#define TGA_TRUE_COLOUR 2
+#define TGA_GREY 3
+#define TGA_RLE 8             // added to the type of a run-length encoded image
+#define TGA_TOP_DOWN 0x20     // image descriptor: top row first
+#define TGA_INTERLEAVE 0xc0   // image descriptor: interleaved rows, never written these days
+
+static uint32_t le16(const uint8_t *p)
+{
+    return p[0] | (p[1] << 8);
+}
+
+const char *tga_parse_header(const uint8_t *header, size_t len, BmpInfo *info)
+{
+    if (len < TGA_HEADER_SIZE)
+    {
+        info->header_len = TGA_HEADER_SIZE;
+        return cover_short;
+    }
+
+    uint32_t id_len = header[0];
+    uint32_t map_type = header[1];
+    uint32_t type = header[2] & ~TGA_RLE;
+    uint32_t map_len = le16(header + 5);
+    uint32_t map_bits = header[7];
+    uint32_t width = le16(header + 12);
+    uint32_t height = le16(header + 14);
+    uint32_t bpp = header[16];
+    uint32_t desc = header[17];
+
+    // no magic: anything that does not look like a TGA header is some other file
+    if (map_type > 1 || type < TGA_MAPPED || type > TGA_GREY || (desc & TGA_INTERLEAVE) ||
+        width == 0 || height == 0 || (map_type == 0 && (map_len != 0 || type == TGA_MAPPED)))
+        return "not a BMP, PPM, PAM or TGA image";
+
+    if (header[2] & TGA_RLE)
+        return "run-length encoded TGA images are not supported";
+
+    // byte LSBs are colour LSBs only in 8-bit channels: not in colour map indices,
+    // nor in the 5-5-5 pixels of 16 bpp true colour
+    if (type == TGA_MAPPED)
+        return "colour-mapped TGA images are not supported";
+
+    if (type == TGA_TRUE_COLOUR ? bpp != 24 && bpp != 32 : bpp != 8)
+        return "unsupported TGA pixel depth";
+
+    info->format = e_cover_tga;
+    info->header_len = TGA_HEADER_SIZE;
+    info->file_size = 0;
+    info->pixel_offset = TGA_HEADER_SIZE + id_len + (map_type ? map_len * ((map_bits + 7) / 8) : 0);   // past the ID and colour map
+    info->dib_size = 0;
+    info->width = width;
+    info->height = height;
+    info->top_down = (desc & TGA_TOP_DOWN) != 0;
+    info->bits_per_pixel = bpp;
+    info->compression = 0;
+    info->rows = height;
+    info->row_bytes = (size_t)width * bpp / 8;
+    info->stride = info->row_bytes;   // no row padding
+    return NULL;
+}
@@ -0,0 +1,26 @@
+#ifndef TGA_H
+#define TGA_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include "bmp.h"    // Contains the pixel row geometry
+
+/*
+ * Uncompressed TGA covers: 24 and 32 bpp true colour (image type 2)
+ * and 8 bpp greyscale (type 3). The 18-byte header is followed by the
+ * image ID and any colour map, both passed over, then the pixels
+ * with no row padding, bottom row first unless bit 5 of the image
+ * descriptor is set, in BGR(A) order like a BMP. TGA has no magic
+ * bytes, so the header fields are checked hard before an image is
+ * taken for one; the footer of a version 2 file is copied untouched.
+ * Colour-mapped images (type 1), 16 bpp true colour and run-length
+ * encoded images (types 9-11) are refused.
+ */
+
+#define TGA_HEADER_SIZE 18
+
+/* Parse the first len bytes of a TGA image, returns NULL or why it cannot be
+   used (cover_short when len is below TGA_HEADER_SIZE) */
+const char *tga_parse_header(const uint8_t *header, size_t len, BmpInfo *info);
+
+#endif
@@ -15,6 +15,11 @@ typedef enum
 {
     e_encode,
     e_decode,
+    e_batch,
+    e_scan,
+    e_bench,
+    e_shard,
+    e_daemon,
     e_unsupported
 } OperationType;
 
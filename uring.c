@@ -0,0 +1,262 @@
+#include <stdlib.h>     // for aligned_alloc/free
+#include <string.h>     // for memset
+#include <errno.h>      // for EINTR
+#include <unistd.h>     // for syscall/close
+#include <sys/mman.h>   // for mmap/munmap
+#include <sys/uio.h>    // for struct iovec
+#include <sys/syscall.h>    // for the io_uring syscall numbers
+#include <linux/io_uring.h> // for the ring layout and opcodes
+#include "uring.h"      // for uring declarations
+#include "block.h"      // for hooking the ring into the block engine
+
+#define URING_PAGE 4096   // buffers start on a page so the kernel pins whole pages
+
+static int sys_setup(unsigned entries, struct io_uring_params *p)
+{
+    return (int)syscall(__NR_io_uring_setup, entries, p);
+}
+
+static int sys_enter(int fd, unsigned submit, unsigned min_complete, unsigned flags)
+{
+    return (int)syscall(__NR_io_uring_enter, fd, submit, min_complete, flags, NULL, 0);
+}
+
+static int sys_register(int fd, unsigned opcode, void *arg, unsigned nr)
+{
+    return (int)syscall(__NR_io_uring_register, fd, opcode, arg, nr);
+}
+
+// map the submission and completion rings and the entries
+static Status map_rings(Uring *ur, const struct io_uring_params *p)
+{
+    ur->sq_ring_size = p->sq_off.array + p->sq_entries * sizeof(unsigned);
+    ur->cq_ring_size = p->cq_off.cqes + p->cq_entries * sizeof(struct io_uring_cqe);
+    if (p->features & IORING_FEAT_SINGLE_MMAP)   // both rings share one mapping
+    {
+        if (ur->cq_ring_size > ur->sq_ring_size)
+            ur->sq_ring_size = ur->cq_ring_size;
+        ur->cq_ring_size = ur->sq_ring_size;
+    }
+
+    ur->sq_ring = mmap(NULL, ur->sq_ring_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ur->fd, IORING_OFF_SQ_RING);
+    if (ur->sq_ring == MAP_FAILED)
+        return e_failure;
+
+    if (p->features & IORING_FEAT_SINGLE_MMAP)
+        ur->cq_ring = ur->sq_ring;
+    else
+    {
+        ur->cq_ring = mmap(NULL, ur->cq_ring_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ur->fd, IORING_OFF_CQ_RING);
+        if (ur->cq_ring == MAP_FAILED)
+            return e_failure;
+    }
+
+    ur->sqes_size = p->sq_entries * sizeof(struct io_uring_sqe);
+    ur->sqes = mmap(NULL, ur->sqes_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ur->fd, IORING_OFF_SQES);
+    if (ur->sqes == MAP_FAILED)
+        return e_failure;
+
+    unsigned char *sq = ur->sq_ring, *cq = ur->cq_ring;
+    ur->sq_tail = (unsigned *)(sq + p->sq_off.tail);
+    ur->sq_mask = (unsigned *)(sq + p->sq_off.ring_mask);
+    ur->sq_array = (unsigned *)(sq + p->sq_off.array);
+    ur->cq_head = (unsigned *)(cq + p->cq_off.head);
+    ur->cq_tail = (unsigned *)(cq + p->cq_off.tail);
+    ur->cq_mask = (unsigned *)(cq + p->cq_off.ring_mask);
+    ur->cqes = cq + p->cq_off.cqes;
+    return e_success;
+}
+
+// hand the pool to the kernel once, so every read and write skips pinning the pages again
+static void register_buffers(Uring *ur)
+{
+    struct iovec iov[URING_BUFFERS];
+
+    for (int i = 0; i < URING_BUFFERS; i++)
+    {
+        iov[i].iov_base = ur->pool + i * ur->stride;
+        iov[i].iov_len = ur->stride;
+    }
+    ur->fixed = sys_register(ur->fd, IORING_REGISTER_BUFFERS, iov, URING_BUFFERS) == 0;   // plain reads and writes when over RLIMIT_MEMLOCK
+}
+
+Status uring_init(Uring *ur, size_t block_size)
+{
+    struct io_uring_params p;
+
+    memset(ur, 0, sizeof(*ur));
+    memset(&p, 0, sizeof(p));
+    ur->sq_ring = ur->cq_ring = ur->sqes = MAP_FAILED;
+
+    ur->stride = (URING_HEADROOM + block_size + URING_PAGE - 1) / URING_PAGE * URING_PAGE;
+    ur->pool = aligned_alloc(URING_PAGE, URING_BUFFERS * ur->stride);
+    ur->fd = sys_setup(URING_ENTRIES, &p);   // ENOSYS on old kernels, EPERM where io_uring is disabled
+
+    if (ur->pool == NULL || ur->fd < 0 || map_rings(ur, &p) == e_failure)
+    {
+        uring_free(ur);
+        return e_failure;
+    }
+    register_buffers(ur);
+
+    static const BlockUringOps ops = { uring_acquire, uring_buffer, uring_read, uring_wait,
+                                       uring_write, uring_release, uring_drain };
+    block_set_uring_ops(&ops);   // the engine only calls in through this table
+    return e_success;
+}
+
+// sort out one completion: a finished write frees its buffer, a finished read keeps its result
+static void complete(Uring *ur, const struct io_uring_cqe *cqe)
+{
+    int buf = (int)cqe->user_data;
+
+    if (ur->state[buf] == e_uring_writing)
+    {
+        if (cqe->res < 0 || (size_t)cqe->res != ur->expect[buf])
+            ur->failed = 1;
+        ur->state[buf] = e_uring_free;
+    }
+    else
+    {
+        ur->result[buf] = cqe->res;
+        ur->state[buf] = e_uring_owned;
+    }
+}
+
+// take every completion posted so far, waiting for one when block is set and none is there
+static Status reap(Uring *ur, int block)
+{
+    unsigned head = *ur->cq_head;
+
+    while (block && head == __atomic_load_n(ur->cq_tail, __ATOMIC_ACQUIRE))
+    {
+        if (sys_enter(ur->fd, 0, 1, IORING_ENTER_GETEVENTS) < 0 && errno != EINTR)
+            return e_failure;
+    }
+
+    struct io_uring_cqe *cqes = ur->cqes;
+    for (; head != __atomic_load_n(ur->cq_tail, __ATOMIC_ACQUIRE); head++)
+        complete(ur, &cqes[head & *ur->cq_mask]);
+    __atomic_store_n(ur->cq_head, head, __ATOMIC_RELEASE);
+    return e_success;
+}
+
+// queue one read or write on buffer buf and hand it to the kernel
+static Status submit(Uring *ur, int fixed_op, int op, int buf, const unsigned char *addr, int fd, long off, size_t len)
+{
+    unsigned tail = *ur->sq_tail;
+    unsigned idx = tail & *ur->sq_mask;
+    struct io_uring_sqe *sqe = (struct io_uring_sqe *)ur->sqes + idx;
+
+    memset(sqe, 0, sizeof(*sqe));
+    sqe->opcode = ur->fixed ? fixed_op : op;
+    sqe->fd = fd;
+    sqe->off = off;
+    sqe->addr = (unsigned long)addr;
+    sqe->len = len;
+    sqe->buf_index = ur->fixed ? buf : 0;
+    sqe->user_data = buf;
+
+    ur->sq_array[idx] = idx;
+    __atomic_store_n(ur->sq_tail, tail + 1, __ATOMIC_RELEASE);
+
+    int n;
+    while ((n = sys_enter(ur->fd, 1, 0, 0)) < 0 && errno == EINTR)
+        ;
+    return n == 1 ? e_success : e_failure;
+}
+
+int uring_acquire(Uring *ur)
+{
+    for (;;)
+    {
+        int writing = 0;
+        for (int i = 0; i < URING_BUFFERS; i++)
+        {
+            if (ur->state[i] == e_uring_free)
+            {
+                ur->state[i] = e_uring_owned;
+                return i;
+            }
+            writing |= ur->state[i] == e_uring_writing;
+        }
+        if (!writing || reap(ur, 1) == e_failure)   // every buffer is taken by the caller
+            return -1;
+    }
+}
+
+unsigned char *uring_buffer(Uring *ur, int buf)
+{
+    return ur->pool + buf * ur->stride;
+}
+
+Status uring_read(Uring *ur, int buf, unsigned char *addr, int fd, long off, size_t len)
+{
+    ur->state[buf] = e_uring_reading;
+    if (submit(ur, IORING_OP_READ_FIXED, IORING_OP_READ, buf, addr, fd, off, len) == e_failure)
+    {
+        ur->state[buf] = e_uring_owned;
+        return e_failure;
+    }
+    return e_success;
+}
+
+long uring_wait(Uring *ur, int buf)
+{
+    while (ur->state[buf] == e_uring_reading)
+    {
+        if (reap(ur, 1) == e_failure)
+            return -errno;
+    }
+    return ur->result[buf];
+}
+
+Status uring_write(Uring *ur, int buf, const unsigned char *addr, int fd, long off, size_t len)
+{
+    ur->state[buf] = e_uring_writing;
+    ur->expect[buf] = len;
+    if (submit(ur, IORING_OP_WRITE_FIXED, IORING_OP_WRITE, buf, addr, fd, off, len) == e_failure)
+    {
+        ur->state[buf] = e_uring_free;
+        return e_failure;
+    }
+    return e_success;
+}
+
+void uring_release(Uring *ur, int buf)
+{
+    ur->state[buf] = e_uring_free;
+}
+
+Status uring_drain(Uring *ur)
+{
+    for (int i = 0; i < URING_BUFFERS; i++)
+    {
+        while (ur->state[i] == e_uring_writing)
+        {
+            if (reap(ur, 1) == e_failure)
+                return e_failure;
+        }
+    }
+
+    Status status = ur->failed ? e_failure : e_success;
+    ur->failed = 0;
+    return status;
+}
+
+void uring_free(Uring *ur)
+{
+    if (ur->sqes != MAP_FAILED)
+        munmap(ur->sqes, ur->sqes_size);
+    if (ur->cq_ring != MAP_FAILED && ur->cq_ring != ur->sq_ring)
+        munmap(ur->cq_ring, ur->cq_ring_size);
+    if (ur->sq_ring != MAP_FAILED)
+        munmap(ur->sq_ring, ur->sq_ring_size);
+    if (ur->fd >= 0)
+        close(ur->fd);   // also drops the registered buffers
+
+    free(ur->pool);
+    ur->pool = NULL;
+    ur->fd = -1;
+    ur->sq_ring = ur->cq_ring = ur->sqes = MAP_FAILED;
+}
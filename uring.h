@@ -0,0 +1,83 @@
+#ifndef URING_H
+#define URING_H
+
+#include <stddef.h>
+#include "types.h"  // Contains user-defined types
+
+/*
+ * Linux io_uring backend for the block engine (batch --uring).
+ * One ring per batch worker owns a fixed pool of block buffers,
+ * registered with the kernel so reads and writes skip the per-call
+ * page pinning. While the kernels embed the current block, the
+ * next block of the cover is already being read into another
+ * buffer and finished blocks are still being written out of theirs.
+ * The ring is driven with the raw syscalls, no liburing needed;
+ * where io_uring is missing or not allowed, uring_init() fails and
+ * the engine stays on stdio.
+ */
+
+#define URING_BUFFERS 4         // the block being embedded, one read ahead, two being written
+#define URING_HEADROOM 4096     // room before a block for the open layout step carried into it
+#define URING_ENTRIES 8         // submission queue slots, more than buffers ever in flight
+
+typedef enum
+{
+    e_uring_free,
+    e_uring_owned,      // handed out, no I/O in flight
+    e_uring_reading,
+    e_uring_writing
+} UringState;
+
+typedef struct _Uring
+{
+    int fd;                       // ring file descriptor, -1 when not set up
+    void *sq_ring;                // submission ring mapping
+    void *cq_ring;                // completion ring mapping, the same as sq_ring on newer kernels
+    size_t sq_ring_size;
+    size_t cq_ring_size;
+    void *sqes;                   // submission queue entries
+    size_t sqes_size;
+
+    unsigned *sq_tail, *sq_mask, *sq_array;
+    unsigned *cq_head, *cq_tail, *cq_mask;
+    void *cqes;
+
+    unsigned char *pool;          // URING_BUFFERS buffers of stride bytes
+    size_t stride;                // URING_HEADROOM plus one block, page rounded
+    int fixed;                    // buffers are registered, READ_FIXED / WRITE_FIXED are used
+
+    UringState state[URING_BUFFERS];
+    long result[URING_BUFFERS];   // bytes read, or -errno, once a read completes
+    size_t expect[URING_BUFFERS]; // bytes a write in flight has to write
+    int failed;                   // a write came up short since the last uring_drain
+
+} Uring;
+
+/* Set up a ring and its buffer pool for blocks of block_size bytes, fails (printing nothing) without io_uring */
+Status uring_init(Uring *ur, size_t block_size);
+
+/* Take a free buffer, waiting for a write to finish when all are busy; -1 on error */
+int uring_acquire(Uring *ur);
+
+/* Start of buffer buf, the block itself goes URING_HEADROOM bytes in */
+unsigned char *uring_buffer(Uring *ur, int buf);
+
+/* Start reading len bytes at file offset off into addr, which lies in buffer buf */
+Status uring_read(Uring *ur, int buf, unsigned char *addr, int fd, long off, size_t len);
+
+/* Wait for the read into buf, returns the bytes read or -errno; the buffer stays taken */
+long uring_wait(Uring *ur, int buf);
+
+/* Start writing len bytes at addr (in buffer buf) to file offset off; the buffer is free again once written */
+Status uring_write(Uring *ur, int buf, const unsigned char *addr, int fd, long off, size_t len);
+
+/* Give back a buffer with no I/O in flight */
+void uring_release(Uring *ur, int buf);
+
+/* Wait for every write in flight, fails when any of them came up short */
+Status uring_drain(Uring *ur);
+
+/* Tear down the ring and free its buffers */
+void uring_free(Uring *ur);
+
+#endif
@@ -0,0 +1,38 @@
+#include "varint.h"     // for varint declarations
+
+size_t varint_len(uint64_t value)
+{
+    size_t n = 1;
+
+    for (; value >= 0x80; value >>= 7)
+        n++;
+    return n;
+}
+
+size_t varint_put(uint8_t *p, uint64_t value)
+{
+    size_t n = 0;
+
+    for (; value >= 0x80; value >>= 7)
+        p[n++] = (uint8_t)value | 0x80;   // more groups follow
+    p[n++] = (uint8_t)value;
+    return n;
+}
+
+size_t varint_get(const uint8_t *p, size_t len, uint64_t *value)
+{
+    uint64_t v = 0;
+
+    for (size_t n = 0; n < len && n < VARINT_MAX_LEN; n++)
+    {
+        if (n == VARINT_MAX_LEN - 1 && p[n] > 1)   // the tenth byte holds only bit 63
+            return 0;
+        v |= (uint64_t)(p[n] & 0x7F) << (7 * n);
+        if (!(p[n] & 0x80))
+        {
+            *value = v;
+            return n + 1;
+        }
+    }
+    return 0;
+}
@@ -0,0 +1,26 @@
+#ifndef VARINT_H
+#define VARINT_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+/*
+ * Variable-length 64-bit integers (unsigned LEB128) used for the
+ * size fields of version 2 payload headers: 7 bits per byte, least
+ * significant group first, the top bit set on every byte but the
+ * last. Sizes below 128 take one byte instead of the four of a
+ * 32-bit field, and no size up to 2^64 - 1 overflows.
+ */
+
+#define VARINT_MAX_LEN 10   // bytes of the largest 64-bit value
+
+/* Bytes value takes as a varint */
+size_t varint_len(uint64_t value);
+
+/* Write value at p (VARINT_MAX_LEN bytes of room), returns the bytes written */
+size_t varint_put(uint8_t *p, uint64_t value);
+
+/* Read a varint from the len bytes at p, returns the bytes read or 0 when it is cut short or too long */
+size_t varint_get(const uint8_t *p, size_t len, uint64_t *value);
+
+#endif